@@ -13,6 +13,8 @@
 #define TICK_INTERVAL_US (1000000 / TICK_RATE_HZ)
 #define MAX_MSG_PAYLOAD  256
 #define MSG_HEADER_SIZE  3
+#define UDP_INPUT_REDUNDANCY 4   /* inputs repeated in every input datagram */
+#define LOCKSTEP_WINDOW  32      /* ticks a lockstep peer may run ahead */
 
 typedef enum {
     ROLE_PLAYER    = 0,
@@ -23,6 +25,11 @@ typedef enum {
     GAME_PONG = 0
 } game_type_t;
 
+typedef enum {
+    GAME_MODE_SERVER   = 0,   /* the host simulates and sends state */
+    GAME_MODE_LOCKSTEP = 1    /* both players simulate; only inputs travel */
+} game_mode_t;
+
 typedef enum {
     COLOR_P1       = 1,
     COLOR_P2       = 2,
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "network.h"
 #include "platform.h"
+#include "protocol.h"
 
 typedef struct game_def game_def_t;
 
@@ -13,12 +14,39 @@ struct game_def {
     size_t      state_size;
 
     void (*init)(void *state, int rows, int cols);
+    /* Optional: seeds whatever the game leaves to chance. Two states
+     * given the same seed and the same inputs must stay identical. */
+    void (*seed)(void *state, uint32_t seed);
     void (*handle_input)(void *state, int player_id, int key);
+    /* Optional: actions that repeat every tick while their key is held.
+     * key_action maps a key to its action bit (0 for none); set_held
+     * receives every action a player now holds. */
+    uint8_t (*key_action)(int key);
+    void (*set_held)(void *state, int player_id, uint8_t held);
     void (*update)(void *state);
+    /* Optional: one tick of only what player_id drives from its held
+     * actions, for a client predicting its own side between snapshots */
+    void (*predict_tick)(void *state, int player_id);
     void (*render)(void *state, const char *p1_name, const char *p2_name,
                    bool is_spectator, int spectator_count);
+    /* Optional: render draws only what changed since its last frame,
+     * and this tells it the screen was wiped, so the next frame must
+     * draw everything. NULL means render always draws everything. */
+    void (*render_reset)(void);
     int  (*pack_state)(const void *state, uint8_t *buf, size_t buflen);
     int  (*unpack_state)(void *state, const uint8_t *buf, size_t len);
+    /* Optional: hash of everything update() depends on, for lockstep
+     * peers to compare; see game_hash_u32. NULL hashes pack_state's
+     * output, which may leave out or round some of it. */
+    uint32_t (*hash_state)(const void *state);
+    /* Optional: encode a packed state against an older packed baseline
+     * and back. NULL uses the generic XOR codec in snapshot.c. */
+    int  (*delta_encode)(const uint8_t *base, size_t base_len,
+                         const uint8_t *cur, size_t cur_len,
+                         uint8_t *out, size_t outlen);
+    int  (*delta_decode)(const uint8_t *base, size_t base_len,
+                         const uint8_t *delta, size_t delta_len,
+                         uint8_t *out, size_t outlen);
     bool (*is_over)(const void *state);
     int  (*get_winner)(const void *state);
 };
@@ -34,17 +62,89 @@ typedef struct {
     bool              is_spectator;
     int               spectator_count;
     uint8_t           local_player_id;
+    int               rows, cols;     /* the field */
+    uint32_t          seed;
+    bool              lockstep;       /* peers simulate, only inputs travel */
 } game_session_t;
 
+#ifndef BYTES_HEADLESS
+/* Sizes the field to the terminal */
 void game_session_init(game_session_t *gs, const game_def_t *def,
                        const char *p1, const char *p2,
                        bool is_server, bool is_spectator,
                        uint8_t local_player_id);
+#endif
+void game_session_init_sized(game_session_t *gs, const game_def_t *def,
+                             const char *p1, const char *p2,
+                             bool is_server, bool is_spectator,
+                             uint8_t local_player_id, int rows, int cols);
 void game_session_cleanup(game_session_t *gs);
+void game_session_seed(game_session_t *gs, uint32_t seed);
+/* A seed for a new match */
+uint32_t game_random_seed(void);
+/* Packs the MSG_GAME_START describing the session */
+int  game_pack_start(const game_session_t *gs, uint8_t *buf, size_t buflen);
+#ifndef BYTES_HEADLESS
+/* Sets up the session a MSG_GAME_START describes; a start without a
+ * field size gets the terminal's */
+void game_session_init_start(game_session_t *gs, const msg_game_start_t *start,
+                             bool is_spectator, uint8_t local_player_id);
+#endif
+
+/* An input is a key, applied once through handle_input, or with
+ * GAME_INPUT_HELD set the full set of actions now held down */
+#define GAME_INPUT_HELD 0x40000000
+#define GAME_INPUT_NONE (-1)
+
+void game_apply_input(const game_def_t *def, void *state, int player_id,
+                      int32_t input);
+
+/* FNV-1a over v's bytes in little-endian order, so every platform gets
+ * the same hash; start from GAME_HASH_INIT */
+#define GAME_HASH_INIT 2166136261u
+
+static inline uint32_t game_hash_u32(uint32_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        h ^= (v >> (8 * i)) & 0xFF;
+        h *= 16777619u;
+    }
+    return h;
+}
 
-void game_run_server(game_session_t *gs, net_server_t *srv, int player_client_idx);
-void game_run_client(game_session_t *gs, net_connection_t *conn);
+/* Terminals report key presses and their autorepeat but never releases.
+ * A first press stays an ordinary key; a repeat arriving soon after it
+ * holds the action, and a gap in the repeats lets go again. */
+#define GAME_KEY_REPEAT_US  700000   /* first press to first repeat */
+#define GAME_KEY_RELEASE_US 150000   /* no repeat for this long = released */
+
+typedef struct {
+    uint8_t held;
+    int64_t last_us[8];   /* newest event per action bit, 0 = idle */
+} game_keys_t;
+
+/* Returns the input a key amounts to, or GAME_INPUT_NONE when it only
+ * keeps a hold alive */
+int32_t game_keys_feed(game_keys_t *k, const game_def_t *def, int key,
+                       int64_t now_us);
+/* Returns a GAME_INPUT_HELD input once a held key has gone quiet */
+int32_t game_keys_poll(game_keys_t *k, int64_t now_us);
+
+#ifndef BYTES_HEADLESS
+/* Draws the state through term.h without showing it; term_present()
+ * does that. With full, or for a game that can't draw just the changes,
+ * the screen is erased first; pass full on a loop's first frame and
+ * after anything else drew over the field. overlay says the caller
+ * draws over the field with curses before presenting. */
+void game_render(const game_session_t *gs, bool full, bool overlay);
+
+/* udp may be NULL; otherwise it carries snapshots and player input
+ * alongside the TCP session once both ends have heard each other. */
+void game_run_server(game_session_t *gs, net_server_t *srv, int player_client_idx,
+                     net_udp_t *udp);
+void game_run_client(game_session_t *gs, net_connection_t *conn, net_udp_t *udp);
 void game_run_spectator(game_session_t *gs, net_connection_t *conn);
+#endif
 
 const game_def_t *game_get_def(game_type_t type);
 int game_get_count(void);
@@ -0,0 +1,45 @@
+#ifndef BYTES_LINKSTATS_H
+#define BYTES_LINKSTATS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#define LINKSTATS_PING_INTERVAL_US 250000
+#define LINKSTATS_PING_TIMEOUT_US  1000000   /* unanswered this long = lost */
+#define LINKSTATS_PINGS            8         /* awaiting an answer at once */
+
+/* Link quality as one end sees it. RTT is smoothed like TCP's SRTT,
+ * jitter is the smoothed change between consecutive RTTs (RFC 3550)
+ * and loss the smoothed share of pings that never came back. */
+typedef struct {
+    uint32_t next_seq;
+    uint32_t pending_seq[LINKSTATS_PINGS];
+    int64_t  pending_us[LINKSTATS_PINGS];   /* 0 = free */
+    int64_t  next_ping_us;
+
+    bool     have_rtt;
+    float    last_rtt_ms;
+    float    srtt_ms;
+    float    jitter_ms;
+    float    loss;                          /* 0..1 */
+
+    /* Per-second rates over the last full second */
+    uint32_t ticks;                         /* bumped by the caller */
+    int64_t  window_start_us;
+    uint64_t window_rx, window_tx;
+    uint32_t window_ticks;
+    uint32_t rx_rate, tx_rate;              /* bytes/s */
+    uint32_t tick_rate;
+} linkstats_t;
+
+void linkstats_init(linkstats_t *ls, int64_t now_us);
+/* Returns the sequence number of a ping to send now, or 0 */
+uint32_t linkstats_ping_due(linkstats_t *ls, int64_t now_us);
+void linkstats_pong(linkstats_t *ls, uint32_t seq, uint64_t sent_us,
+                    int64_t now_us);
+/* Expires unanswered pings and rolls the rates; rx and tx are the byte
+ * totals so far in each direction */
+void linkstats_update(linkstats_t *ls, int64_t now_us, uint64_t rx, uint64_t tx);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef BYTES_LOCKSTEP_H
+#define BYTES_LOCKSTEP_H
+
+#include "common.h"
+#include "game.h"
+#include "protocol.h"
+
+/* Lockstep with rollback. Both peers simulate every tick from their own
+ * input and the other's; an input that hasn't arrived yet is guessed to
+ * hold whatever the last one held. When the real one turns out to
+ * differ, the state goes back to that tick and the ticks since are
+ * simulated again. A tick both inputs are known for is confirmed, and
+ * every LOCKSTEP_HASH_TICKS the peers compare hashes of one.
+ *
+ * Tick t applies the inputs for t, then update(). The state before each
+ * of the last LOCKSTEP_WINDOW ticks is kept to roll back to, so a peer
+ * stalls rather than run that far past the other's inputs. Game states
+ * must be plain data; they are copied with memcpy(). */
+#define LOCKSTEP_HASH_TICKS TICK_RATE_HZ
+#define LOCKSTEP_HASHES     8    /* per side, awaiting comparison */
+#define LOCKSTEP_KEYS       4    /* local keys waiting for a tick */
+#define LOCKSTEP_SYNC_TICKS 10   /* at most one tick given up per this many */
+
+typedef struct {
+    uint8_t held;
+    int32_t key;                 /* GAME_INPUT_NONE for none */
+} lockstep_input_t;
+
+typedef struct {
+    uint32_t tick;               /* 0 = empty */
+    uint32_t hash;
+} lockstep_hash_t;
+
+typedef struct {
+    const game_def_t *def;
+    int              local;           /* our player id */
+    uint32_t         tick;            /* ticks simulated */
+    uint32_t         confirmed;       /* ticks simulated on real inputs */
+    uint32_t         remote_tick;     /* newest tick with the peer's input */
+    uint32_t         resim_from;      /* oldest tick run on a wrong guess */
+    uint32_t         sent;            /* newest input of ours sent */
+    uint32_t         acked;           /* remote_tick as last acknowledged */
+    uint32_t         peer_ack;        /* newest input of ours the peer has */
+    int              peer_advantage;
+    uint32_t         next_sync;
+
+    uint8_t          held;            /* local actions held now */
+    int32_t          keys[LOCKSTEP_KEYS];
+    int              nkeys;
+
+    lockstep_input_t inputs[2][LOCKSTEP_WINDOW];   /* by tick % window */
+    uint8_t         *states;          /* state before each tick, likewise */
+
+    lockstep_hash_t  hashes[LOCKSTEP_HASHES];
+    lockstep_hash_t  peer_hashes[LOCKSTEP_HASHES];
+    uint32_t         hash_sent;
+    uint32_t         desync_tick;     /* first tick found to differ, 0 = none */
+
+    uint32_t         rollbacks;
+    uint32_t         resimulated;     /* ticks simulated a second time */
+} lockstep_t;
+
+/* Allocates the state history; -1 if that fails */
+int  lockstep_init(lockstep_t *ls, const game_def_t *def, int local_player_id);
+void lockstep_free(lockstep_t *ls);
+
+/* Queues a local input for the next tick */
+void lockstep_local_input(lockstep_t *ls, int32_t input);
+/* Simulates the next tick into state. Returns 0, doing nothing, while
+ * the peer's inputs lag a whole window behind or we run ahead of it. */
+int  lockstep_step(lockstep_t *ls, void *state);
+void lockstep_receive(lockstep_t *ls, const msg_lockstep_input_t *in);
+/* Rolls state back and forward again if a received input proved a guess
+ * wrong, then confirms what can be. Returns true if state changed. */
+bool lockstep_settle(lockstep_t *ls, void *state);
+/* The state after the confirmed tick, given the current one */
+const void *lockstep_confirmed_state(const lockstep_t *ls, const void *state);
+
+/* Packs our inputs the peer still needs: over a reliable channel each
+ * one once, otherwise all it hasn't acknowledged. Returns the frame
+ * length, 0 when a reliable channel has nothing new to carry. */
+int  lockstep_pack_inputs(lockstep_t *ls, uint8_t *buf, size_t buflen,
+                          bool reliable);
+/* Packs our newest confirmed hash if it hasn't gone out, else returns 0 */
+int  lockstep_pack_hash(lockstep_t *ls, uint8_t *buf, size_t buflen);
+void lockstep_peer_hash(lockstep_t *ls, const msg_lockstep_hash_t *h);
+
+#endif
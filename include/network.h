@@ -4,20 +4,120 @@
 #include "common.h"
 #include "platform.h"
 
+/* Outbound frames waiting for the socket to become writable. Broadcasts
+ * never block: whatever the kernel won't take right now stays here. */
+#define NET_SENDQ_FRAMES 16
+
+typedef enum {
+    NET_OVERFLOW_DROP_STATE = 0,   /* drop the oldest queued state update */
+    NET_OVERFLOW_DISCONNECT = 1
+} net_overflow_policy_t;
+
+/* Frames a broadcast may hold outside any queue while it fans out */
+#define NET_FRAME_SLACK 40
+#define NET_FRAME_POOL_SIZE(clients) ((clients) * NET_SENDQ_FRAMES + NET_FRAME_SLACK)
+
+/* An encoded frame that any number of send queues can share. It is
+ * written once by whoever allocated it and is read-only after that. */
+typedef struct net_frame {
+    struct net_frame_pool *pool;
+    struct net_frame      *next_free;
+    int                    refs;
+    uint16_t               len;
+    uint8_t                data[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+} net_frame_t;
+
+/* Fixed store of frames, allocated up front so the game loop never
+ * mallocs. A pool and every queue holding its frames belong to one
+ * thread, so reference counts need no atomics. */
+typedef struct net_frame_pool {
+    net_frame_t *frames;
+    net_frame_t *free_list;
+    int          capacity;
+} net_frame_pool_t;
+
+typedef struct {
+    net_frame_t     *frames[NET_SENDQ_FRAMES];
+    int              head;
+    int              count;
+    size_t           head_sent;   /* bytes of the head frame already sent */
+    int              in_flight;   /* frames the kernel still reads (io_uring) */
+} net_sendq_t;
+
+/* Bytes read off a stream but not handed out as frames yet. One recv()
+ * takes whatever the kernel holds; a trailing partial frame waits here
+ * for the rest instead of blocking. */
+#define NET_RX_BUF_SIZE 2048
+
+typedef struct {
+    uint8_t data[NET_RX_BUF_SIZE];
+    size_t  start;   /* first byte not yet handed out */
+    size_t  end;
+    bool    by_loop; /* filled by the event loop's io_uring, not recv() */
+    bool    eof;
+} net_rxbuf_t;
+
 typedef struct {
     bytes_socket_t fd;
     bool           connected;
     bool           is_player;
+    bool           greeted;
     uint8_t        player_id;
     char           name[MAX_NAME_LEN];
+    uint32_t       acked_tick;   /* newest snapshot it confirmed, 0 = none */
+    bool           batched;      /* has frames held back by a batch */
+    net_sendq_t    sendq;
+    net_rxbuf_t    rx;
 } net_client_t;
 
+/* ── Event loop ─────────────────────────────────────────────────── */
+
+/* Tags identify what a ready fd is. Client fds use tag_base plus their
+ * index in net_server_t.clients; the listen socket and stdin use these. */
+#define NET_TAG_LISTEN  (-1)
+#define NET_TAG_STDIN   (-2)
+#define NET_TAG_UDP     (-3)
+#define NET_TAG_UPSTREAM (-4)
+#define NET_TAG_TIMER   (-5)
+#define NET_TAG_WAKE    (-6)
+#define NET_TAG_MIN     NET_TAG_WAKE
+
+#define NET_EV_READ     0x01
+#define NET_EV_WRITE    0x02
+#define NET_EV_HUP      0x04
+
+typedef struct {
+    bytes_socket_t fd;
+    int            tag;
+    int            events;
+} net_event_t;
+
+/* Edge-triggered epoll on Linux, poll() elsewhere or when epoll is
+ * unavailable. Edge-triggered means a READ event is only reported when
+ * new data arrives, so handlers must drain the fd until it would block. */
+typedef struct {
+    int             epoll_fd;
+    struct pollfd  *pollfds;
+    int            *tags;
+    int             capacity;
+    int             count;
+    bool            stdin_always_ready;
+    struct net_loop_uring *uring;   /* see net_loop_use_uring() */
+} net_loop_t;
+
 typedef struct {
     bytes_socket_t listen_fd;
     int            port;
     net_client_t   clients[MAX_CLIENTS];
     int            client_count;
     bool           running;
+    net_loop_t    *loop;
+    int            tag_base;
+    net_overflow_policy_t overflow;
+    bool              batching;  /* see net_server_begin_batch() */
+    net_frame_pool_t *pool;      /* must be set before anything is sent */
+    net_frame_pool_t  own_pool;  /* set up by net_server_init */
+    uint64_t          bytes_out; /* written to client sockets so far */
 } net_server_t;
 
 typedef struct {
@@ -25,10 +125,40 @@ typedef struct {
     bool           connected;
     char           local_name[MAX_NAME_LEN];
     uint8_t        role;
+    net_rxbuf_t    rx;
 } net_connection_t;
 
+/* Optional datagram channel next to a TCP session. It carries only
+ * traffic where a newer packet supersedes a lost one (snapshots,
+ * redundant inputs); everything else stays on TCP. */
+typedef struct {
+    bytes_socket_t     fd;
+    bool               has_peer;
+    bool               active;    /* traffic seen in both directions */
+    uint32_t           token;     /* ties the first datagram to the session */
+    struct sockaddr_in peer;
+    uint64_t           bytes_in;  /* datagrams accepted from the peer */
+    uint64_t           bytes_out;
+} net_udp_t;
+
+int  net_frame_pool_init(net_frame_pool_t *pool, int capacity);
+void net_frame_pool_close(net_frame_pool_t *pool);
+/* Returns a frame holding one reference, or NULL when the pool is dry */
+net_frame_t *net_frame_alloc(net_frame_pool_t *pool);
+net_frame_t *net_frame_copy(net_frame_pool_t *pool, const uint8_t *buf,
+                            size_t len);
+net_frame_t *net_frame_ref(net_frame_t *f);
+void net_frame_release(net_frame_t *f);
+
+bytes_socket_t net_listen(int port, int backlog);
+bytes_socket_t net_accept(bytes_socket_t listen_fd);
+
+/* A server from net_server_init owns its frame pool; one set up with
+ * net_server_reset shares a pool the caller provides in srv->pool. */
 int  net_server_init(net_server_t *srv, int port);
+void net_server_reset(net_server_t *srv);
 int  net_server_accept(net_server_t *srv, int timeout_ms);
+int  net_server_adopt(net_server_t *srv, bytes_socket_t fd);
 void net_server_close_client(net_server_t *srv, int idx);
 void net_server_shutdown(net_server_t *srv);
 
@@ -36,12 +166,65 @@ int  net_client_connect(net_connection_t *conn, const char *host, int port);
 void net_client_disconnect(net_connection_t *conn);
 
 int  net_send(bytes_socket_t fd, const uint8_t *buf, size_t len, int timeout_ms);
+/* Reads exactly one frame, waiting for a partial one to complete. Meant
+ * for handshakes, before the connection's receive buffer takes over. */
 int  net_recv(bytes_socket_t fd, uint8_t *buf, size_t buflen, int timeout_ms);
+/* Next complete frame, pointed to inside rx and valid until the next
+ * call. Returns its length, 0 when none is complete yet, -1 on error. */
+int  net_recv_frame(bytes_socket_t fd, net_rxbuf_t *rx, const uint8_t **frame,
+                    int timeout_ms);
 int  net_send_to_all(net_server_t *srv, const uint8_t *buf, size_t len);
 int  net_send_to_spectators(net_server_t *srv, const uint8_t *buf, size_t len);
+int  net_server_send(net_server_t *srv, int idx, const uint8_t *buf, size_t len);
+/* Queues a shared frame; the queue takes its own reference */
+int  net_server_send_frame(net_server_t *srv, int idx, net_frame_t *f);
+int  net_server_flush(net_server_t *srv, int idx);
+/* Sends between the two only queue their frames. The end writes each
+ * client's queue with one sendmsg(), so the messages a loop iteration
+ * produces for a connection (a welcome and its game start, a pause and
+ * the state after it) leave as one packet instead of one each. */
+void net_server_begin_batch(net_server_t *srv);
+void net_server_end_batch(net_server_t *srv);
+void net_server_drain(net_server_t *srv, int timeout_ms);
 
 int  net_poll_readable(bytes_socket_t fd, int timeout_ms);
 
+int  net_loop_init(net_loop_t *loop, int capacity);
+void net_loop_close(net_loop_t *loop);
+/* Switches an empty loop to io_uring: multishot accept on the listen
+ * socket, multishot recv straight into each stream's net_rxbuf_t and
+ * one batched submission for all sends between two waits. Returns -1,
+ * leaving the loop as it was, when the kernel can't do that. Client
+ * tags must stay below the capacity, and servers using the loop must
+ * shut down before it closes. */
+int  net_loop_use_uring(net_loop_t *loop);
+unsigned long net_loop_enters(const net_loop_t *loop);
+int  net_loop_add(net_loop_t *loop, bytes_socket_t fd, int tag);
+/* Like net_loop_add for a stream read through rx with net_recv_frame() */
+int  net_loop_add_stream(net_loop_t *loop, bytes_socket_t fd, int tag,
+                         net_rxbuf_t *rx);
+/* Next connection on a listen socket in the loop, or INVALID */
+bytes_socket_t net_loop_accept(net_loop_t *loop, bytes_socket_t listen_fd);
+void net_loop_remove(net_loop_t *loop, bytes_socket_t fd);
+void net_loop_want_write(net_loop_t *loop, bytes_socket_t fd, bool on);
+int  net_loop_add_stdin(net_loop_t *loop);
+int  net_loop_wait(net_loop_t *loop, net_event_t *events, int max_events,
+                   int timeout_ms);
+int  net_server_attach_loop(net_server_t *srv, net_loop_t *loop);
+
+int  net_udp_open(net_udp_t *udp, int port);
+void net_udp_close(net_udp_t *udp);
+void net_udp_set_peer(net_udp_t *udp, const struct sockaddr_in *peer);
+int  net_udp_peer_from_tcp(net_udp_t *udp, bytes_socket_t tcp_fd, int port);
+void net_udp_forget_peer(net_udp_t *udp);
+int  net_udp_send(net_udp_t *udp, const uint8_t *buf, size_t len);
+int  net_udp_recv(net_udp_t *udp, uint8_t *buf, size_t buflen,
+                  struct sockaddr_in *from);
+
+/* Splits "host[:port][/room]"; an empty host means 127.0.0.1 */
+void net_parse_address(const char *addr, char *host, size_t hostlen, int *port,
+                       int default_port, char *room, size_t roomlen);
+
 char *net_get_local_ip(char *buf, size_t buflen);
 
 #endif
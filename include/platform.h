@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #ifdef BYTES_WINDOWS
 
@@ -27,11 +28,13 @@
     #include <windows.h>
     #include <iphlpapi.h>
 
-    /* Resolve MOUSE_MOVED conflict between wincontypes.h and PDCurses */
-    #ifdef MOUSE_MOVED
-        #undef MOUSE_MOVED
+    #ifndef BYTES_HEADLESS
+        /* Resolve MOUSE_MOVED conflict between wincontypes.h and PDCurses */
+        #ifdef MOUSE_MOVED
+            #undef MOUSE_MOVED
+        #endif
+        #include <curses.h>
     #endif
-    #include <curses.h>
 
     typedef SOCKET bytes_socket_t;
     #define BYTES_INVALID_SOCKET INVALID_SOCKET
@@ -59,7 +62,9 @@
     #include <sys/socket.h>
     #include <sys/types.h>
     #include <unistd.h>
-    #include <ncurses.h>
+    #ifndef BYTES_HEADLESS
+        #include <ncurses.h>
+    #endif
 
     typedef int bytes_socket_t;
     #define BYTES_INVALID_SOCKET (-1)
@@ -79,16 +84,11 @@
 
 #endif
 
-/* ── Packed struct macros ───────────────────────────────────────── */
-
-#ifdef _MSC_VER
-    #define BYTES_PACKED_BEGIN __pragma(pack(push, 1))
-    #define BYTES_PACKED_END   __pragma(pack(pop))
-    #define BYTES_PACKED_ATTR
-#else
-    #define BYTES_PACKED_BEGIN
-    #define BYTES_PACKED_END
-    #define BYTES_PACKED_ATTR __attribute__((packed))
+/* Headless builds have no curses, but inputs still arrive as curses key
+ * codes; ncurses and PDCurses agree on these */
+#ifdef BYTES_HEADLESS
+    #define KEY_DOWN 0402
+    #define KEY_UP   0403
 #endif
 
 /* ── Platform functions ─────────────────────────────────────────── */
@@ -104,6 +104,70 @@ int64_t  platform_mono_us(void);
 void     platform_usleep(unsigned us);
 void     platform_ignore_sigpipe(void);
 
+/* Fixed-timestep clock on absolute deadlines: a late tick doesn't push
+ * the next one back. With an fd (Linux timerfd), add it to an event loop
+ * and it becomes readable at every deadline. */
+#define PLATFORM_TICKER_CATCHUP 4    /* most ticks run back to back */
+
+typedef struct {
+    int64_t  interval_us;
+    int64_t  next_us;         /* deadline of the next tick */
+    int      fd;              /* -1 = none, wait out platform_ticker_wait_ms() */
+    uint64_t ticks;
+    uint64_t late;            /* ran a whole interval or more past deadline */
+    uint64_t dropped;         /* skipped after a stall, beyond the catch-up */
+} platform_ticker_t;
+
+void     platform_ticker_init(platform_ticker_t *t, int64_t interval_us,
+                              bool want_fd);
+void     platform_ticker_close(platform_ticker_t *t);
+/* Next deadline one interval from now, forgetting anything owed */
+void     platform_ticker_restart(platform_ticker_t *t, int64_t now_us);
+/* How many ticks to run now, at most PLATFORM_TICKER_CATCHUP */
+int      platform_ticker_due(platform_ticker_t *t, int64_t now_us);
+/* Event loop timeout until the next deadline; -1 when the fd wakes it */
+int      platform_ticker_wait_ms(const platform_ticker_t *t, int64_t now_us);
+
+/* Wakes a thread out of its event loop: it adds fd and drains it when
+ * readable, any other thread signals. fd is -1 where there is no such
+ * thing (Windows), and the loop has to wake itself with a timeout. */
+typedef struct {
+    int fd;
+    int write_fd;
+} platform_wake_t;
+
+int      platform_wake_init(platform_wake_t *w);
+void     platform_wake_close(platform_wake_t *w);
+void     platform_wake_signal(platform_wake_t *w);
+void     platform_wake_drain(platform_wake_t *w);
+
+/* True when the terminal holds more than max_queued bytes it hasn't
+ * taken yet, or has no room for more. Ptys never report what they
+ * hold, only that they are full; Windows reports nothing. */
+bool     platform_term_behind(int max_queued);
+
+int      platform_cpu_count(void);
+void     platform_raise_fd_limit(void);
+
+/* Read-only view of a whole file; NULL if missing or empty */
+const uint8_t *platform_map_file(const char *path, size_t *size);
+void     platform_unmap_file(const uint8_t *p, size_t size);
+
+/* Exclusive advisory lock between processes, taken on a file of its
+ * own (created if missing) so that it outlives any file it guards being
+ * replaced. Blocks until granted; -1 if the lock file can't be opened. */
+typedef struct {
+    intptr_t handle;
+} platform_lock_t;
+
+int      platform_lock(platform_lock_t *lk, const char *path);
+void     platform_unlock(platform_lock_t *lk);
+
+/* Writes f's buffered data through to the disk */
+int      platform_sync_file(FILE *f);
+/* Renames from over to in one step, so a crash leaves one or the other */
+int      platform_replace_file(const char *from, const char *to);
+
 void     platform_get_home_dir(char *buf, size_t len);
 char    *platform_get_local_ip(char *buf, size_t buflen);
 
@@ -6,20 +6,69 @@
 #define PONG_WIN_SCORE   5
 #define PONG_PADDLE_LEN  5
 #define PONG_HEADER_ROWS 3
-#define PONG_BALL_SPEED_INIT 1.0f
-#define PONG_BALL_SPEED_INC  0.05f
-#define PONG_BALL_MAX_SPEED  2.5f
+#define PONG_PADDLE_SPEED    1      /* cells per tick while a key is held */
+
+/* Field sizes a server may be given. Packed states carry positions as
+ * hundredths of a cell in an int16, which caps both sides; below the
+ * minimum a paddle no longer fits between the walls. */
+#define PONG_MIN_ROWS    (PONG_HEADER_ROWS + PONG_PADDLE_LEN + 3)
+#define PONG_MAX_ROWS    200
+#define PONG_MIN_COLS    20
+#define PONG_MAX_COLS    320
+
+/* Positions and velocities are 16.16 fixed point, so every machine
+ * plays out the same match from the same seed and inputs */
+typedef int32_t pong_fx_t;
+#define PONG_FX_ONE          65536
+#define PONG_FX(cells)       ((pong_fx_t)(cells) * PONG_FX_ONE)
+
+#define PONG_BALL_SPEED_INIT PONG_FX_ONE
+#define PONG_BALL_SPEED_INC  (PONG_FX_ONE / 20)
+#define PONG_BALL_MAX_SPEED  (PONG_FX_ONE * 5 / 2)
+
+/* Shared with the batch kernel in pong_batch.c, which must match
+ * pong_game_def.update bit for bit */
+static inline pong_fx_t pong_fx_mul(pong_fx_t a, pong_fx_t b)
+{
+    return (pong_fx_t)((int64_t)a * b / PONG_FX_ONE);
+}
+
+/* Nearest cell, halves away from zero like roundf() */
+static inline int pong_fx_round(pong_fx_t v)
+{
+    return (v >= 0) ? (v + PONG_FX_ONE / 2) / PONG_FX_ONE
+                    : (v - PONG_FX_ONE / 2) / PONG_FX_ONE;
+}
+
+/* Toward zero, like a cast from float */
+static inline int pong_fx_trunc(pong_fx_t v)
+{
+    return v / PONG_FX_ONE;
+}
+
+/* A serve's vertical speed, from the LCG in Numerical Recipes; only its
+ * high bits are worth using */
+static inline pong_fx_t pong_serve_vy(uint32_t *rng)
+{
+    *rng = *rng * 1664525u + 1013904223u;
+    return (pong_fx_t)((*rng >> 16) % 100) * PONG_FX_ONE / 100 - PONG_FX_ONE / 2;
+}
+
+/* Held actions (game_def_t.key_action) */
+#define PONG_HOLD_UP   0x01
+#define PONG_HOLD_DOWN 0x02
 
 typedef struct {
-    float x, y;
-    float vx, vy;
-    float prev_x, prev_y;
-    float speed;
+    pong_fx_t x, y;
+    pong_fx_t vx, vy;
+    pong_fx_t prev_x, prev_y;
+    pong_fx_t speed;
 } pong_ball_t;
 
 typedef struct {
-    int x, y;
-    int len;
+    int     x, y;
+    int     len;
+    uint8_t held;    /* PONG_HOLD_* bits; not sent, a client keeps its own */
 } pong_paddle_t;
 
 typedef struct {
@@ -33,6 +82,7 @@ typedef struct {
     int           field_top;
     int           field_bottom;
     bool          scored;
+    uint32_t      rng;    /* serve angles, from the session seed */
 } pong_state_t;
 
 extern const game_def_t pong_game_def;
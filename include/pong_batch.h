@@ -0,0 +1,48 @@
+#ifndef BYTES_PONG_BATCH_H
+#define BYTES_PONG_BATCH_H
+
+#include "pong.h"
+
+/* Many Pong games on one field size, laid out one array per field so a
+ * tick of all of them runs as a vector loop: for bots, and for testing
+ * how many matches a server could carry. A tick here gives exactly what
+ * pong_game_def.update gives each game on its own.
+ *
+ * The arrays are count rounded up to PONG_BATCH_LANES long; the games
+ * past count are spares that get simulated and ignored. */
+#define PONG_BATCH_LANES 4
+
+typedef struct {
+    int        count;
+    int        capacity;
+    int        rows, cols;
+    int        field_top, field_bottom;
+    int        p1_x, p2_x;
+    pong_fx_t  angle[PONG_PADDLE_LEN];   /* vy off each cell of a paddle */
+
+    pong_fx_t *x, *y, *vx, *vy;
+    pong_fx_t *prev_x, *prev_y, *speed;
+    int32_t   *p1_y, *p2_y;
+    int32_t   *held1, *held2;            /* PONG_HOLD_* bits */
+    int32_t   *score1, *score2;
+    int32_t   *scored;
+    uint32_t  *rng;
+} pong_batch_t;
+
+/* Allocates count games, each as pong_game_def.init would start it.
+ * Returns -1 if that fails. */
+int  pong_batch_init(pong_batch_t *b, int count, int rows, int cols);
+void pong_batch_free(pong_batch_t *b);
+
+/* Copy game i in and out; s must be on the batch's field size */
+void pong_batch_load(pong_batch_t *b, int i, const pong_state_t *s);
+void pong_batch_store(const pong_batch_t *b, int i, pong_state_t *s);
+
+/* Advances every game one tick, with SSE2 where the build has it */
+void pong_batch_update(pong_batch_t *b);
+/* The same one game at a time, which the vector path must agree with */
+void pong_batch_update_scalar(pong_batch_t *b);
+/* Name of the path pong_batch_update takes */
+const char *pong_batch_kernel(void);
+
+#endif
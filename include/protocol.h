@@ -4,6 +4,9 @@
 #include "common.h"
 #include "platform.h"
 
+#include <stddef.h>
+#include <string.h>
+
 typedef enum {
     MSG_HELLO      = 1,
     MSG_WELCOME    = 2,
@@ -13,77 +16,317 @@ typedef enum {
     MSG_GAME_OVER  = 6,
     MSG_PAUSE      = 7,
     MSG_RESUME     = 8,
-    MSG_QUIT       = 9
+    MSG_QUIT       = 9,
+    MSG_UDP_OFFER  = 10,  /* TCP: datagram port and session token */
+    MSG_UDP_HELLO  = 11,  /* datagram only */
+    MSG_SNAPSHOT   = 12,  /* tick-stamped state, keyframe or delta */
+    MSG_UDP_INPUT  = 13,  /* datagram only */
+    MSG_STATE_ACK  = 14,
+    MSG_INPUT_HELD = 15,  /* actions held down, sent when they change */
+    MSG_PING       = 16,  /* either direction, on the channel carrying state */
+    MSG_PONG       = 17,
+    MSG_LOCKSTEP_INPUT = 18,  /* lockstep only, on the channel inputs take */
+    MSG_LOCKSTEP_HASH  = 19   /* lockstep only, TCP */
 } msg_type_t;
 
-BYTES_PACKED_BEGIN
 typedef struct {
     uint8_t  type;
     uint16_t payload_len;
-} BYTES_PACKED_ATTR msg_header_t;
-BYTES_PACKED_END
+} msg_header_t;
 
-BYTES_PACKED_BEGIN
-typedef struct {
-    char    name[MAX_NAME_LEN];
-    uint8_t role;
-} BYTES_PACKED_ATTR msg_hello_t;
-BYTES_PACKED_END
+/* ── Schema ─────────────────────────────────────────────────────── */
 
-BYTES_PACKED_BEGIN
-typedef struct {
-    char    host_name[MAX_NAME_LEN];
-    char    opponent_name[MAX_NAME_LEN];
-    uint8_t assigned_id;
-} BYTES_PACKED_ATTR msg_welcome_t;
-BYTES_PACKED_END
+/* Wire field kinds. Each is a struct of bytes, so a message's wire
+ * struct has no padding, can sit at any address in a receive buffer,
+ * and its fields can only be read through the getter of their kind.
+ * Multi-byte kinds are little-endian. */
+typedef struct { uint8_t b[1]; } proto_u8_t;
+typedef struct { uint8_t b[2]; } proto_u16_t;
+typedef struct { uint8_t b[2]; } proto_i16_t;
+typedef struct { uint8_t b[4]; } proto_u32_t;
+typedef struct { uint8_t b[4]; } proto_i32_t;
+typedef struct { uint8_t b[8]; } proto_u64_t;
+typedef struct { uint8_t b[MAX_NAME_LEN]; } proto_name_t;
 
-BYTES_PACKED_BEGIN
-typedef struct {
-    uint8_t game_type;
-    char    p1_name[MAX_NAME_LEN];
-    char    p2_name[MAX_NAME_LEN];
-} BYTES_PACKED_ATTR msg_game_start_t;
-BYTES_PACKED_END
+/* Fixed-layout messages, field by field in wire order. Each has a list
+ * of F(kind, field) and a line in PROTO_MESSAGES naming its struct, its
+ * msg_type_t and the last field a sender must include; fields after it
+ * were added later and read as zero when absent. From these come, per
+ * message:
+ *   msg_<name>_t          the fields in host types
+ *   msg_<name>_wire_t     the payload as it is on the wire
+ *   MSG_<TYPE>_SIZE/_MIN  full and shortest accepted payload length
+ *   proto_pack_<name>()   takes the fields as arguments, in order
+ *   proto_view_<name>()   the payload in place, read with proto_get_*();
+ *                         NULL unless it has every field
+ *   proto_unpack_<name>() the fields copied out into msg_<name>_t, which
+ *                         also takes the shorter payloads of older peers */
+#define MSG_HELLO_FIELDS(F) \
+    F(name, name) F(u8, role) F(name, room)
+#define MSG_WELCOME_FIELDS(F) \
+    F(name, host_name) F(name, opponent_name) F(u8, assigned_id)
+#define MSG_GAME_START_FIELDS(F) \
+    F(u8, game_type) F(name, p1_name) F(name, p2_name) \
+    F(u8, mode) F(u32, seed) F(u16, rows) F(u16, cols)
+#define MSG_INPUT_FIELDS(F) \
+    F(u32, seq) F(i32, key)
+#define MSG_INPUT_HELD_FIELDS(F) \
+    F(u32, seq) F(u8, held)
+#define MSG_GAME_OVER_FIELDS(F) \
+    F(u8, winner_id) F(name, winner_name)
+#define MSG_PAUSE_FIELDS(F) \
+    F(u8, reason)
+#define MSG_UDP_OFFER_FIELDS(F) \
+    F(u16, port) F(u32, token)
+#define MSG_UDP_HELLO_FIELDS(F) \
+    F(u32, token)
+#define MSG_STATE_ACK_FIELDS(F) \
+    F(u32, tick)
+#define MSG_PING_FIELDS(F) \
+    F(u32, seq) F(u64, time_us)
+#define MSG_PONG_FIELDS(F) MSG_PING_FIELDS(F)
+#define MSG_LOCKSTEP_HASH_FIELDS(F) \
+    F(u32, tick) F(u32, hash)
+
+#define PROTO_MESSAGES(X) \
+    X(hello,         HELLO,          role) \
+    X(welcome,       WELCOME,        assigned_id) \
+    X(game_start,    GAME_START,     p2_name) \
+    X(input,         INPUT,          key) \
+    X(input_held,    INPUT_HELD,     held) \
+    X(game_over,     GAME_OVER,      winner_name) \
+    X(pause,         PAUSE,          reason) \
+    X(udp_offer,     UDP_OFFER,      token) \
+    X(udp_hello,     UDP_HELLO,      token) \
+    X(state_ack,     STATE_ACK,      tick) \
+    X(ping,          PING,           time_us) \
+    X(pong,          PONG,           time_us) \
+    X(lockstep_hash, LOCKSTEP_HASH,  hash)
+
+/* tick 0 in a state ack asks for a keyframe. Input sequence numbers
+ * start at 1 and count every key a player sends, whichever channel
+ * carries it; MSG_INPUT_HELD shares them. A pong echoes its ping
+ * unchanged; time_us is the sender's platform_mono_us(), meaningful
+ * only to the sender. A lockstep hash covers the sender's confirmed
+ * state after tick. A game start without the fields after the names
+ * (an old recording) reads as mode 0, seed 0 and no field size. */
+
+#define PROTO_HOST_u8(f)   uint8_t  f;
+#define PROTO_HOST_u16(f)  uint16_t f;
+#define PROTO_HOST_i16(f)  int16_t  f;
+#define PROTO_HOST_u32(f)  uint32_t f;
+#define PROTO_HOST_i32(f)  int32_t  f;
+#define PROTO_HOST_u64(f)  uint64_t f;
+#define PROTO_HOST_name(f) char     f[MAX_NAME_LEN];
+
+#define PROTO_ARG_u8   uint8_t
+#define PROTO_ARG_u16  uint16_t
+#define PROTO_ARG_i16  int16_t
+#define PROTO_ARG_u32  uint32_t
+#define PROTO_ARG_i32  int32_t
+#define PROTO_ARG_u64  uint64_t
+#define PROTO_ARG_name const char *
+
+#define PROTO_HOST_FIELD(kind, f) PROTO_HOST_##kind(f)
+#define PROTO_WIRE_FIELD(kind, f) proto_##kind##_t f;
+#define PROTO_ARG(kind, f)        , PROTO_ARG_##kind f
+
+/* Bytes from the start of wire struct *w to the end of field f */
+#define PROTO_FIELD_END(w, f) \
+    ((size_t)((const uint8_t *)(&(w)->f + 1) - (const uint8_t *)(w)))
+
+#define PROTO_DECLARE(msg, TYPE, last) \
+    typedef struct { MSG_##TYPE##_FIELDS(PROTO_HOST_FIELD) } msg_##msg##_t; \
+    typedef struct { MSG_##TYPE##_FIELDS(PROTO_WIRE_FIELD) } msg_##msg##_wire_t; \
+    enum { \
+        MSG_##TYPE##_SIZE = sizeof(msg_##msg##_wire_t), \
+        MSG_##TYPE##_MIN  = offsetof(msg_##msg##_wire_t, last) \
+                          + sizeof(((msg_##msg##_wire_t *)0)->last) \
+    }; \
+    int proto_pack_##msg(uint8_t *buf, size_t buflen \
+                         MSG_##TYPE##_FIELDS(PROTO_ARG)); \
+    int proto_unpack_##msg(const uint8_t *payload, size_t len, \
+                           msg_##msg##_t *out); \
+    static inline const msg_##msg##_wire_t * \
+    proto_view_##msg(const uint8_t *payload, size_t len) \
+    { \
+        return (len >= MSG_##TYPE##_SIZE) \
+             ? (const msg_##msg##_wire_t *)payload : NULL; \
+    }
+
+PROTO_MESSAGES(PROTO_DECLARE)
+
+static inline uint32_t proto_le32(const uint8_t *b)
+{
+    return (uint32_t)b[0]
+         | ((uint32_t)b[1] << 8)
+         | ((uint32_t)b[2] << 16)
+         | ((uint32_t)b[3] << 24);
+}
+
+static inline void proto_put_le32(uint8_t *b, uint32_t v)
+{
+    b[0] = (uint8_t)(v & 0xFF);
+    b[1] = (uint8_t)((v >> 8) & 0xFF);
+    b[2] = (uint8_t)((v >> 16) & 0xFF);
+    b[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint8_t proto_get_u8(const proto_u8_t *f)
+{
+    return f->b[0];
+}
+
+static inline uint16_t proto_get_u16(const proto_u16_t *f)
+{
+    return (uint16_t)(f->b[0] | (f->b[1] << 8));
+}
+
+static inline int16_t proto_get_i16(const proto_i16_t *f)
+{
+    uint16_t u = (uint16_t)(f->b[0] | (f->b[1] << 8));
+    int16_t v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+static inline uint32_t proto_get_u32(const proto_u32_t *f)
+{
+    return proto_le32(f->b);
+}
 
-BYTES_PACKED_BEGIN
+static inline int32_t proto_get_i32(const proto_i32_t *f)
+{
+    uint32_t u = proto_le32(f->b);
+    int32_t v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+static inline uint64_t proto_get_u64(const proto_u64_t *f)
+{
+    return (uint64_t)proto_le32(f->b) | ((uint64_t)proto_le32(f->b + 4) << 32);
+}
+
+/* Always terminated, whatever the sender put in the field */
+static inline void proto_get_name(const proto_name_t *f, char out[MAX_NAME_LEN])
+{
+    memcpy(out, f->b, MAX_NAME_LEN);
+    out[MAX_NAME_LEN - 1] = '\0';
+}
+
+static inline void proto_put_u8(proto_u8_t *f, uint8_t v)
+{
+    f->b[0] = v;
+}
+
+static inline void proto_put_u16(proto_u16_t *f, uint16_t v)
+{
+    f->b[0] = (uint8_t)(v & 0xFF);
+    f->b[1] = (uint8_t)(v >> 8);
+}
+
+static inline void proto_put_i16(proto_i16_t *f, int16_t v)
+{
+    uint16_t u;
+    memcpy(&u, &v, sizeof(u));
+    f->b[0] = (uint8_t)(u & 0xFF);
+    f->b[1] = (uint8_t)(u >> 8);
+}
+
+static inline void proto_put_u32(proto_u32_t *f, uint32_t v)
+{
+    proto_put_le32(f->b, v);
+}
+
+static inline void proto_put_i32(proto_i32_t *f, int32_t v)
+{
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    proto_put_le32(f->b, u);
+}
+
+static inline void proto_put_u64(proto_u64_t *f, uint64_t v)
+{
+    proto_put_le32(f->b, (uint32_t)v);
+    proto_put_le32(f->b + 4, (uint32_t)(v >> 32));
+}
+
+/* Zero-padded; NULL leaves the field empty */
+static inline void proto_put_name(proto_name_t *f, const char *s)
+{
+    size_t n = 0;
+    if (s != NULL) {
+        n = strnlen(s, MAX_NAME_LEN - 1);
+        memcpy(f->b, s, n);
+    }
+    memset(f->b + n, 0, MAX_NAME_LEN - n);
+}
+
+/* ── Variable-length messages ───────────────────────────────────── */
+
+/* Followed by the packed state (base_age 0) or a delta against the
+ * snapshot from base_age ticks earlier */
 typedef struct {
-    int32_t key;
-} BYTES_PACKED_ATTR msg_input_t;
-BYTES_PACKED_END
+    uint32_t tick;
+    uint8_t  base_age;
+} msg_snapshot_t;
+
+/* Offset of the body in a whole MSG_SNAPSHOT frame */
+#define MSG_SNAPSHOT_BODY (MSG_HEADER_SIZE + 5)
+
+/* The packed state in a snapshot body is preceded by the newest input
+ * sequence number applied for each player, so a predicting client can
+ * tell which of its inputs the state already contains. Deltas cover
+ * them like any other bytes of the body. */
+#define MSG_SNAPSHOT_INPUTS 8
+
+/* A lockstep peer's inputs for ticks tick .. tick + count - 1, every
+ * one the other side hasn't acknowledged yet. ack is the newest tick of
+ * the receiver's inputs the sender holds; advantage is how many ticks
+ * the sender runs ahead of them. On the wire each input is a held byte,
+ * with MSG_LOCKSTEP_KEY set when an i32 key follows. */
+#define MSG_LOCKSTEP_KEY 0x80
 
-BYTES_PACKED_BEGIN
 typedef struct {
-    uint8_t winner_id;
-    char    winner_name[MAX_NAME_LEN];
-} BYTES_PACKED_ATTR msg_game_over_t;
-BYTES_PACKED_END
+    uint32_t tick;
+    uint32_t ack;
+    int8_t   advantage;
+    uint8_t  count;
+    uint8_t  held[LOCKSTEP_WINDOW];
+    int32_t  keys[LOCKSTEP_WINDOW];   /* -1 (GAME_INPUT_NONE) for none */
+} msg_lockstep_input_t;
 
-BYTES_PACKED_BEGIN
+/* keys[0] carries sequence number seq, keys[1] seq - 1, and so on */
 typedef struct {
-    uint8_t reason;
-} BYTES_PACKED_ATTR msg_pause_t;
-BYTES_PACKED_END
+    uint32_t seq;
+    uint8_t  count;
+    int32_t  keys[UDP_INPUT_REDUNDANCY];
+} msg_udp_input_t;
 
 int proto_pack_header(uint8_t *buf, size_t buflen, uint8_t type, uint16_t payload_len);
-int proto_pack_hello(uint8_t *buf, size_t buflen, const char *name, uint8_t role);
-int proto_pack_welcome(uint8_t *buf, size_t buflen, const char *host_name,
-                       const char *opponent_name, uint8_t assigned_id);
-int proto_pack_game_start(uint8_t *buf, size_t buflen, uint8_t game_type,
-                          const char *p1_name, const char *p2_name);
-int proto_pack_input(uint8_t *buf, size_t buflen, int32_t key);
-int proto_pack_state(uint8_t *buf, size_t buflen, const uint8_t *state_data, uint16_t state_len);
-int proto_pack_game_over(uint8_t *buf, size_t buflen, uint8_t winner_id, const char *winner_name);
-int proto_pack_pause(uint8_t *buf, size_t buflen, uint8_t reason);
+int proto_unpack_header(const uint8_t *buf, size_t len, msg_header_t *hdr);
+
 int proto_pack_resume(uint8_t *buf, size_t buflen);
 int proto_pack_quit(uint8_t *buf, size_t buflen);
+int proto_pack_snapshot(uint8_t *buf, size_t buflen, uint32_t tick, uint8_t base_age,
+                        const uint8_t *body, uint16_t body_len);
+/* Fills in everything in front of a body already written at
+ * buf + MSG_SNAPSHOT_BODY */
+int proto_finish_snapshot(uint8_t *buf, size_t buflen, uint32_t tick,
+                          uint8_t base_age, uint16_t body_len);
+int proto_pack_udp_input(uint8_t *buf, size_t buflen, uint32_t seq,
+                         const int32_t *keys, uint8_t count);
+int proto_pack_lockstep_input(uint8_t *buf, size_t buflen,
+                              const msg_lockstep_input_t *in);
+/* Write and read the MSG_SNAPSHOT_INPUTS bytes; seqs[0] is player 1 */
+int proto_pack_input_seqs(uint8_t *body, size_t len, const uint32_t seqs[2]);
+int proto_unpack_input_seqs(const uint8_t *body, size_t len, uint32_t seqs[2]);
 
-int proto_unpack_header(const uint8_t *buf, size_t len, msg_header_t *hdr);
-int proto_unpack_hello(const uint8_t *payload, size_t len, msg_hello_t *out);
-int proto_unpack_welcome(const uint8_t *payload, size_t len, msg_welcome_t *out);
-int proto_unpack_game_start(const uint8_t *payload, size_t len, msg_game_start_t *out);
-int proto_unpack_input(const uint8_t *payload, size_t len, msg_input_t *out);
-int proto_unpack_game_over(const uint8_t *payload, size_t len, msg_game_over_t *out);
-int proto_unpack_pause(const uint8_t *payload, size_t len, msg_pause_t *out);
+/* Returns the offset of the body within the payload, or -1 */
+int proto_unpack_snapshot(const uint8_t *payload, size_t len, msg_snapshot_t *out);
+int proto_unpack_udp_input(const uint8_t *payload, size_t len, msg_udp_input_t *out);
+int proto_unpack_lockstep_input(const uint8_t *payload, size_t len,
+                                msg_lockstep_input_t *out);
 
 #endif
@@ -0,0 +1,26 @@
+#ifndef BYTES_RELAY_H
+#define BYTES_RELAY_H
+
+#include "common.h"
+#include "network.h"
+#include "platform.h"
+
+/* Downstream viewers are spread over this many client tables, so one
+ * relay serves RELAY_GROUPS * MAX_CLIENTS of them. */
+#define RELAY_GROUPS 32
+
+typedef struct {
+    char host[64];             /* upstream host, dedicated server or relay */
+    int  upstream_port;
+    char room[MAX_NAME_LEN];
+    int  port;                 /* where downstream spectators connect */
+    net_overflow_policy_t overflow;
+    bool io_uring;
+} relay_config_t;
+
+/* Watches one match as a spectator and rebroadcasts it to downstream
+ * spectators, who may themselves be relays. Returns when the match ends,
+ * the upstream goes away or *quit becomes non-zero. */
+int relay_run(const relay_config_t *cfg, volatile int *quit);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef BYTES_REPLAY_H
+#define BYTES_REPLAY_H
+
+#include "common.h"
+#include "game.h"
+#include "protocol.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+
+/* A recorded match, little-endian throughout:
+ *
+ *   "BYTESRPL" u16 version  u16 tick_rate  u16 rows  u16 cols
+ *   u16 len, then the MSG_GAME_START frame the players got
+ *   records:  u8 kind  u32 tick  u16 len  body
+ *   index:    (u32 tick, u32 offset) per keyframe
+ *   footer:   u32 index_count  u32 index_offset  "BYTESIDX"
+ *
+ * A body is what a snapshot carries: the input sequence numbers, then
+ * pack_state output. Deltas are against the previous record. A file cut
+ * short has no footer; readers then find the keyframes by scanning. */
+#define REPLAY_VERSION         1
+#define REPLAY_KEYFRAME_TICKS  (TICK_RATE_HZ * 5)
+#define REPLAY_MAX_KEYFRAMES   4096   /* 5.7 hours; later ones go unindexed */
+#define REPLAY_EXT             ".rpl"
+
+#define REPLAY_REC_KEY   1
+#define REPLAY_REC_DELTA 2
+
+typedef struct {
+    uint32_t tick;
+    uint32_t offset;
+} replay_key_t;
+
+typedef struct {
+    FILE             *fp;
+    const game_def_t *def;
+    uint32_t          offset;
+    uint32_t          last_key;     /* tick of the newest keyframe */
+    uint16_t          prev_len;     /* 0 = next record is a keyframe */
+    uint8_t           prev[MAX_MSG_PAYLOAD];
+    uint32_t          nkeys;
+    replay_key_t      keys[REPLAY_MAX_KEYFRAMES];
+} replay_writer_t;
+
+/* Allocates a writer and writes the header; NULL on failure. The start
+ * frame is the whole MSG_GAME_START message. */
+replay_writer_t *replay_writer_open(const char *path, const game_def_t *def,
+                                    const uint8_t *start, size_t start_len,
+                                    int rows, int cols);
+/* Appends the newest state in h */
+void replay_writer_tick(replay_writer_t *w, const snapshot_history_t *h);
+/* Writes the index and frees the writer. Returns -1 if any of the
+ * recording failed to reach the file. */
+int  replay_writer_close(replay_writer_t *w);
+
+typedef struct {
+    const uint8_t    *data;         /* the mapped file */
+    size_t            size;
+    const game_def_t *def;
+    msg_game_start_t  start;
+    int               rows, cols;
+    replay_key_t     *keys;
+    uint32_t          nkeys;
+    uint32_t          first_tick, last_tick;
+    uint32_t          records;      /* offset of the first record */
+    size_t            end;          /* and of what follows the last */
+
+    /* Where playback is: the state of tick, and the record after it */
+    uint32_t          pos;
+    uint32_t          tick;
+    uint16_t          body_len;
+    uint8_t           body[MAX_MSG_PAYLOAD];
+} replay_reader_t;
+
+int  replay_open(replay_reader_t *r, const char *path);
+void replay_close(replay_reader_t *r);
+/* Decodes the next record. Returns 1, 0 at the end, -1 if corrupt. */
+int  replay_next(replay_reader_t *r);
+/* Moves to the last state at or before tick: back to the nearest
+ * keyframe, then forward. Returns -1 if corrupt. */
+int  replay_seek(replay_reader_t *r, uint32_t tick);
+/* Unpacks the current state into state */
+int  replay_restore(const replay_reader_t *r, void *state);
+
+#endif
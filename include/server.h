@@ -0,0 +1,31 @@
+#ifndef BYTES_SERVER_H
+#define BYTES_SERVER_H
+
+#include "common.h"
+#include "network.h"
+#include "platform.h"
+
+#define SERVER_ROOMS_PER_SHARD  128
+#define SERVER_MAX_PENDING      64
+#define SERVER_LISTEN_BACKLOG   1024    /* where connections wait while every pending slot is busy */
+#define SERVER_HELLO_TIMEOUT_MS 5000
+#define SERVER_DEFAULT_ROOM     "lobby"
+#define SERVER_FIELD_ROWS       24
+#define SERVER_FIELD_COLS       80
+
+typedef struct {
+    int port;
+    int threads;    /* worker shards; 0 = one per core */
+    int rows;       /* field size used for every room */
+    int cols;
+    net_overflow_policy_t overflow;
+    bool io_uring;  /* drive sockets through io_uring where available */
+    const char *record_dir;   /* record every match here; NULL = don't */
+} server_config_t;
+
+/* Runs the dedicated multi-room server until *quit becomes non-zero.
+ * Each worker thread owns a shard of rooms; the calling thread accepts
+ * connections and routes them by the room named in MSG_HELLO. */
+int server_run(const server_config_t *cfg, volatile int *quit);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BYTES_SNAPSHOT_H
+#define BYTES_SNAPSHOT_H
+
+#include "common.h"
+#include "game.h"
+#include "network.h"
+
+/* How many packed states both ends remember. A delta may only refer to
+ * a baseline this recent; a client acknowledging anything older gets a
+ * keyframe instead. */
+#define SNAPSHOT_HISTORY 32
+
+typedef struct {
+    uint32_t tick;     /* 0 = empty slot */
+    uint16_t len;
+    uint8_t  data[MAX_MSG_PAYLOAD];
+} snapshot_frame_t;
+
+typedef struct {
+    snapshot_frame_t frames[SNAPSHOT_HISTORY];
+    uint32_t         latest;
+} snapshot_history_t;
+
+void snapshot_history_reset(snapshot_history_t *h);
+void snapshot_history_put(snapshot_history_t *h, uint32_t tick,
+                          const uint8_t *data, size_t len);
+const snapshot_frame_t *snapshot_history_get(const snapshot_history_t *h,
+                                             uint32_t tick);
+
+/* Generic codec for games without delta hooks: the packed state is read
+ * as 16-bit fields, a bitmask marks the ones that differ from the
+ * baseline and only their XOR with the baseline follows. */
+int snapshot_xor_encode(const uint8_t *base, size_t base_len,
+                        const uint8_t *cur, size_t cur_len,
+                        uint8_t *out, size_t outlen);
+int snapshot_xor_decode(const uint8_t *base, size_t base_len,
+                        const uint8_t *delta, size_t delta_len,
+                        uint8_t *out, size_t outlen);
+
+/* One tick's snapshot on its way out. The keyframe is encoded once and
+ * each delta once per baseline; clients get references to those. */
+typedef struct {
+    const game_def_t         *def;
+    const snapshot_history_t *history;
+    net_frame_t              *key;
+    net_frame_t              *delta[SNAPSHOT_HISTORY];   /* by base age */
+} snapshot_fanout_t;
+
+/* Packs the state, behind the input sequence numbers it includes, into
+ * a pooled keyframe for tick and records it in h. Returns the frame
+ * holding one reference, or NULL. */
+net_frame_t *snapshot_capture(const game_def_t *def, const void *state,
+                              const uint32_t input_seqs[2],
+                              snapshot_history_t *h, uint32_t tick,
+                              net_frame_pool_t *pool);
+/* Keyframe for the newest state already in h */
+net_frame_t *snapshot_keyframe(const snapshot_history_t *h,
+                               net_frame_pool_t *pool);
+
+/* Takes over the reference to key, which must be the newest state in h */
+void snapshot_fanout_begin(snapshot_fanout_t *fo, const game_def_t *def,
+                           const snapshot_history_t *h, net_frame_t *key);
+/* The frame for a client that acknowledged acked; borrowed until _end */
+net_frame_t *snapshot_fanout_get(snapshot_fanout_t *fo, uint32_t acked);
+/* Queues the snapshot for every greeted client but skip_idx */
+void snapshot_fanout_send(snapshot_fanout_t *fo, net_server_t *srv,
+                          int skip_idx);
+void snapshot_fanout_end(snapshot_fanout_t *fo);
+
+void snapshot_note_ack(net_client_t *c, uint32_t tick);
+
+/* Decodes a MSG_SNAPSHOT payload into h. Returns the packed length of
+ * the new latest state, 0 for a stale snapshot, -1 when its baseline is
+ * gone (acknowledge tick 0 to ask for a keyframe). */
+int  snapshot_unpack(const game_def_t *def, snapshot_history_t *h,
+                     const uint8_t *payload, size_t len);
+/* Unpacks the newest state in h and, if input_seqs isn't NULL, the
+ * input sequence numbers it includes. Returns -1 if there is none. */
+int  snapshot_restore(const game_def_t *def, const snapshot_history_t *h,
+                      void *state, uint32_t input_seqs[2]);
+
+#endif
@@ -2,28 +2,49 @@
 #define BYTES_STATS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#define STATS_MAX_ENTRIES 32
 #define STATS_KEY_LEN     64
 
+/* The stats file is a log: a header naming its generation, then one
+ * line per change, each with a checksum. A change is appended under a
+ * lock shared by every process that writes the file, and is synced
+ * before the lock is let go. A line a crash cut short fails its
+ * checksum and is skipped. Now and then the log is compacted: one line
+ * per key, written to a new file that is renamed over the old one, with
+ * a new generation so that other processes know to read it afresh. */
+
 typedef struct {
     char key[STATS_KEY_LEN];
     int  value;
 } stats_entry_t;
 
 typedef struct {
-    stats_entry_t entries[STATS_MAX_ENTRIES];
-    int           count;
-    char          path[256];
+    stats_entry_t *entries;
+    int            count;
+    int            capacity;
+    int           *index;       /* open addressing: entry + 1, 0 = empty */
+    int            index_size;  /* a power of two */
+    uint32_t       generation;  /* of the log the entries came from */
+    size_t         offset;      /* bytes of it read so far */
+    int            records;     /* lines in it, for when to compact */
+    bool           torn;        /* it ends in part of a line */
+    bool           legacy;      /* it has no header: plain key=value */
+    char           path[256];
+    char           lock_path[264];
 } stats_t;
 
 void stats_init(stats_t *st);
+void stats_close(stats_t *st);
+/* Reads the file, compacting it if it has grown; false if there is none */
 bool stats_load(stats_t *st);
-bool stats_save(const stats_t *st);
+/* Compacts the file now */
+bool stats_save(stats_t *st);
 int  stats_get(const stats_t *st, const char *key);
 void stats_set(stats_t *st, const char *key, int value);
 void stats_increment(stats_t *st, const char *key);
 void stats_record_game(stats_t *st, const char *game_name, bool won);
-void stats_display(const stats_t *st);
+void stats_display(stats_t *st);
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef BYTES_TERM_H
+#define BYTES_TERM_H
+
+#include "common.h"
+#include "platform.h"
+
+#include <stdbool.h>
+#include <wchar.h>
+
+/* What a game draws its frames with. By default that is curses, like
+ * every other screen. The raw backend builds each frame as escape
+ * sequences in one buffer instead, and writes them at once. The buffer
+ * has a cursor move only where the next cell isn't the one after the
+ * last, and an SGR only where the attributes change. When the terminal
+ * has synchronized output (DEC mode 2026), the frame is wrapped in it,
+ * so the terminal never shows half of one.
+ *
+ * Curses doesn't know what raw frames put on the screen. A frame with
+ * anything drawn over the field goes through curses instead, and the
+ * hand-over makes curses repaint everything. */
+
+#define TERM_BUF_SIZE 16384   /* a frame longer than this is written in parts */
+
+/* A cell's character with its color pair and attributes, ready for
+ * either backend */
+typedef struct {
+    cchar_t cc;
+    char    utf8[8];
+    int     len;
+    int     sgr;              /* attributes, as term keys them */
+} term_glyph_t;
+
+void term_glyph(term_glyph_t *g, const wchar_t *wch, attr_t attrs, short pair);
+
+/* Turns the raw backend on after ui_init(); false if this terminal
+ * can't take it (not a tty, no UTF-8, Windows) */
+bool term_use_ansi(void);
+
+/* Starts a frame. overlay says curses will draw over the field before
+ * it is shown, which keeps the frame on curses. Returns whether the
+ * frame must draw everything: full, or the backend changed. The screen
+ * is erased first in that case. */
+bool term_begin(bool full, bool overlay);
+/* Shows the frame: one write() for a raw one, refresh() otherwise */
+void term_present(void);
+/* Before curses draws over a raw frame: its next refresh repaints the
+ * whole screen */
+void term_release(void);
+
+void term_put(int y, int x, const term_glyph_t *g);
+void term_hline(int y, int x, const term_glyph_t *g, int n);
+void term_vline(int y, int x, const term_glyph_t *g, int n);
+void term_text(int y, int x, attr_t attrs, short pair, const char *s);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef BYTES_TRIBUF_H
+#define BYTES_TRIBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lock-free triple buffer between one writer and one reader. The writer
+ * fills its slot and publishes it; the reader takes the newest slot
+ * published. Neither ever waits for the other: a slow reader just
+ * skips the slots published meanwhile, and a slot stays untouched by
+ * the writer for as long as the reader holds it. */
+typedef struct {
+    uint8_t  *slots;
+    size_t    stride;
+    uint32_t  back;      /* the writer's slot */
+    uint32_t  front;     /* the reader's slot */
+    uint32_t  middle;    /* slot index, | TRIBUF_FRESH once published;
+                          * the only field both threads touch */
+} tribuf_t;
+
+/* Three zeroed slots of size bytes each; -1 if they can't be allocated */
+int   tribuf_init(tribuf_t *tb, size_t size);
+void  tribuf_free(tribuf_t *tb);
+
+/* Writer: the slot to fill, then hands it over */
+void *tribuf_back(tribuf_t *tb);
+void  tribuf_publish(tribuf_t *tb);
+
+/* Reader: the newest slot published since the last call, or NULL when
+ * nothing new has been. It stays valid until the next call. */
+void *tribuf_acquire(tribuf_t *tb);
+
+#endif
@@ -2,6 +2,8 @@
 #define BYTES_UI_H
 
 #include "common.h"
+#include "linkstats.h"
+#include "lockstep.h"
 #include "platform.h"
 
 typedef enum {
@@ -19,13 +21,21 @@ void ui_cleanup(void);
 
 menu_choice_t ui_main_menu(void);
 void ui_get_name(char *name, size_t maxlen);
-void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_port);
+void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_port,
+                          char *room, size_t roomlen);
 void ui_waiting_screen(const char *player_name, const char *ip, int port);
 void ui_player_joined(const char *p1_name, const char *p2_name);
 void ui_countdown(const char *p1_name, const char *p2_name);
 void ui_game_over(const char *winner_name, bool you_won);
 void ui_pause_overlay(int seconds_left);
 void ui_show_message(const char *msg);
+/* Link figures drawn over the top right of the field; peer names the
+ * other end ("host", "player", ...) */
+void ui_net_hud(const linkstats_t *ls, const char *peer);
+/* Warns of a desync; with detail, rollback figures under the link HUD */
+void ui_lockstep_hud(const lockstep_t *ls, bool detail);
+/* Replay position and controls on one line; times in ticks */
+void ui_replay_bar(int row, uint32_t at, uint32_t total, int speed, bool paused);
 
 void ui_draw_box(int y, int x, int h, int w);
 
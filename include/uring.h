@@ -0,0 +1,59 @@
+#ifndef BYTES_URING_H
+#define BYTES_URING_H
+
+#include "common.h"
+#include "platform.h"
+
+#include <stdbool.h>
+
+/* A small io_uring driver on the raw system calls, so there is nothing
+ * extra to link. Only Linux has it; elsewhere uring_open() returns NULL
+ * and callers stay on their readiness-based path. */
+#if defined(BYTES_LINUX) && defined(__linux__)
+    #define BYTES_HAVE_URING 1
+#endif
+
+/* Receive buffers the kernel picks from for multishot recv. Data is
+ * copied out and the buffer handed straight back. */
+#define URING_BUF_COUNT 256
+#define URING_BUF_SIZE  512
+
+struct msghdr;
+
+typedef struct uring uring_t;
+
+typedef struct {
+    uint64_t user_data;
+    int32_t  res;
+    bool     more;      /* the request stays armed */
+    int      buf_id;    /* provided buffer holding res bytes, -1 = none */
+} uring_cqe_t;
+
+/* Returns NULL when the kernel lacks io_uring or multishot recv */
+uring_t *uring_open(unsigned entries);
+void     uring_close(uring_t *u);
+
+/* Each queues one submission; nothing reaches the kernel before the
+ * next uring_enter(). They return -1 if the queue can't take it. */
+int  uring_accept_multishot(uring_t *u, int fd, uint64_t user_data);
+int  uring_recv_multishot(uring_t *u, int fd, uint64_t user_data);
+int  uring_poll_multishot(uring_t *u, int fd, uint64_t user_data);
+int  uring_sendmsg(uring_t *u, int fd, const struct msghdr *msg,
+                   uint64_t user_data);
+int  uring_cancel(uring_t *u, uint64_t target, uint64_t user_data);
+
+/* Submits everything queued; with wait, also blocks until a completion
+ * arrives or timeout_ms passes (-1 = no limit). One system call. */
+int  uring_enter(uring_t *u, bool wait, int timeout_ms);
+bool uring_pending(const uring_t *u);
+
+/* Completions are read in place: peek, use, then pop */
+int  uring_peek(uring_t *u, uring_cqe_t *cqe);
+void uring_pop(uring_t *u);
+
+const uint8_t *uring_buffer(const uring_t *u, int buf_id);
+void           uring_recycle(uring_t *u, int buf_id);
+
+unsigned long  uring_enters(const uring_t *u);
+
+#endif
@@ -1,9 +1,19 @@
 #include "game.h"
+#include "linkstats.h"
+#include "lockstep.h"
 #include "protocol.h"
+#ifndef BYTES_HEADLESS
 #include "ui.h"
+#endif
 #include "pong.h"
 #include "platform.h"
+#include "snapshot.h"
+#ifndef BYTES_HEADLESS
+#include "term.h"
+#endif
+#include "tribuf.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -34,10 +44,38 @@ const char *game_get_name(int index)
     return game_registry[index]->name;
 }
 
+#ifndef BYTES_HEADLESS
 void game_session_init(game_session_t *gs, const game_def_t *def,
                        const char *p1, const char *p2,
                        bool is_server, bool is_spectator,
                        uint8_t local_player_id)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    game_session_init_sized(gs, def, p1, p2, is_server, is_spectator,
+                            local_player_id, rows, cols);
+}
+
+void game_session_init_start(game_session_t *gs, const msg_game_start_t *start,
+                             bool is_spectator, uint8_t local_player_id)
+{
+    const game_def_t *def = game_get_def((game_type_t)start->game_type);
+    if (start->rows > 0 && start->cols > 0)
+        game_session_init_sized(gs, def, start->p1_name, start->p2_name,
+                                false, is_spectator, local_player_id,
+                                start->rows, start->cols);
+    else
+        game_session_init(gs, def, start->p1_name, start->p2_name,
+                          false, is_spectator, local_player_id);
+    game_session_seed(gs, start->seed);
+    gs->lockstep = start->mode == GAME_MODE_LOCKSTEP;
+}
+#endif
+
+void game_session_init_sized(game_session_t *gs, const game_def_t *def,
+                             const char *p1, const char *p2,
+                             bool is_server, bool is_spectator,
+                             uint8_t local_player_id, int rows, int cols)
 {
     memset(gs, 0, sizeof(*gs));
     gs->def = def;
@@ -48,235 +86,1273 @@ void game_session_init(game_session_t *gs, const game_def_t *def,
     gs->local_player_id = local_player_id;
     gs->running = true;
     gs->paused = false;
+    gs->rows = rows;
+    gs->cols = cols;
 
     gs->state = calloc(1, def->state_size);
-
-    int rows, cols;
-    getmaxyx(stdscr, rows, cols);
     def->init(gs->state, rows, cols);
 }
 
+void game_session_seed(game_session_t *gs, uint32_t seed)
+{
+    gs->seed = seed;
+    if (gs->def->seed != NULL)
+        gs->def->seed(gs->state, seed);
+}
+
+uint32_t game_random_seed(void)
+{
+    return (uint32_t)platform_mono_us() ^ ((uint32_t)time(NULL) * 2654435761u);
+}
+
+int game_pack_start(const game_session_t *gs, uint8_t *buf, size_t buflen)
+{
+    uint8_t mode = gs->lockstep ? GAME_MODE_LOCKSTEP : GAME_MODE_SERVER;
+    return proto_pack_game_start(buf, buflen, (uint8_t)gs->def->type,
+                                 gs->p1_name, gs->p2_name, mode, gs->seed,
+                                 (uint16_t)gs->rows, (uint16_t)gs->cols);
+}
+
 void game_session_cleanup(game_session_t *gs)
 {
     free(gs->state);
     gs->state = NULL;
 }
 
-void game_run_server(game_session_t *gs, net_server_t *srv, int player_client_idx)
+void game_apply_input(const game_def_t *def, void *state, int player_id,
+                      int32_t input)
+{
+    if (!(input & GAME_INPUT_HELD))
+        def->handle_input(state, player_id, input);
+    else if (def->set_held != NULL)
+        def->set_held(state, player_id, (uint8_t)input);
+}
+
+/* ── Held keys ──────────────────────────────────────────────────── */
+
+int32_t game_keys_feed(game_keys_t *k, const game_def_t *def, int key,
+                       int64_t now_us)
+{
+    uint8_t bit = (def->key_action != NULL) ? def->key_action(key) : 0;
+    if (bit == 0)
+        return key;
+
+    int i = 0;
+    while (!(bit & (1u << i)))
+        i++;
+
+    int64_t last = k->last_us[i];
+    k->last_us[i] = now_us;
+    if (k->held & bit)
+        return GAME_INPUT_NONE;
+    if (last != 0 && now_us - last <= GAME_KEY_REPEAT_US) {
+        k->held |= bit;
+        return GAME_INPUT_HELD | k->held;
+    }
+    return key;
+}
+
+int32_t game_keys_poll(game_keys_t *k, int64_t now_us)
+{
+    uint8_t before = k->held;
+
+    for (int i = 0; i < 8; i++) {
+        if ((k->held & (1u << i)) && now_us - k->last_us[i] > GAME_KEY_RELEASE_US) {
+            k->held &= (uint8_t)~(1u << i);
+            k->last_us[i] = 0;
+        }
+    }
+    return (k->held != before) ? (GAME_INPUT_HELD | k->held) : GAME_INPUT_NONE;
+}
+
+/* Everything below drives a match in the terminal; headless builds
+ * only host through server.c */
+#ifndef BYTES_HEADLESS
+
+/* The screen is erased rather than cleared: clear() would make the
+ * next refresh repaint the whole terminal instead of what differs */
+void game_render(const game_session_t *gs, bool full, bool overlay)
 {
     const game_def_t *def = gs->def;
-    uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
-    uint8_t recv_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
-    uint8_t state_buf[MAX_MSG_PAYLOAD];
+    if (term_begin(full || def->render_reset == NULL, overlay) &&
+        def->render_reset != NULL)
+        def->render_reset();
+    def->render(gs->state, gs->p1_name, gs->p2_name, gs->is_spectator,
+                gs->spectator_count);
+}
+
+/* ── Link HUD ───────────────────────────────────────────────────── */
+
+#define GAME_HUD_KEY 'n'
+
+/* TCP bytes are counted here; net_udp_t counts its own */
+typedef struct {
+    linkstats_t stats;
+    bool        show;
+    uint64_t    tcp_in;
+    uint64_t    tcp_out;
+} game_link_t;
+
+static void link_update(game_link_t *gl, const net_udp_t *udp, int64_t now)
+{
+    uint64_t rx = gl->tcp_in;
+    uint64_t tx = gl->tcp_out;
+    if (udp != NULL) {
+        rx += udp->bytes_in;
+        tx += udp->bytes_out;
+    }
+    linkstats_update(&gl->stats, now, rx, tx);
+}
+
+/* Answers a ping in buf with its pong; returns the frame length or -1 */
+static int link_answer(const uint8_t *payload, size_t len, uint8_t *buf,
+                       size_t buflen)
+{
+    const msg_ping_wire_t *ping = proto_view_ping(payload, len);
+    if (ping == NULL)
+        return -1;
+    return proto_pack_pong(buf, buflen, proto_get_u32(&ping->seq),
+                           proto_get_u64(&ping->time_us));
+}
+
+static void link_pong(game_link_t *gl, const uint8_t *payload, size_t len)
+{
+    const msg_pong_wire_t *pong = proto_view_pong(payload, len);
+    if (pong != NULL)
+        linkstats_pong(&gl->stats, proto_get_u32(&pong->seq),
+                       proto_get_u64(&pong->time_us), platform_mono_us());
+}
+
+/* Frames a client sends over its TCP connection go through here */
+static void link_send(game_link_t *gl, bytes_socket_t fd, const uint8_t *buf,
+                      size_t len)
+{
+    int n = net_send(fd, buf, len, 100);
+    if (n > 0)
+        gl->tcp_out += (uint64_t)n;
+}
+
+/* ── Server ─────────────────────────────────────────────────────── */
+
+#define SERVER_MAX_EVENTS (MAX_CLIENTS + 4)
+
+typedef struct {
+    game_session_t *gs;
+    net_server_t   *srv;
+    net_udp_t      *udp;          /* NULL when the player is TCP-only */
+    int             player_idx;
+    int64_t         disconnect_time;
+    uint32_t        tick;
+    uint32_t        input_seqs[2];   /* newest input applied per player */
+    game_link_t     link;            /* player RTT, all clients' bytes */
+    lockstep_t     *ls;              /* NULL unless the session is lockstep */
+    snapshot_history_t history;
+    uint8_t         send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+} server_ctx_t;
+
+static void server_player_lost(server_ctx_t *ctx, int64_t now)
+{
+    net_server_close_client(ctx->srv, ctx->player_idx);
+    ctx->player_idx = -1;
+    ctx->gs->paused = true;
+
+    /* A reconnecting player comes back over TCP only, counting inputs
+     * from 1 again */
+    if (ctx->udp != NULL)
+        net_udp_forget_peer(ctx->udp);
+    ctx->input_seqs[1] = 0;
+    game_apply_input(ctx->gs->def, ctx->gs->state, 2, GAME_INPUT_HELD);
+    ctx->disconnect_time = now;
+
+    int pn = proto_pack_pause(ctx->send_buf, sizeof(ctx->send_buf), 0);
+    if (pn > 0)
+        net_send_to_all(ctx->srv, ctx->send_buf, (size_t)pn);
+}
+
+static void server_drop_client(server_ctx_t *ctx, int idx, int64_t now)
+{
+    net_client_t *c = &ctx->srv->clients[idx];
+    bool greeted = c->greeted;
+    c->greeted = false;
+
+    if (idx == ctx->player_idx) {
+        server_player_lost(ctx, now);
+        return;
+    }
+    if (greeted && ctx->gs->spectator_count > 0)
+        ctx->gs->spectator_count--;
+    net_server_close_client(ctx->srv, idx);
+}
+
+/* A send can give up on a client (write error or queue overflow) from
+ * anywhere; settle the bookkeeping for those once per iteration. */
+static void server_reap(server_ctx_t *ctx, int64_t now)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        net_client_t *c = &ctx->srv->clients[i];
+        if (!c->connected && (c->greeted || i == ctx->player_idx))
+            server_drop_client(ctx, i, now);
+    }
+}
+
+static void server_greet(server_ctx_t *ctx, int idx, const msg_hello_t *hello)
+{
+    game_session_t *gs = ctx->gs;
+    net_client_t *c = &ctx->srv->clients[idx];
+
+    c->greeted = true;
+    strncpy(c->name, hello->name, MAX_NAME_LEN - 1);
+
+    /* A player arriving while we wait for a reconnect takes the seat.
+     * In lockstep it would need our exact state, so it only watches. */
+    if (gs->paused && ctx->player_idx < 0 && hello->role == ROLE_PLAYER &&
+        ctx->ls == NULL) {
+        c->is_player = true;
+        c->player_id = 2;
+        ctx->player_idx = idx;
+
+        int wn = proto_pack_welcome(ctx->send_buf, sizeof(ctx->send_buf),
+                                    gs->p1_name, gs->p2_name, 2);
+        if (wn > 0)
+            net_server_send(ctx->srv, idx, ctx->send_buf, (size_t)wn);
+
+        int rn = proto_pack_resume(ctx->send_buf, sizeof(ctx->send_buf));
+        if (rn > 0)
+            net_send_to_all(ctx->srv, ctx->send_buf, (size_t)rn);
+
+        gs->paused = false;
+        return;
+    }
+
+    c->is_player = false;
+
+    int wn = proto_pack_welcome(ctx->send_buf, sizeof(ctx->send_buf),
+                                gs->p1_name, gs->p2_name, 0);
+    if (wn > 0)
+        net_server_send(ctx->srv, idx, ctx->send_buf, (size_t)wn);
+
+    int gn = game_pack_start(gs, ctx->send_buf, sizeof(ctx->send_buf));
+    if (gn > 0)
+        net_server_send(ctx->srv, idx, ctx->send_buf, (size_t)gn);
+
+    if (gs->paused) {
+        int pn = proto_pack_pause(ctx->send_buf, sizeof(ctx->send_buf), 0);
+        if (pn > 0)
+            net_server_send(ctx->srv, idx, ctx->send_buf, (size_t)pn);
+    }
+
+    gs->spectator_count++;
+}
+
+/* Drains everything a client has sent; the loop is edge-triggered so
+ * stopping early would leave messages unread until more data arrives. */
+static void server_read_client(server_ctx_t *ctx, int idx, int64_t now)
+{
+    game_session_t *gs = ctx->gs;
+    net_server_t *srv = ctx->srv;
+    const uint8_t *recv_buf;
+
+    while (gs->running && srv->clients[idx].connected) {
+        net_client_t *c = &srv->clients[idx];
+        int rr = net_recv_frame(c->fd, &c->rx, &recv_buf, 0);
+        if (rr == 0)
+            return;
+        if (rr < 0) {
+            server_drop_client(ctx, idx, now);
+            return;
+        }
+
+        msg_header_t hdr;
+        proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+        const uint8_t *payload = recv_buf + MSG_HEADER_SIZE;
+        ctx->link.tcp_in += (uint64_t)rr;
+
+        if (!srv->clients[idx].greeted) {
+            msg_hello_t hello;
+            if (hdr.type == MSG_HELLO &&
+                proto_unpack_hello(payload, hdr.payload_len, &hello) == 0)
+                server_greet(ctx, idx, &hello);
+            continue;
+        }
+
+        if (hdr.type == MSG_STATE_ACK) {
+            msg_state_ack_t ack;
+            if (proto_unpack_state_ack(payload, hdr.payload_len, &ack) == 0)
+                snapshot_note_ack(&srv->clients[idx], ack.tick);
+            continue;
+        }
+        if (hdr.type == MSG_PING) {
+            int n = link_answer(payload, hdr.payload_len, ctx->send_buf,
+                                sizeof(ctx->send_buf));
+            if (n > 0)
+                net_server_send(srv, idx, ctx->send_buf, (size_t)n);
+            continue;
+        }
+
+        /* Beyond acks spectators have nothing to say */
+        if (idx != ctx->player_idx)
+            continue;
+
+        if (hdr.type == MSG_INPUT) {
+            const msg_input_wire_t *inp = proto_view_input(payload, hdr.payload_len);
+            uint32_t seq = (inp != NULL) ? proto_get_u32(&inp->seq) : 0;
+            if (inp == NULL || (int32_t)(seq - ctx->input_seqs[1]) <= 0)
+                continue;
+            game_apply_input(gs->def, gs->state, 2, proto_get_i32(&inp->key));
+            ctx->input_seqs[1] = seq;
+        } else if (hdr.type == MSG_INPUT_HELD) {
+            const msg_input_held_wire_t *held =
+                proto_view_input_held(payload, hdr.payload_len);
+            uint32_t seq = (held != NULL) ? proto_get_u32(&held->seq) : 0;
+            if (held == NULL || (int32_t)(seq - ctx->input_seqs[1]) <= 0)
+                continue;
+            game_apply_input(gs->def, gs->state, 2,
+                             GAME_INPUT_HELD | proto_get_u8(&held->held));
+            ctx->input_seqs[1] = seq;
+        } else if (hdr.type == MSG_LOCKSTEP_INPUT && ctx->ls != NULL) {
+            msg_lockstep_input_t in;
+            if (proto_unpack_lockstep_input(payload, hdr.payload_len, &in) == 0)
+                lockstep_receive(ctx->ls, &in);
+        } else if (hdr.type == MSG_LOCKSTEP_HASH && ctx->ls != NULL) {
+            msg_lockstep_hash_t h;
+            if (proto_unpack_lockstep_hash(payload, hdr.payload_len, &h) == 0)
+                lockstep_peer_hash(ctx->ls, &h);
+        } else if (hdr.type == MSG_PONG) {
+            link_pong(&ctx->link, payload, hdr.payload_len);
+        } else if (hdr.type == MSG_QUIT) {
+            gs->running = false;
+        }
+    }
+}
+
+/* Datagrams from the player: the hello that pins down its address, then
+ * input batches. Each batch repeats the last few inputs, so anything
+ * already applied is skipped and a lost datagram costs nothing as long
+ * as a later one gets through. */
+static void server_read_udp(server_ctx_t *ctx)
+{
+    net_udp_t *udp = ctx->udp;
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    struct sockaddr_in from;
+
+    for (;;) {
+        int n = net_udp_recv(udp, buf, sizeof(buf), &from);
+        if (n <= 0)
+            return;
+
+        msg_header_t hdr;
+        proto_unpack_header(buf, (size_t)n, &hdr);
+        if ((size_t)hdr.payload_len > (size_t)n - MSG_HEADER_SIZE)
+            continue;
+        const uint8_t *payload = buf + MSG_HEADER_SIZE;
+
+        if (!udp->has_peer) {
+            msg_udp_hello_t hello;
+            if (ctx->player_idx >= 0 && hdr.type == MSG_UDP_HELLO &&
+                proto_unpack_udp_hello(payload, hdr.payload_len, &hello) == 0 &&
+                hello.token == udp->token) {
+                net_udp_set_peer(udp, &from);
+                udp->active = true;
+            }
+            continue;
+        }
+
+        msg_state_ack_t ack;
+        if (hdr.type == MSG_STATE_ACK && ctx->player_idx >= 0 &&
+            proto_unpack_state_ack(payload, hdr.payload_len, &ack) == 0) {
+            snapshot_note_ack(&ctx->srv->clients[ctx->player_idx], ack.tick);
+            continue;
+        }
+        if (hdr.type == MSG_PING) {
+            int pn = link_answer(payload, hdr.payload_len, ctx->send_buf,
+                                 sizeof(ctx->send_buf));
+            if (pn > 0)
+                net_udp_send(udp, ctx->send_buf, (size_t)pn);
+            continue;
+        }
+        if (hdr.type == MSG_PONG) {
+            link_pong(&ctx->link, payload, hdr.payload_len);
+            continue;
+        }
+        msg_lockstep_input_t lin;
+        if (hdr.type == MSG_LOCKSTEP_INPUT && ctx->ls != NULL &&
+            proto_unpack_lockstep_input(payload, hdr.payload_len, &lin) == 0) {
+            lockstep_receive(ctx->ls, &lin);
+            continue;
+        }
+
+        msg_udp_input_t in;
+        if (hdr.type != MSG_UDP_INPUT ||
+            proto_unpack_udp_input(payload, hdr.payload_len, &in) < 0)
+            continue;
+
+        for (int i = in.count - 1; i >= 0; i--) {
+            uint32_t seq = in.seq - (uint32_t)i;
+            if ((int32_t)(seq - ctx->input_seqs[1]) <= 0)
+                continue;
+            game_apply_input(ctx->gs->def, ctx->gs->state, 2, in.keys[i]);
+            ctx->input_seqs[1] = seq;
+        }
+    }
+}
+
+/* Pings the player on whichever channel carries its snapshots */
+static void server_ping_player(server_ctx_t *ctx, int64_t now)
+{
+    if (ctx->player_idx < 0 || !ctx->srv->clients[ctx->player_idx].greeted)
+        return;
+    uint32_t seq = linkstats_ping_due(&ctx->link.stats, now);
+    if (seq == 0)
+        return;
+
+    int n = proto_pack_ping(ctx->send_buf, sizeof(ctx->send_buf), seq,
+                            (uint64_t)now);
+    if (n <= 0)
+        return;
+    if (ctx->udp != NULL && ctx->udp->active)
+        net_udp_send(ctx->udp, ctx->send_buf, (size_t)n);
+    else
+        net_server_send(ctx->srv, ctx->player_idx, ctx->send_buf, (size_t)n);
+}
+
+/* Every client gets the tick's snapshot as a delta against the last one
+ * it acknowledged. Player 2 gets it by datagram once that path is up;
+ * spectators, and a player without it, stay on the TCP queue. In
+ * lockstep the player simulates for itself and gets none. */
+static void server_broadcast_state(server_ctx_t *ctx, const void *state)
+{
+    const game_def_t *def = ctx->gs->def;
+    int skip_idx = -1;
+
+    net_frame_t *key = snapshot_capture(def, state, ctx->input_seqs,
+                                        &ctx->history, ctx->tick,
+                                        ctx->srv->pool);
+    if (key == NULL)
+        return;
+
+    snapshot_fanout_t fo;
+    snapshot_fanout_begin(&fo, def, &ctx->history, key);
+
+    if (ctx->ls != NULL) {
+        skip_idx = ctx->player_idx;
+    } else if (ctx->udp != NULL && ctx->udp->active && ctx->player_idx >= 0) {
+        net_client_t *p = &ctx->srv->clients[ctx->player_idx];
+        net_frame_t *f = snapshot_fanout_get(&fo, p->acked_tick);
+        net_udp_send(ctx->udp, f->data, f->len);
+        skip_idx = ctx->player_idx;
+    }
+
+    snapshot_fanout_send(&fo, ctx->srv, skip_idx);
+    snapshot_fanout_end(&fo);
+}
+
+/* Keys of the host's own player go straight into the state, or in
+ * lockstep into the next tick */
+static void server_local_input(server_ctx_t *ctx, int32_t input)
+{
+    if (ctx->ls != NULL)
+        lockstep_local_input(ctx->ls, input);
+    else
+        game_apply_input(ctx->gs->def, ctx->gs->state, 1, input);
+}
+
+/* Our inputs go by datagram once the player has been heard there, the
+ * hashes always over TCP */
+static void server_lockstep_send(server_ctx_t *ctx)
+{
+    if (ctx->player_idx < 0)
+        return;
+    bool udp = ctx->udp != NULL && ctx->udp->active;
+
+    int n = lockstep_pack_inputs(ctx->ls, ctx->send_buf, sizeof(ctx->send_buf),
+                                 !udp);
+    if (n > 0 && udp)
+        net_udp_send(ctx->udp, ctx->send_buf, (size_t)n);
+    else if (n > 0)
+        net_server_send(ctx->srv, ctx->player_idx, ctx->send_buf, (size_t)n);
+
+    n = lockstep_pack_hash(ctx->ls, ctx->send_buf, sizeof(ctx->send_buf));
+    if (n > 0)
+        net_server_send(ctx->srv, ctx->player_idx, ctx->send_buf, (size_t)n);
+}
+
+/* Simulates the ticks due, takes back wrong guesses and sends spectators
+ * each newly confirmed state. Returns true if the state changed. */
+static bool server_lockstep_run(server_ctx_t *ctx, int steps)
+{
+    lockstep_t *ls = ctx->ls;
+    void *state = ctx->gs->state;
+    bool changed = false;
+
+    for (int s = 0; s < steps; s++) {
+        if (lockstep_step(ls, state)) {
+            ctx->link.stats.ticks++;
+            changed = true;
+        }
+    }
+    if (lockstep_settle(ls, state))
+        changed = true;
+    if (steps > 0)
+        server_lockstep_send(ctx);
+
+    if (ls->confirmed != ctx->tick) {
+        ctx->tick = ls->confirmed;
+        server_broadcast_state(ctx, lockstep_confirmed_state(ls, state));
+    }
+    return changed;
+}
+
+/* ── Host view ──────────────────────────────────────────────────── */
+
+/* While the host plays, a thread of its own owns the terminal: it draws
+ * the newest frame the match loop has published and hands keys back.
+ * The match loop never waits on the terminal, so a slow one holds up
+ * neither the ticks nor the state the clients are sent. */
+
+#define VIEW_KEYS 64   /* read but not yet taken; a power of two */
+
+/* The game state follows the header in each slot */
+typedef struct {
+    int         spectators;
+    int         pause_left;    /* seconds left to reconnect, 0 = playing */
+    linkstats_t link;
+    bool        lockstep;
+    lockstep_t  ls;            /* only what ui_lockstep_hud reads */
+} view_frame_t;
+
+typedef struct {
+    const game_session_t *gs;
+    tribuf_t        frames;
+    platform_wake_t wake;       /* a frame was published, or stop was set */
+    platform_wake_t keys_wake;  /* keys are waiting */
+    int32_t         keys[VIEW_KEYS];
+    uint32_t        key_head;   /* advanced by the view */
+    uint32_t        key_tail;   /* advanced by the match loop */
+    bool            stop;
+    bool            started;
+    pthread_t       thread;
+} host_view_t;
+
+static void *view_state(view_frame_t *f)
+{
+    return (uint8_t *)f + sizeof(*f);
+}
+
+static bool view_push_key(host_view_t *v, int ch)
+{
+    uint32_t head = v->key_head;
+    if (head - __atomic_load_n(&v->key_tail, __ATOMIC_ACQUIRE) >= VIEW_KEYS)
+        return false;
+    v->keys[head % VIEW_KEYS] = ch;
+    __atomic_store_n(&v->key_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool view_take_key(host_view_t *v, int *ch)
+{
+    uint32_t tail = v->key_tail;
+    if (tail == __atomic_load_n(&v->key_head, __ATOMIC_ACQUIRE))
+        return false;
+    *ch = v->keys[tail % VIEW_KEYS];
+    __atomic_store_n(&v->key_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Keys and the HUD toggle are read here, since curses may only be used
+ * from one thread; each pass draws whatever frame is newest by then */
+static void *view_main(void *arg)
+{
+    host_view_t *v = arg;
+    net_event_t events[4];
+    net_loop_t loop;
+    if (net_loop_init(&loop, 4) < 0)
+        return NULL;
+    net_loop_add_stdin(&loop);
+    if (v->wake.fd >= 0)
+        net_loop_add(&loop, v->wake.fd, NET_TAG_WAKE);
+
+    game_session_t shown = *v->gs;
+    view_frame_t *f = NULL;
+    bool full = true;
+    bool show_hud = false;
+
+    while (!__atomic_load_n(&v->stop, __ATOMIC_ACQUIRE)) {
+        net_loop_wait(&loop, events, 4, (v->wake.fd >= 0) ? -1 : 10);
+        platform_wake_drain(&v->wake);
+
+        int ch;
+        bool keys = false;
+        while ((ch = getch()) != ERR) {
+            if (ch == GAME_HUD_KEY) {
+                show_hud = !show_hud;
+                full = true;
+            } else if (view_push_key(v, ch)) {
+                keys = true;
+            }
+        }
+        if (keys)
+            platform_wake_signal(&v->keys_wake);
+
+        view_frame_t *next = tribuf_acquire(&v->frames);
+        if (next != NULL)
+            f = next;
+        if (f == NULL || (next == NULL && !full))
+            continue;
+
+        if (f->pause_left > 0) {
+            term_release();
+            ui_pause_overlay(f->pause_left);
+            full = true;
+            continue;
+        }
+        bool lockstep_hud = f->lockstep && (show_hud || f->ls.desync_tick != 0);
+        shown.state = view_state(f);
+        shown.spectator_count = f->spectators;
+        game_render(&shown, full, show_hud || lockstep_hud);
+        full = false;
+        if (show_hud)
+            ui_net_hud(&f->link, "player");
+        if (lockstep_hud)
+            ui_lockstep_hud(&f->ls, show_hud);
+        term_present();
+    }
+
+    net_loop_close(&loop);
+    return NULL;
+}
+
+/* Returns -1 if the thread or its buffers can't be had */
+static int view_start(host_view_t *v, const game_session_t *gs)
+{
+    memset(v, 0, sizeof(*v));
+    v->gs = gs;
+    if (tribuf_init(&v->frames, sizeof(view_frame_t) + gs->def->state_size) < 0)
+        return -1;
+    /* Without these the loops fall back to timeouts and stdin itself */
+    platform_wake_init(&v->wake);
+    platform_wake_init(&v->keys_wake);
+    if (pthread_create(&v->thread, NULL, view_main, v) != 0) {
+        platform_wake_close(&v->wake);
+        platform_wake_close(&v->keys_wake);
+        tribuf_free(&v->frames);
+        return -1;
+    }
+    v->started = true;
+    return 0;
+}
+
+/* Hands the terminal back to the calling thread */
+static void view_stop(host_view_t *v)
+{
+    if (!v->started)
+        return;
+    __atomic_store_n(&v->stop, true, __ATOMIC_RELEASE);
+    platform_wake_signal(&v->wake);
+    pthread_join(v->thread, NULL);
+    v->started = false;
+    platform_wake_close(&v->wake);
+    platform_wake_close(&v->keys_wake);
+    tribuf_free(&v->frames);
+}
+
+static void view_publish(host_view_t *v, const server_ctx_t *ctx, int pause_left)
+{
+    const game_session_t *gs = ctx->gs;
+    view_frame_t *f = tribuf_back(&v->frames);
+    f->spectators = gs->spectator_count;
+    f->pause_left = pause_left;
+    f->link = ctx->link.stats;
+    f->lockstep = (ctx->ls != NULL);
+    if (ctx->ls != NULL) {
+        f->ls.tick = ctx->ls->tick;
+        f->ls.remote_tick = ctx->ls->remote_tick;
+        f->ls.desync_tick = ctx->ls->desync_tick;
+        f->ls.rollbacks = ctx->ls->rollbacks;
+        f->ls.resimulated = ctx->ls->resimulated;
+    }
+    memcpy(view_state(f), gs->state, gs->def->state_size);
+    tribuf_publish(&v->frames);
+    platform_wake_signal(&v->wake);
+}
+
+void game_run_server(game_session_t *gs, net_server_t *srv, int player_client_idx,
+                     net_udp_t *udp)
+{
+    const game_def_t *def = gs->def;
+    net_event_t events[SERVER_MAX_EVENTS];
+    net_loop_t loop;
+
+    server_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.gs = gs;
+    ctx.srv = srv;
+    ctx.udp = udp;
+    ctx.player_idx = player_client_idx;
+    linkstats_init(&ctx.link.stats, platform_mono_us());
+
+    lockstep_t ls;
+    if (gs->lockstep) {
+        if (lockstep_init(&ls, def, 1) < 0) {
+            ui_show_message("Out of memory.");
+            nodelay(stdscr, FALSE);
+            getch();
+            return;
+        }
+        ctx.ls = &ls;
+    }
+
+    if (net_loop_init(&loop, SERVER_MAX_EVENTS) < 0 ||
+        net_server_attach_loop(srv, &loop) < 0) {
+        net_loop_close(&loop);
+        srv->loop = NULL;
+        ui_show_message("Failed to set up the server event loop.");
+        nodelay(stdscr, FALSE);
+        getch();
+        return;
+    }
+    if (udp != NULL && net_loop_add(&loop, udp->fd, NET_TAG_UDP) < 0)
+        ctx.udp = NULL;
 
     keypad(stdscr, TRUE);
-    timeout(TICK_INTERVAL_US / 1000 / 2);
+    nodelay(stdscr, TRUE);
 
-    int64_t last_tick = platform_mono_us();
-    int reconnect_countdown = 0;
-    int64_t disconnect_time = 0;
+    host_view_t view;
+    if (view_start(&view, gs) < 0) {
+        if (ctx.ls != NULL)
+            lockstep_free(ctx.ls);
+        net_loop_close(&loop);
+        srv->loop = NULL;
+        ui_show_message("Out of memory.");
+        nodelay(stdscr, FALSE);
+        getch();
+        return;
+    }
+    /* Keys come from the view; without its wake fd, stdin itself wakes us */
+    if (view.keys_wake.fd >= 0)
+        net_loop_add(&loop, view.keys_wake.fd, NET_TAG_STDIN);
+    else
+        net_loop_add_stdin(&loop);
+
+    game_keys_t keys;
+    memset(&keys, 0, sizeof(keys));
+
+    platform_ticker_t ticker;
+    platform_ticker_init(&ticker, TICK_INTERVAL_US, true);
+    if (ticker.fd >= 0 && net_loop_add(&loop, ticker.fd, NET_TAG_TIMER) < 0)
+        platform_ticker_close(&ticker);
 
+    int pause_shown = 0;   /* countdown in the view's newest frame */
+    view_publish(&view, &ctx, 0);
     while (gs->running) {
         int64_t now = platform_mono_us();
 
+        int32_t released = game_keys_poll(&keys, now);
+        if (released != GAME_INPUT_NONE && !gs->paused)
+            server_local_input(&ctx, released);
+
+        int wait_ms = platform_ticker_wait_ms(&ticker, now);
+        if (gs->paused && (wait_ms < 0 || wait_ms > 100))
+            wait_ms = 100;
+
+        /* What the last iteration sent goes out before we sleep, one
+         * write per client */
+        net_server_end_batch(srv);
+        int nev = net_loop_wait(&loop, events, SERVER_MAX_EVENTS, wait_ms);
+        now = platform_mono_us();
+        net_server_begin_batch(srv);
+
+        for (int i = 0; i < nev && gs->running; i++) {
+            if (events[i].tag == NET_TAG_LISTEN) {
+                while (net_server_accept(srv, 0) >= 0)
+                    ;
+            } else if (events[i].tag == NET_TAG_UDP) {
+                server_read_udp(&ctx);
+            } else if (events[i].tag == NET_TAG_STDIN) {
+                int ch;
+                platform_wake_drain(&view.keys_wake);
+                while (view_take_key(&view, &ch)) {
+                    if (ch == 'q') {
+                        int qn = proto_pack_quit(ctx.send_buf, sizeof(ctx.send_buf));
+                        if (qn > 0)
+                            net_send_to_all(srv, ctx.send_buf, (size_t)qn);
+                        gs->running = false;
+                        break;
+                    }
+                    int32_t in = game_keys_feed(&keys, def, ch, now);
+                    if (in != GAME_INPUT_NONE && !gs->paused)
+                        server_local_input(&ctx, in);
+                }
+            } else {
+                int idx = events[i].tag;
+                if (idx < 0 || idx >= MAX_CLIENTS)
+                    continue;
+                if (events[i].events & NET_EV_WRITE)
+                    net_server_flush(srv, idx);
+                if (events[i].events & NET_EV_READ)
+                    server_read_client(&ctx, idx, now);
+            }
+        }
+
+        server_reap(&ctx, now);
+        if (!gs->running)
+            break;
+
+        server_ping_player(&ctx, now);
+        ctx.link.tcp_out = srv->bytes_out;
+        link_update(&ctx.link, ctx.udp, now);
+
         if (gs->paused) {
-            int elapsed = (int)((now - disconnect_time) / 1000000);
+            int elapsed = (int)((now - ctx.disconnect_time) / 1000000);
             int remaining = RECONNECT_TIMEOUT_SEC - elapsed;
             if (remaining <= 0) {
-                int winner = (player_client_idx >= 0) ? 2 : 1;
+                int winner = (ctx.player_idx >= 0) ? 2 : 1;
                 const char *wname = (winner == 1) ? gs->p1_name : gs->p2_name;
 
-                int n = proto_pack_game_over(send_buf, sizeof(send_buf),
+                int n = proto_pack_game_over(ctx.send_buf, sizeof(ctx.send_buf),
                                              (uint8_t)winner, wname);
                 if (n > 0)
-                    net_send_to_all(srv, send_buf, (size_t)n);
+                    net_send_to_all(srv, ctx.send_buf, (size_t)n);
+                net_server_end_batch(srv);
 
                 gs->running = false;
+                view_stop(&view);
                 bool you_won = (winner == 1);
                 ui_game_over(wname, you_won);
                 break;
             }
 
-            int new_idx = net_server_accept(srv, 100);
-            if (new_idx >= 0) {
-                int rr = net_recv(srv->clients[new_idx].fd, recv_buf,
-                                  sizeof(recv_buf), 3000);
-                if (rr > 0) {
-                    msg_header_t hdr;
-                    proto_unpack_header(recv_buf, (size_t)rr, &hdr);
-                    if (hdr.type == MSG_HELLO) {
-                        msg_hello_t hello;
-                        proto_unpack_hello(recv_buf + MSG_HEADER_SIZE,
-                                           hdr.payload_len, &hello);
-                        if (hello.role == ROLE_PLAYER) {
-                            srv->clients[new_idx].is_player = true;
-                            srv->clients[new_idx].player_id = 2;
-                            strncpy(srv->clients[new_idx].name, hello.name,
-                                    MAX_NAME_LEN - 1);
-                            player_client_idx = new_idx;
-
-                            int wn = proto_pack_welcome(send_buf, sizeof(send_buf),
-                                                        gs->p1_name, gs->p2_name, 2);
-                            if (wn > 0)
-                                net_send(srv->clients[new_idx].fd, send_buf, (size_t)wn, 500);
-
-                            int rn = proto_pack_resume(send_buf, sizeof(send_buf));
-                            if (rn > 0)
-                                net_send_to_all(srv, send_buf, (size_t)rn);
-
-                            gs->paused = false;
-                            reconnect_countdown = 0;
-                        } else {
-                            srv->clients[new_idx].is_player = false;
-                            gs->spectator_count++;
-                        }
-                    }
-                }
+            if (remaining != pause_shown) {
+                view_publish(&view, &ctx, remaining);
+                pause_shown = remaining;
             }
-
-            ui_pause_overlay(remaining);
+            platform_ticker_restart(&ticker, now);
             continue;
         }
 
-        int spec_idx = net_server_accept(srv, 0);
-        if (spec_idx >= 0) {
-            int rr = net_recv(srv->clients[spec_idx].fd, recv_buf,
-                              sizeof(recv_buf), 1000);
-            if (rr > 0) {
-                msg_header_t hdr;
-                proto_unpack_header(recv_buf, (size_t)rr, &hdr);
-                if (hdr.type == MSG_HELLO) {
-                    msg_hello_t hello;
-                    proto_unpack_hello(recv_buf + MSG_HEADER_SIZE,
-                                       hdr.payload_len, &hello);
-                    srv->clients[spec_idx].is_player = false;
-                    strncpy(srv->clients[spec_idx].name, hello.name,
-                            MAX_NAME_LEN - 1);
-
-                    int wn = proto_pack_welcome(send_buf, sizeof(send_buf),
-                                                gs->p1_name, gs->p2_name, 0);
-                    if (wn > 0)
-                        net_send(srv->clients[spec_idx].fd, send_buf, (size_t)wn, 500);
-
-                    int gn = proto_pack_game_start(send_buf, sizeof(send_buf),
-                                                   (uint8_t)def->type,
-                                                   gs->p1_name, gs->p2_name);
-                    if (gn > 0)
-                        net_send(srv->clients[spec_idx].fd, send_buf, (size_t)gn, 500);
-
-                    gs->spectator_count++;
-                }
+        /* Ticks owed after a stall are simulated back to back, and the
+         * state they end in goes out once */
+        int steps = platform_ticker_due(&ticker, now);
+        bool changed = false;
+        if (ctx.ls != NULL) {
+            changed = server_lockstep_run(&ctx, steps);
+        } else if (steps > 0) {
+            for (int s = 0; s < steps && !def->is_over(gs->state); s++) {
+                ctx.tick++;
+                ctx.link.stats.ticks++;
+                def->update(gs->state);
             }
+            server_broadcast_state(&ctx, gs->state);
+            changed = true;
         }
 
-        if (player_client_idx >= 0 && srv->clients[player_client_idx].connected) {
-            int pr = net_poll_readable(srv->clients[player_client_idx].fd, 0);
-            if (pr > 0) {
-                int rr = net_recv(srv->clients[player_client_idx].fd,
-                                  recv_buf, sizeof(recv_buf), 0);
-                if (rr > 0) {
-                    msg_header_t hdr;
-                    proto_unpack_header(recv_buf, (size_t)rr, &hdr);
-                    if (hdr.type == MSG_INPUT) {
-                        msg_input_t inp;
-                        proto_unpack_input(recv_buf + MSG_HEADER_SIZE,
-                                           hdr.payload_len, &inp);
-                        def->handle_input(gs->state, 2, inp.key);
-                    } else if (hdr.type == MSG_QUIT) {
-                        gs->running = false;
-                        break;
-                    }
-                } else if (rr < 0) {
-                    net_server_close_client(srv, player_client_idx);
-                    player_client_idx = -1;
-                    gs->paused = true;
-                    disconnect_time = now;
-                    reconnect_countdown = RECONNECT_TIMEOUT_SEC;
-
-                    int pn = proto_pack_pause(send_buf, sizeof(send_buf), 0);
-                    if (pn > 0)
-                        net_send_to_all(srv, send_buf, (size_t)pn);
-
-                    (void)reconnect_countdown;
-                    continue;
-                }
-            } else if (pr < 0) {
-                net_server_close_client(srv, player_client_idx);
-                player_client_idx = -1;
-                gs->paused = true;
-                disconnect_time = now;
-
-                int pn = proto_pack_pause(send_buf, sizeof(send_buf), 0);
-                if (pn > 0)
-                    net_send_to_all(srv, send_buf, (size_t)pn);
-                continue;
-            }
+        /* The clients have this tick's state before the view gets it */
+        if (changed || pause_shown != 0) {
+            view_publish(&view, &ctx, 0);
+            pause_shown = 0;
         }
 
-        int ch = getch();
-        if (ch == 'q') {
-            int qn = proto_pack_quit(send_buf, sizeof(send_buf));
-            if (qn > 0)
-                net_send_to_all(srv, send_buf, (size_t)qn);
+        /* In lockstep only a confirmed state decides the match */
+        const void *result = (ctx.ls != NULL)
+                           ? lockstep_confirmed_state(ctx.ls, gs->state)
+                           : gs->state;
+        if (def->is_over(result)) {
+            if (result != gs->state)
+                memcpy(gs->state, result, def->state_size);
+            int winner = def->get_winner(gs->state);
+            const char *wname = (winner == 1) ? gs->p1_name : gs->p2_name;
+
+            int gon = proto_pack_game_over(ctx.send_buf, sizeof(ctx.send_buf),
+                                           (uint8_t)winner, wname);
+            if (gon > 0)
+                net_send_to_all(srv, ctx.send_buf, (size_t)gon);
+            net_server_end_batch(srv);
+
             gs->running = false;
+            view_stop(&view);
+            bool you_won = (winner == 1);
+            ui_game_over(wname, you_won);
             break;
         }
-        if (ch != ERR)
-            def->handle_input(gs->state, 1, ch);
+    }
 
-        if (now - last_tick >= TICK_INTERVAL_US) {
-            last_tick = now;
+    net_server_end_batch(srv);
+    view_stop(&view);
 
-            def->update(gs->state);
+    if (ticker.fd >= 0)
+        net_loop_remove(&loop, ticker.fd);
+    platform_ticker_close(&ticker);
+    if (ctx.ls != NULL)
+        lockstep_free(ctx.ls);
+    net_loop_close(&loop);
+    srv->loop = NULL;
+    nodelay(stdscr, FALSE);
+}
 
-            clear();
-            def->render(gs->state, gs->p1_name, gs->p2_name,
-                        false, gs->spectator_count);
-            refresh();
+/* ── Render governor ────────────────────────────────────────────── */
 
-            int slen = def->pack_state(gs->state, state_buf, sizeof(state_buf));
-            if (slen > 0) {
-                int pkt = proto_pack_state(send_buf, sizeof(send_buf),
-                                           state_buf, (uint16_t)slen);
-                if (pkt > 0)
-                    net_send_to_all(srv, send_buf, (size_t)pkt);
-            }
+/* refresh() blocks until the terminal has taken the frame, and over a
+ * congested SSH session that stalls the socket reads behind it until
+ * the host gives up on us. Each refresh is timed, and no frame starts
+ * while the terminal is still backed up. While refreshes run slow,
+ * frames are spaced further apart; once they keep up, the spacing
+ * shrinks back to one frame per state. A frame always shows the newest. */
+#define GOV_SLOW_US         (TICK_INTERVAL_US / 4)   /* a refresh this long is behind */
+#define GOV_QUEUE_BYTES     2048      /* queued for the terminal = behind */
+#define GOV_MAX_INTERVAL_US 500000    /* still two frames a second */
+#define GOV_CALM_FRAMES     8         /* kept up this long = speed up */
 
-            if (def->is_over(gs->state)) {
-                int winner = def->get_winner(gs->state);
-                const char *wname = (winner == 1) ? gs->p1_name : gs->p2_name;
+typedef struct {
+    int64_t interval_us;   /* least time between frames, 0 = every state */
+    int64_t next_us;       /* earliest the next frame may start */
+    int     calm;          /* frames in a row that kept up */
+} render_gov_t;
 
-                int gon = proto_pack_game_over(send_buf, sizeof(send_buf),
-                                               (uint8_t)winner, wname);
-                if (gon > 0)
-                    net_send_to_all(srv, send_buf, (size_t)gon);
+static bool gov_due(const render_gov_t *g, int64_t now)
+{
+    return now >= g->next_us && !platform_term_behind(GOV_QUEUE_BYTES);
+}
 
-                gs->running = false;
-                bool you_won = (winner == 1);
-                ui_game_over(wname, you_won);
-                break;
-            }
+/* term_present() with the governor timing it. A frame that blocked means
+ * the terminal took that long for one frame, so it gets at least as
+ * long again to drain before the next. */
+static void gov_refresh(render_gov_t *g)
+{
+    int64_t start = platform_mono_us();
+    term_present();
+    int64_t cost = platform_mono_us() - start;
+
+    if (cost > GOV_SLOW_US) {
+        g->calm = 0;
+        g->interval_us = (g->interval_us > 0) ? g->interval_us * 2
+                                              : TICK_INTERVAL_US * 2;
+        if (g->interval_us > GOV_MAX_INTERVAL_US)
+            g->interval_us = GOV_MAX_INTERVAL_US;
+    } else if (g->interval_us > 0 && ++g->calm >= GOV_CALM_FRAMES) {
+        g->calm = 0;
+        g->interval_us /= 2;
+        if (g->interval_us <= TICK_INTERVAL_US)
+            g->interval_us = 0;
+    }
+    g->next_us = start + g->interval_us;
+    if (g->next_us < start + 2 * cost)
+        g->next_us = start + 2 * cost;
+}
+
+/* ── Client ─────────────────────────────────────────────────────── */
+
+#define CLIENT_UDP_HELLO_INTERVAL_US 200000
+#define CLIENT_PREDICT_INPUTS        64
+#define CLIENT_PREDICT_TICKS         128
+
+/* Snapshots decoded so far; deltas refer back into this */
+typedef struct {
+    snapshot_history_t history;
+    int64_t            ack;     /* tick to acknowledge next, -1 = none */
+} client_snap_t;
+
+/* Our own inputs, applied on screen before the server has seen them,
+ * and the ticks our held actions have run since */
+typedef struct {
+    uint32_t seq;                            /* newest input sent */
+    int32_t  inputs[CLIENT_PREDICT_INPUTS];  /* by seq % CLIENT_PREDICT_INPUTS */
+    uint8_t  held[CLIENT_PREDICT_INPUTS];    /* actions held once it applied */
+    uint32_t ticks;                          /* held ticks predicted so far */
+    uint32_t tick_seq[CLIENT_PREDICT_TICKS]; /* newest input when each ran */
+    int64_t  tick_us[CLIENT_PREDICT_TICKS];  /* and when */
+} client_predict_t;
+
+typedef struct {
+    net_udp_t *udp;
+    int64_t    next_hello;
+    uint32_t   input_seq;      /* sequence number of inputs[0] */
+    int32_t    inputs[UDP_INPUT_REDUNDANCY];   /* newest first */
+    int        input_count;
+    int        resends_left;
+} client_udp_t;
+
+/* Returns true when the snapshot is newer than anything seen so far. One
+ * that can't be decoded makes us ask for a keyframe. */
+static bool client_feed_snapshot(client_snap_t *cs, const game_def_t *def,
+                                 const uint8_t *payload, size_t len)
+{
+    int n = snapshot_unpack(def, &cs->history, payload, len);
+    if (n < 0) {
+        cs->ack = 0;
+        return false;
+    }
+    if (n == 0)
+        return false;
+    cs->ack = cs->history.latest;
+    return true;
+}
+
+/* Numbers a new input and, unless the match is paused, applies it to
+ * the predicted state right away */
+static uint32_t client_predict_input(client_predict_t *cp, game_session_t *gs,
+                                     int32_t input)
+{
+    uint8_t held = cp->held[cp->seq % CLIENT_PREDICT_INPUTS];
+    cp->seq++;
+    cp->inputs[cp->seq % CLIENT_PREDICT_INPUTS] = input;
+    cp->held[cp->seq % CLIENT_PREDICT_INPUTS] =
+        (input & GAME_INPUT_HELD) ? (uint8_t)input : held;
+    if (!gs->paused)
+        game_apply_input(gs->def, gs->state, gs->local_player_id, input);
+    return cp->seq;
+}
+
+/* Runs our held actions for one tick between snapshots. Returns true
+ * when they moved anything. */
+static bool client_predict_tick(client_predict_t *cp, game_session_t *gs,
+                                int64_t now)
+{
+    int pid = gs->local_player_id;
+    if (gs->def->predict_tick == NULL || gs->paused || pid < 1 || pid > 2 ||
+        cp->held[cp->seq % CLIENT_PREDICT_INPUTS] == 0)
+        return false;
+    cp->tick_seq[cp->ticks % CLIENT_PREDICT_TICKS] = cp->seq;
+    cp->tick_us[cp->ticks % CLIENT_PREDICT_TICKS] = now;
+    cp->ticks++;
+    gs->def->predict_tick(gs->state, pid);
+    return true;
+}
+
+/* Rebuilds the predicted state from the newest snapshot plus every input
+ * of ours it doesn't include yet, each followed by the held ticks that
+ * ran after it. The server started holding half a round trip after we
+ * did, and its snapshot is half a round trip old, so of the ticks held
+ * under the newest input it has, those from the last round trip
+ * (since_us on) are missing too. Snapshots don't carry held actions;
+ * ours are put back as they stood at that input. Inputs and ticks too
+ * old to be remembered are taken as lost. */
+static void client_reconcile(const client_predict_t *cp, const client_snap_t *cs,
+                             game_session_t *gs, int64_t since_us)
+{
+    uint32_t seqs[2];
+    if (snapshot_restore(gs->def, &cs->history, gs->state, seqs) < 0)
+        return;
+    int pid = gs->local_player_id;
+    if (pid < 1 || pid > 2 || gs->paused)
+        return;
+
+    uint32_t pending = cp->seq - seqs[pid - 1];
+    if (pending > CLIENT_PREDICT_INPUTS - 1)
+        pending = CLIENT_PREDICT_INPUTS - 1;
+    uint32_t seq = cp->seq - pending;
+    if (gs->def->set_held != NULL)
+        gs->def->set_held(gs->state, pid, cp->held[seq % CLIENT_PREDICT_INPUTS]);
+
+    uint32_t t = (cp->ticks > CLIENT_PREDICT_TICKS) ? cp->ticks - CLIENT_PREDICT_TICKS : 0;
+    for (; t < cp->ticks; t++) {
+        int32_t age = (int32_t)(cp->tick_seq[t % CLIENT_PREDICT_TICKS] - seq);
+        if (age > 0 || (age == 0 && cp->tick_us[t % CLIENT_PREDICT_TICKS] > since_us))
+            break;
+    }
+    for (;;) {
+        for (; t < cp->ticks && cp->tick_seq[t % CLIENT_PREDICT_TICKS] == seq; t++)
+            gs->def->predict_tick(gs->state, pid);
+        if (seq == cp->seq)
+            break;
+        seq++;
+        game_apply_input(gs->def, gs->state, pid,
+                         cp->inputs[seq % CLIENT_PREDICT_INPUTS]);
+    }
+}
+
+/* One ack per pass covers everything drained in it */
+static void client_send_ack(client_snap_t *cs, game_link_t *gl,
+                            bytes_socket_t fd, net_udp_t *udp)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MSG_STATE_ACK_SIZE];
+
+    if (cs->ack < 0)
+        return;
+    int n = proto_pack_state_ack(buf, sizeof(buf), (uint32_t)cs->ack);
+    cs->ack = -1;
+    if (n <= 0)
+        return;
+
+    if (udp != NULL)
+        net_udp_send(udp, buf, (size_t)n);
+    else
+        link_send(gl, fd, buf, (size_t)n);
+}
+
+/* Pings the host over the channel snapshots arrive on (udp, if not NULL) */
+static void client_ping(game_link_t *gl, bytes_socket_t fd, net_udp_t *udp,
+                        int64_t now)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MSG_PING_SIZE];
+
+    uint32_t seq = linkstats_ping_due(&gl->stats, now);
+    if (seq == 0)
+        return;
+    int n = proto_pack_ping(buf, sizeof(buf), seq, (uint64_t)now);
+    if (n <= 0)
+        return;
+
+    if (udp != NULL)
+        net_udp_send(udp, buf, (size_t)n);
+    else
+        link_send(gl, fd, buf, (size_t)n);
+}
+
+/* Until the host answers, keep announcing ourselves on the datagram port */
+static void client_udp_hello(client_udp_t *cu, int64_t now)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MSG_UDP_HELLO_SIZE];
+
+    if (cu->udp->active || now < cu->next_hello)
+        return;
+    cu->next_hello = now + CLIENT_UDP_HELLO_INTERVAL_US;
+
+    int n = proto_pack_udp_hello(buf, sizeof(buf), cu->udp->token);
+    if (n > 0)
+        net_udp_send(cu->udp, buf, (size_t)n);
+}
+
+/* Sends the input window. A new input (numbered seq) goes out at once;
+ * the same window is repeated on the next few passes so one lost
+ * datagram loses nothing. */
+static void client_udp_send_inputs(client_udp_t *cu, uint32_t seq, int32_t input)
+{
+    uint8_t buf[MSG_HEADER_SIZE + 5 + 4 * UDP_INPUT_REDUNDANCY];
+
+    if (input != GAME_INPUT_NONE) {
+        memmove(cu->inputs + 1, cu->inputs,
+                sizeof(cu->inputs[0]) * (UDP_INPUT_REDUNDANCY - 1));
+        cu->inputs[0] = input;
+        cu->input_seq = seq;
+        if (cu->input_count < UDP_INPUT_REDUNDANCY)
+            cu->input_count++;
+        cu->resends_left = UDP_INPUT_REDUNDANCY;
+    }
+    if (cu->resends_left == 0)
+        return;
+    cu->resends_left--;
+
+    int n = proto_pack_udp_input(buf, sizeof(buf), cu->input_seq,
+                                 cu->inputs, (uint8_t)cu->input_count);
+    if (n > 0)
+        net_udp_send(cu->udp, buf, (size_t)n);
+}
+
+/* Drains every pending datagram. Snapshots older than what is on
+ * screen already are dropped rather than replayed; in lockstep the host
+ * sends its inputs instead. */
+static bool client_udp_read(client_udp_t *cu, client_snap_t *cs,
+                            game_link_t *gl, const game_def_t *def,
+                            lockstep_t *ls)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    bool got = false;
+
+    for (;;) {
+        int n = net_udp_recv(cu->udp, buf, sizeof(buf), NULL);
+        if (n <= 0)
+            break;
+
+        msg_header_t hdr;
+        proto_unpack_header(buf, (size_t)n, &hdr);
+        if ((size_t)hdr.payload_len > (size_t)n - MSG_HEADER_SIZE)
+            continue;
+
+        if (hdr.type == MSG_PING) {
+            int pn = link_answer(buf + MSG_HEADER_SIZE, hdr.payload_len,
+                                 buf, sizeof(buf));
+            if (pn > 0)
+                net_udp_send(cu->udp, buf, (size_t)pn);
+            continue;
+        }
+        if (hdr.type == MSG_PONG) {
+            link_pong(gl, buf + MSG_HEADER_SIZE, hdr.payload_len);
+            continue;
         }
+        msg_lockstep_input_t in;
+        if (hdr.type == MSG_LOCKSTEP_INPUT && ls != NULL &&
+            proto_unpack_lockstep_input(buf + MSG_HEADER_SIZE, hdr.payload_len,
+                                        &in) == 0) {
+            cu->udp->active = true;
+            lockstep_receive(ls, &in);
+            continue;
+        }
+        if (hdr.type != MSG_SNAPSHOT)
+            continue;
 
-        int64_t elapsed = platform_mono_us() - now;
-        int64_t remaining_us = TICK_INTERVAL_US - elapsed;
-        if (remaining_us > 1000)
-            platform_usleep((unsigned)(remaining_us / 2));
+        cu->udp->active = true;
+        if (client_feed_snapshot(cs, def, buf + MSG_HEADER_SIZE, hdr.payload_len))
+            got = true;
     }
+    return got;
+}
 
-    nodelay(stdscr, FALSE);
+/* Inputs go over udp when it isn't NULL, hashes always over TCP */
+static void client_lockstep_send(lockstep_t *ls, game_link_t *gl,
+                                 bytes_socket_t fd, net_udp_t *udp)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+
+    int n = lockstep_pack_inputs(ls, buf, sizeof(buf), udp == NULL);
+    if (n > 0 && udp != NULL)
+        net_udp_send(udp, buf, (size_t)n);
+    else if (n > 0)
+        link_send(gl, fd, buf, (size_t)n);
+
+    n = lockstep_pack_hash(ls, buf, sizeof(buf));
+    if (n > 0)
+        link_send(gl, fd, buf, (size_t)n);
 }
 
-void game_run_client(game_session_t *gs, net_connection_t *conn)
+/* In lockstep the host's snapshots give way to its inputs, and the
+ * client ticks the match itself */
+void game_run_client(game_session_t *gs, net_connection_t *conn, net_udp_t *udp)
 {
     const game_def_t *def = gs->def;
     uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
-    uint8_t recv_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    const uint8_t *recv_buf;
+
+    client_snap_t cs;
+    memset(&cs, 0, sizeof(cs));
+    cs.ack = -1;
+
+    client_udp_t cu;
+    memset(&cu, 0, sizeof(cu));
+    cu.udp = (udp != NULL && udp->fd != BYTES_INVALID_SOCKET) ? udp : NULL;
+
+    client_predict_t cp;
+    memset(&cp, 0, sizeof(cp));
+
+    game_keys_t keys;
+    memset(&keys, 0, sizeof(keys));
+
+    game_link_t gl;
+    memset(&gl, 0, sizeof(gl));
+    linkstats_init(&gl.stats, platform_mono_us());
+
+    lockstep_t ls;
+    lockstep_t *lsp = NULL;
+    if (gs->lockstep) {
+        if (lockstep_init(&ls, def, gs->local_player_id) < 0) {
+            ui_show_message("Out of memory.");
+            nodelay(stdscr, FALSE);
+            getch();
+            return;
+        }
+        lsp = &ls;
+    }
+    platform_ticker_t ticker;
+    platform_ticker_init(&ticker, TICK_INTERVAL_US, false);
 
     keypad(stdscr, TRUE);
     timeout(TICK_INTERVAL_US / 1000 / 2);
 
+    render_gov_t gov;
+    memset(&gov, 0, sizeof(gov));
+    bool full = true;
+    bool stale = false;   /* the screen is behind the state */
     while (gs->running) {
+        if (lsp != NULL)
+            timeout(platform_ticker_wait_ms(&ticker, platform_mono_us()));
         int ch = getch();
         if (ch == 'q') {
             int qn = proto_pack_quit(send_buf, sizeof(send_buf));
@@ -285,15 +1361,61 @@ void game_run_client(game_session_t *gs, net_connection_t *conn)
             gs->running = false;
             break;
         }
+        if (ch == GAME_HUD_KEY) {
+            gl.show = !gl.show;
+            full = true;
+            ch = ERR;
+        }
+
+        /* A key that went quiet and a new one can land in one pass */
+        int32_t inputs[2];
+        int ninputs = 0;
+        int64_t now = platform_mono_us();
+        inputs[ninputs] = game_keys_poll(&keys, now);
+        if (inputs[ninputs] != GAME_INPUT_NONE)
+            ninputs++;
         if (ch != ERR) {
-            int n = proto_pack_input(send_buf, sizeof(send_buf), ch);
+            inputs[ninputs] = game_keys_feed(&keys, def, ch, now);
+            if (inputs[ninputs] != GAME_INPUT_NONE)
+                ninputs++;
+        }
+
+        bool use_udp = cu.udp != NULL && cu.udp->active;
+        for (int i = 0; i < ninputs; i++) {
+            if (lsp != NULL) {
+                lockstep_local_input(lsp, inputs[i]);
+                continue;
+            }
+            uint32_t seq = client_predict_input(&cp, gs, inputs[i]);
+            if (use_udp) {
+                client_udp_send_inputs(&cu, seq, inputs[i]);
+                continue;
+            }
+            /* The datagram window only ever holds consecutive inputs */
+            cu.input_count = 0;
+            int n = (inputs[i] & GAME_INPUT_HELD)
+                  ? proto_pack_input_held(send_buf, sizeof(send_buf), seq,
+                                          (uint8_t)inputs[i])
+                  : proto_pack_input(send_buf, sizeof(send_buf), seq, inputs[i]);
             if (n > 0)
-                net_send(conn->fd, send_buf, (size_t)n, 100);
+                link_send(&gl, conn->fd, send_buf, (size_t)n);
         }
+        if (use_udp && ninputs == 0 && lsp == NULL)
+            client_udp_send_inputs(&cu, 0, GAME_INPUT_NONE);
+        client_ping(&gl, conn->fd, use_udp ? cu.udp : NULL, now);
 
         bool got_state = false;
+        if (cu.udp != NULL) {
+            client_udp_hello(&cu, platform_mono_us());
+            if (use_udp && lsp == NULL)
+                net_poll_readable(cu.udp->fd, 10);
+            got_state = client_udp_read(&cu, &cs, &gl, def, lsp);
+            use_udp = cu.udp->active;
+        }
+
         for (;;) {
-            int rr = net_recv(conn->fd, recv_buf, sizeof(recv_buf), got_state ? 0 : 10);
+            int rr = net_recv_frame(conn->fd, &conn->rx, &recv_buf,
+                                    (got_state || use_udp || lsp != NULL) ? 0 : 10);
             if (rr <= 0) {
                 if (rr < 0) {
                     gs->running = false;
@@ -306,13 +1428,41 @@ void game_run_client(game_session_t *gs, net_connection_t *conn)
 
             msg_header_t hdr;
             proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+            gl.tcp_in += (uint64_t)rr;
 
             switch (hdr.type) {
-            case MSG_STATE:
-                def->unpack_state(gs->state, recv_buf + MSG_HEADER_SIZE,
-                                  hdr.payload_len);
-                got_state = true;
+            case MSG_SNAPSHOT:
+                if (client_feed_snapshot(&cs, def, recv_buf + MSG_HEADER_SIZE,
+                                         hdr.payload_len))
+                    got_state = true;
+                break;
+            case MSG_PING: {
+                int pn = link_answer(recv_buf + MSG_HEADER_SIZE,
+                                     hdr.payload_len, send_buf,
+                                     sizeof(send_buf));
+                if (pn > 0)
+                    link_send(&gl, conn->fd, send_buf, (size_t)pn);
+                break;
+            }
+            case MSG_PONG:
+                link_pong(&gl, recv_buf + MSG_HEADER_SIZE, hdr.payload_len);
+                break;
+            case MSG_LOCKSTEP_INPUT: {
+                msg_lockstep_input_t in;
+                if (lsp != NULL &&
+                    proto_unpack_lockstep_input(recv_buf + MSG_HEADER_SIZE,
+                                                hdr.payload_len, &in) == 0)
+                    lockstep_receive(lsp, &in);
+                break;
+            }
+            case MSG_LOCKSTEP_HASH: {
+                msg_lockstep_hash_t h;
+                if (lsp != NULL &&
+                    proto_unpack_lockstep_hash(recv_buf + MSG_HEADER_SIZE,
+                                               hdr.payload_len, &h) == 0)
+                    lockstep_peer_hash(lsp, &h);
                 break;
+            }
             case MSG_GAME_OVER: {
                 msg_game_over_t go;
                 proto_unpack_game_over(recv_buf + MSG_HEADER_SIZE,
@@ -339,40 +1489,107 @@ void game_run_client(game_session_t *gs, net_connection_t *conn)
                 break;
         }
 
-        if (got_state && gs->running) {
-            clear();
-            def->render(gs->state, gs->p1_name, gs->p2_name,
-                        false, gs->spectator_count);
-            refresh();
+        client_send_ack(&cs, &gl, conn->fd, use_udp ? cu.udp : NULL);
+
+        if (got_state) {
+            gl.stats.ticks++;
+            int64_t rtt_us = gl.stats.have_rtt ? (int64_t)(gl.stats.srtt_ms * 1000.0f) : 0;
+            if (gs->running)
+                client_reconcile(&cp, &cs, gs, platform_mono_us() - rtt_us);
+        }
+
+        bool stepped = false;
+        if (lsp == NULL && gs->running) {
+            int steps = gs->paused ? 0 : platform_ticker_due(&ticker, platform_mono_us());
+            for (int s = 0; s < steps; s++) {
+                if (client_predict_tick(&cp, gs, platform_mono_us()))
+                    stepped = true;
+            }
+        }
+        if (lsp != NULL && gs->running) {
+            int steps = gs->paused ? 0 : platform_ticker_due(&ticker, platform_mono_us());
+            for (int s = 0; s < steps; s++) {
+                if (lockstep_step(lsp, gs->state)) {
+                    gl.stats.ticks++;
+                    stepped = true;
+                }
+            }
+            if (lockstep_settle(lsp, gs->state))
+                stepped = true;
+            if (steps > 0)
+                client_lockstep_send(lsp, &gl, conn->fd, use_udp ? cu.udp : NULL);
+        }
+
+        /* A predicted key shows at once; a lockstep one with its tick */
+        bool predicted = ninputs > 0 && lsp == NULL;
+        if (got_state || stepped || predicted)
+            stale = true;
+        now = platform_mono_us();
+        link_update(&gl, cu.udp, now);
+        if ((stale || full) && gs->running && gov_due(&gov, now)) {
+            bool lockstep_hud = lsp != NULL && (gl.show || lsp->desync_tick != 0);
+            game_render(gs, full, gl.show || lockstep_hud);
+            full = false;
+            stale = false;
+            if (gl.show)
+                ui_net_hud(&gl.stats, "host");
+            if (lockstep_hud)
+                ui_lockstep_hud(lsp, gl.show);
+            gov_refresh(&gov);
         }
 
         if (gs->paused) {
+            term_release();
             ui_pause_overlay(RECONNECT_TIMEOUT_SEC);
             platform_usleep(500000);
+            platform_ticker_restart(&ticker, platform_mono_us());
+            full = true;
         }
     }
 
+    if (lsp != NULL)
+        lockstep_free(lsp);
     nodelay(stdscr, FALSE);
 }
 
 void game_run_spectator(game_session_t *gs, net_connection_t *conn)
 {
     const game_def_t *def = gs->def;
-    uint8_t recv_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    const uint8_t *recv_buf;
+
+    uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+
+    client_snap_t cs;
+    memset(&cs, 0, sizeof(cs));
+    cs.ack = -1;
+
+    game_link_t gl;
+    memset(&gl, 0, sizeof(gl));
+    linkstats_init(&gl.stats, platform_mono_us());
 
     keypad(stdscr, TRUE);
     timeout(TICK_INTERVAL_US / 1000 / 2);
 
+    render_gov_t gov;
+    memset(&gov, 0, sizeof(gov));
+    bool full = true;
+    bool stale = false;
     while (gs->running) {
         int ch = getch();
         if (ch == 'q') {
             gs->running = false;
             break;
         }
+        if (ch == GAME_HUD_KEY) {
+            gl.show = !gl.show;
+            full = true;
+        }
+        client_ping(&gl, conn->fd, NULL, platform_mono_us());
 
         bool got_state = false;
         for (;;) {
-            int rr = net_recv(conn->fd, recv_buf, sizeof(recv_buf), got_state ? 0 : 30);
+            int rr = net_recv_frame(conn->fd, &conn->rx, &recv_buf,
+                                    got_state ? 0 : 30);
             if (rr <= 0) {
                 if (rr < 0) {
                     gs->running = false;
@@ -385,12 +1602,24 @@ void game_run_spectator(game_session_t *gs, net_connection_t *conn)
 
             msg_header_t hdr;
             proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+            gl.tcp_in += (uint64_t)rr;
 
             switch (hdr.type) {
-            case MSG_STATE:
-                def->unpack_state(gs->state, recv_buf + MSG_HEADER_SIZE,
-                                  hdr.payload_len);
-                got_state = true;
+            case MSG_SNAPSHOT:
+                if (client_feed_snapshot(&cs, def, recv_buf + MSG_HEADER_SIZE,
+                                         hdr.payload_len))
+                    got_state = true;
+                break;
+            case MSG_PING: {
+                int pn = link_answer(recv_buf + MSG_HEADER_SIZE,
+                                     hdr.payload_len, send_buf,
+                                     sizeof(send_buf));
+                if (pn > 0)
+                    link_send(&gl, conn->fd, send_buf, (size_t)pn);
+                break;
+            }
+            case MSG_PONG:
+                link_pong(&gl, recv_buf + MSG_HEADER_SIZE, hdr.payload_len);
                 break;
             case MSG_GAME_OVER: {
                 msg_game_over_t go;
@@ -417,16 +1646,32 @@ void game_run_spectator(game_session_t *gs, net_connection_t *conn)
                 break;
         }
 
-        if (got_state && gs->running) {
-            clear();
-            def->render(gs->state, gs->p1_name, gs->p2_name,
-                        true, gs->spectator_count);
-            refresh();
+        client_send_ack(&cs, &gl, conn->fd, NULL);
+
+        if (got_state) {
+            gl.stats.ticks++;
+            snapshot_restore(def, &cs.history, gs->state, NULL);
+            stale = true;
+        }
+        int64_t now = platform_mono_us();
+        link_update(&gl, NULL, now);
+        if ((stale || full) && gs->running && gov_due(&gov, now)) {
+            game_render(gs, full, gl.show);
+            full = false;
+            stale = false;
+            if (gl.show)
+                ui_net_hud(&gl.stats, "server");
+            gov_refresh(&gov);
         }
 
-        if (gs->paused)
+        if (gs->paused) {
+            term_release();
             ui_pause_overlay(RECONNECT_TIMEOUT_SEC);
+            full = true;
+        }
     }
 
     nodelay(stdscr, FALSE);
 }
+
+#endif
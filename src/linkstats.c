@@ -0,0 +1,87 @@
+#include "linkstats.h"
+
+#include <math.h>
+#include <string.h>
+
+void linkstats_init(linkstats_t *ls, int64_t now_us)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->next_seq = 1;
+    ls->next_ping_us = now_us;
+    ls->window_start_us = now_us;
+}
+
+uint32_t linkstats_ping_due(linkstats_t *ls, int64_t now_us)
+{
+    if (now_us < ls->next_ping_us)
+        return 0;
+    ls->next_ping_us = now_us + LINKSTATS_PING_INTERVAL_US;
+
+    /* With every slot waiting, the oldest ping is as good as lost */
+    int slot = 0;
+    for (int i = 0; i < LINKSTATS_PINGS; i++) {
+        if (ls->pending_us[i] == 0) {
+            slot = i;
+            break;
+        }
+        if (ls->pending_us[i] < ls->pending_us[slot])
+            slot = i;
+    }
+    if (ls->pending_us[slot] != 0)
+        ls->loss += (1.0f - ls->loss) / 8.0f;
+
+    uint32_t seq = ls->next_seq++;
+    if (ls->next_seq == 0)
+        ls->next_seq = 1;
+    ls->pending_seq[slot] = seq;
+    ls->pending_us[slot] = now_us;
+    return seq;
+}
+
+void linkstats_pong(linkstats_t *ls, uint32_t seq, uint64_t sent_us,
+                    int64_t now_us)
+{
+    int slot = -1;
+    for (int i = 0; i < LINKSTATS_PINGS; i++) {
+        if (ls->pending_us[i] != 0 && ls->pending_seq[i] == seq)
+            slot = i;
+    }
+    /* Late or duplicate answers were already counted */
+    if (slot < 0 || (int64_t)sent_us != ls->pending_us[slot])
+        return;
+    ls->pending_us[slot] = 0;
+    ls->loss -= ls->loss / 8.0f;
+
+    float rtt = (float)(now_us - (int64_t)sent_us) / 1000.0f;
+    if (!ls->have_rtt) {
+        ls->srtt_ms = rtt;
+        ls->have_rtt = true;
+    } else {
+        ls->srtt_ms += (rtt - ls->srtt_ms) / 8.0f;
+        ls->jitter_ms += (fabsf(rtt - ls->last_rtt_ms) - ls->jitter_ms) / 16.0f;
+    }
+    ls->last_rtt_ms = rtt;
+}
+
+void linkstats_update(linkstats_t *ls, int64_t now_us, uint64_t rx, uint64_t tx)
+{
+    for (int i = 0; i < LINKSTATS_PINGS; i++) {
+        if (ls->pending_us[i] != 0 &&
+            now_us - ls->pending_us[i] > LINKSTATS_PING_TIMEOUT_US) {
+            ls->pending_us[i] = 0;
+            ls->loss += (1.0f - ls->loss) / 8.0f;
+        }
+    }
+
+    int64_t span = now_us - ls->window_start_us;
+    if (span < 1000000)
+        return;
+    ls->rx_rate = (uint32_t)((rx - ls->window_rx) * 1000000 / (uint64_t)span);
+    ls->tx_rate = (uint32_t)((tx - ls->window_tx) * 1000000 / (uint64_t)span);
+    ls->tick_rate = (uint32_t)(((uint64_t)(ls->ticks - ls->window_ticks) * 1000000 +
+                                (uint64_t)span / 2) / (uint64_t)span);
+    ls->window_rx = rx;
+    ls->window_tx = tx;
+    ls->window_ticks = ls->ticks;
+    ls->window_start_us = now_us;
+}
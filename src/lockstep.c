@@ -0,0 +1,229 @@
+#include "lockstep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT(t) ((t) % LOCKSTEP_WINDOW)
+
+static uint8_t *state_before(const lockstep_t *ls, uint32_t tick)
+{
+    return ls->states + (size_t)SLOT(tick) * ls->def->state_size;
+}
+
+/* The game's own hash of its full state, or else FNV-1a over the packed
+ * state, which is the same on every platform */
+static uint32_t state_hash(const game_def_t *def, const void *state)
+{
+    if (def->hash_state != NULL)
+        return def->hash_state(state);
+
+    uint8_t buf[MAX_MSG_PAYLOAD];
+    int n = def->pack_state(state, buf, sizeof(buf));
+    uint32_t h = GAME_HASH_INIT;
+    for (int i = 0; i < n; i++) {
+        h ^= buf[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int lockstep_init(lockstep_t *ls, const game_def_t *def, int local_player_id)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->def = def;
+    ls->local = local_player_id;
+    ls->states = calloc(LOCKSTEP_WINDOW, def->state_size);
+    return (ls->states != NULL) ? 0 : -1;
+}
+
+void lockstep_free(lockstep_t *ls)
+{
+    free(ls->states);
+    ls->states = NULL;
+}
+
+void lockstep_local_input(lockstep_t *ls, int32_t input)
+{
+    if (input & GAME_INPUT_HELD)
+        ls->held = (uint8_t)input;
+    else if (ls->nkeys < LOCKSTEP_KEYS)
+        ls->keys[ls->nkeys++] = input;
+}
+
+static void simulate(lockstep_t *ls, void *state, uint32_t t)
+{
+    const game_def_t *def = ls->def;
+    int remote = 2 - ls->local;
+
+    /* Not heard yet: the peer is taken to hold what it last held */
+    if (t > ls->remote_tick) {
+        lockstep_input_t *guess = &ls->inputs[remote][SLOT(t)];
+        guess->held = (ls->remote_tick > 0)
+                    ? ls->inputs[remote][SLOT(ls->remote_tick)].held : 0;
+        guess->key = GAME_INPUT_NONE;
+    }
+
+    memcpy(state_before(ls, t), state, def->state_size);
+    for (int p = 0; p < 2; p++) {
+        const lockstep_input_t *in = &ls->inputs[p][SLOT(t)];
+        if (in->key != GAME_INPUT_NONE)
+            game_apply_input(def, state, p + 1, in->key);
+        game_apply_input(def, state, p + 1, GAME_INPUT_HELD | in->held);
+    }
+    if (!def->is_over(state))
+        def->update(state);
+}
+
+int lockstep_step(lockstep_t *ls, void *state)
+{
+    uint32_t t = ls->tick + 1;
+    if (t - ls->remote_tick >= LOCKSTEP_WINDOW ||
+        t - ls->peer_ack >= LOCKSTEP_WINDOW)
+        return 0;
+
+    /* Each side's advantage is the other's lag plus twice the difference
+     * in their clocks; the one ahead now and then gives up a tick */
+    int advantage = (int)(ls->tick - ls->remote_tick);
+    if (advantage - ls->peer_advantage >= 2 && ls->tick >= ls->next_sync) {
+        ls->next_sync = ls->tick + LOCKSTEP_SYNC_TICKS;
+        return 0;
+    }
+
+    lockstep_input_t *in = &ls->inputs[ls->local - 1][SLOT(t)];
+    in->held = ls->held;
+    in->key = GAME_INPUT_NONE;
+    if (ls->nkeys > 0) {
+        in->key = ls->keys[0];
+        ls->nkeys--;
+        memmove(ls->keys, ls->keys + 1, sizeof(ls->keys[0]) * (size_t)ls->nkeys);
+    }
+
+    simulate(ls, state, t);
+    ls->tick = t;
+    return 1;
+}
+
+void lockstep_receive(lockstep_t *ls, const msg_lockstep_input_t *in)
+{
+    int remote = 2 - ls->local;
+
+    for (int i = 0; i < in->count; i++) {
+        uint32_t t = in->tick + (uint32_t)i;
+        if ((int32_t)(t - ls->remote_tick) <= 0)
+            continue;
+        /* A gap, or further ahead than the peer may be */
+        if (t != ls->remote_tick + 1 || t >= ls->tick + LOCKSTEP_WINDOW)
+            break;
+
+        lockstep_input_t *slot = &ls->inputs[remote][SLOT(t)];
+        if (t <= ls->tick &&
+            (slot->held != in->held[i] || in->keys[i] != GAME_INPUT_NONE) &&
+            (ls->resim_from == 0 || t < ls->resim_from))
+            ls->resim_from = t;
+        slot->held = in->held[i];
+        slot->key = in->keys[i];
+        ls->remote_tick = t;
+    }
+
+    if ((int32_t)(in->ack - ls->peer_ack) > 0 && in->ack <= ls->tick)
+        ls->peer_ack = in->ack;
+    ls->peer_advantage = in->advantage;
+}
+
+static void compare_hash(lockstep_t *ls, int slot)
+{
+    const lockstep_hash_t *ours = &ls->hashes[slot];
+    const lockstep_hash_t *theirs = &ls->peer_hashes[slot];
+    if (ours->tick != 0 && ours->tick == theirs->tick &&
+        ours->hash != theirs->hash && ls->desync_tick == 0)
+        ls->desync_tick = ours->tick;
+}
+
+const void *lockstep_confirmed_state(const lockstep_t *ls, const void *state)
+{
+    if (ls->confirmed == ls->tick)
+        return state;
+    return state_before(ls, ls->confirmed + 1);
+}
+
+bool lockstep_settle(lockstep_t *ls, void *state)
+{
+    bool changed = false;
+
+    if (ls->resim_from != 0) {
+        uint32_t from = ls->resim_from;
+        ls->resim_from = 0;
+        memcpy(state, state_before(ls, from), ls->def->state_size);
+        for (uint32_t t = from; t <= ls->tick; t++)
+            simulate(ls, state, t);
+        ls->rollbacks++;
+        ls->resimulated += ls->tick - from + 1;
+        changed = true;
+    }
+
+    uint32_t confirmed = (ls->remote_tick < ls->tick) ? ls->remote_tick : ls->tick;
+    uint32_t h = (ls->confirmed / LOCKSTEP_HASH_TICKS + 1) * LOCKSTEP_HASH_TICKS;
+    for (; h <= confirmed; h += LOCKSTEP_HASH_TICKS) {
+        const void *at = (h == ls->tick) ? state : state_before(ls, h + 1);
+        int slot = (int)((h / LOCKSTEP_HASH_TICKS) % LOCKSTEP_HASHES);
+        ls->hashes[slot].tick = h;
+        ls->hashes[slot].hash = state_hash(ls->def, at);
+        compare_hash(ls, slot);
+    }
+    ls->confirmed = confirmed;
+    return changed;
+}
+
+int lockstep_pack_inputs(lockstep_t *ls, uint8_t *buf, size_t buflen,
+                         bool reliable)
+{
+    uint32_t from = (reliable ? ls->sent : ls->peer_ack) + 1;
+    uint32_t count = (ls->tick >= from) ? ls->tick - from + 1 : 0;
+    if (count > LOCKSTEP_WINDOW)
+        count = LOCKSTEP_WINDOW;
+    if (reliable && count == 0 && ls->acked == ls->remote_tick)
+        return 0;
+
+    msg_lockstep_input_t m;
+    m.tick = from;
+    m.ack = ls->remote_tick;
+    int advantage = (int)(ls->tick - ls->remote_tick);
+    m.advantage = (int8_t)(advantage > 127 ? 127 : advantage < -128 ? -128 : advantage);
+    m.count = (uint8_t)count;
+    for (uint32_t i = 0; i < count; i++) {
+        const lockstep_input_t *in = &ls->inputs[ls->local - 1][SLOT(from + i)];
+        m.held[i] = in->held;
+        m.keys[i] = in->key;
+    }
+
+    int n = proto_pack_lockstep_input(buf, buflen, &m);
+    if (n > 0) {
+        if (count > 0)
+            ls->sent = from + count - 1;
+        ls->acked = ls->remote_tick;
+    }
+    return n;
+}
+
+int lockstep_pack_hash(lockstep_t *ls, uint8_t *buf, size_t buflen)
+{
+    uint32_t h = ls->confirmed / LOCKSTEP_HASH_TICKS * LOCKSTEP_HASH_TICKS;
+    if (h == 0 || h == ls->hash_sent)
+        return 0;
+    const lockstep_hash_t *ours =
+        &ls->hashes[(h / LOCKSTEP_HASH_TICKS) % LOCKSTEP_HASHES];
+    int n = proto_pack_lockstep_hash(buf, buflen, ours->tick, ours->hash);
+    if (n > 0)
+        ls->hash_sent = h;
+    return n;
+}
+
+void lockstep_peer_hash(lockstep_t *ls, const msg_lockstep_hash_t *h)
+{
+    if (h->tick == 0 || h->tick % LOCKSTEP_HASH_TICKS != 0)
+        return;
+    int slot = (int)((h->tick / LOCKSTEP_HASH_TICKS) % LOCKSTEP_HASHES);
+    ls->peer_hashes[slot].tick = h->tick;
+    ls->peer_hashes[slot].hash = h->hash;
+    compare_hash(ls, slot);
+}
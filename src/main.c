@@ -3,8 +3,14 @@
 #include "network.h"
 #include "pong.h"
 #include "protocol.h"
+#include "relay.h"
+#include "replay.h"
+#include "server.h"
+#ifndef BYTES_HEADLESS
 #include "stats.h"
+#include "term.h"
 #include "ui.h"
+#endif
 #include "platform.h"
 
 #include <math.h>
@@ -46,6 +52,27 @@ static int parse_port(int argc, char **argv, int default_port)
     return default_port;
 }
 
+static int parse_int_opt(int argc, char **argv, const char *opt, int default_val)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], opt) == 0) {
+            int v = atoi(argv[i + 1]);
+            if (v > 0)
+                return v;
+        }
+    }
+    return default_val;
+}
+
+static const char *parse_str_opt(int argc, char **argv, const char *opt)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], opt) == 0)
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
 static bool parse_flag(int argc, char **argv, const char *flag)
 {
     for (int i = 1; i < argc; i++) {
@@ -55,6 +82,8 @@ static bool parse_flag(int argc, char **argv, const char *flag)
     return false;
 }
 
+#ifndef BYTES_HEADLESS
+
 /* ── Key Input Tester ────────────────────────────────────────────── */
 
 #define TEST_HIST_MAX 16
@@ -241,6 +270,7 @@ static void run_solo(stats_t *st)
     const game_def_t *def = game_get_def(GAME_PONG);
     game_session_t gs;
     game_session_init(&gs, def, "You", "CPU", true, false, 1);
+    game_session_seed(&gs, game_random_seed());
 
     keypad(stdscr, TRUE);
 #ifdef ESCDELAY
@@ -249,40 +279,50 @@ static void run_solo(stats_t *st)
 
     ui_countdown("You", "CPU");
 
-    int64_t last_tick = platform_mono_us();
     int ai_tick = 0;
+    game_keys_t keys;
+    memset(&keys, 0, sizeof(keys));
 
-    while (gs.running && !g_quit) {
-        int64_t now = platform_mono_us();
+    /* Waiting for a key doubles as sleeping until the next deadline */
+    platform_ticker_t ticker;
+    platform_ticker_init(&ticker, TICK_INTERVAL_US, false);
 
-        timeout(TICK_INTERVAL_US / 1000 / 2);
+    bool full = true;   /* the first frame draws the whole field */
+    while (gs.running && !g_quit) {
+        timeout(platform_ticker_wait_ms(&ticker, platform_mono_us()));
         int ch = getch();
+        int64_t now = platform_mono_us();
         if (ch == 'q') {
             gs.running = false;
             break;
         }
-        if (ch != ERR)
-            def->handle_input(gs.state, 1, ch);
-
-        if (now - last_tick >= TICK_INTERVAL_US) {
-            last_tick = now;
-
+        int32_t in = game_keys_poll(&keys, now);
+        if (in != GAME_INPUT_NONE)
+            game_apply_input(def, gs.state, 1, in);
+        in = (ch != ERR) ? game_keys_feed(&keys, def, ch, now) : GAME_INPUT_NONE;
+        if (in != GAME_INPUT_NONE)
+            game_apply_input(def, gs.state, 1, in);
+
+        int steps = platform_ticker_due(&ticker, now);
+        if (steps > 0) {
             pong_state_t *ps = (pong_state_t *)gs.state;
-            if (ai_tick % 3 == 0) {
-                float ball_y = ps->ball.y;
-                float pad_mid = (float)ps->p2.y + (float)ps->p2.len / 2.0f;
-                if (ball_y < pad_mid - 1.0f)
-                    def->handle_input(gs.state, 2, KEY_UP);
-                else if (ball_y > pad_mid + 1.0f)
-                    def->handle_input(gs.state, 2, KEY_DOWN);
+            for (int s = 0; s < steps && !def->is_over(gs.state); s++) {
+                if (ai_tick % 3 == 0) {
+                    pong_fx_t ball_y = ps->ball.y;
+                    pong_fx_t pad_mid = PONG_FX(ps->p2.y) + PONG_FX(ps->p2.len) / 2;
+                    if (ball_y < pad_mid - PONG_FX_ONE)
+                        def->handle_input(gs.state, 2, KEY_UP);
+                    else if (ball_y > pad_mid + PONG_FX_ONE)
+                        def->handle_input(gs.state, 2, KEY_DOWN);
+                }
+                ai_tick++;
+
+                def->update(gs.state);
             }
-            ai_tick++;
-
-            def->update(gs.state);
 
-            clear();
-            def->render(gs.state, gs.p1_name, gs.p2_name, false, 0);
-            refresh();
+            game_render(&gs, full, false);
+            full = false;
+            term_present();
 
             if (def->is_over(gs.state)) {
                 gs.running = false;
@@ -297,17 +337,14 @@ static void run_solo(stats_t *st)
             }
         }
 
-        int64_t elapsed = platform_mono_us() - now;
-        int64_t remaining_us = TICK_INTERVAL_US - elapsed;
-        if (remaining_us > 1000)
-            platform_usleep((unsigned)(remaining_us / 2));
     }
 
     nodelay(stdscr, FALSE);
     game_session_cleanup(&gs);
 }
 
-static void run_host(int port, stats_t *st)
+static void run_host(int port, net_overflow_policy_t overflow, bool use_udp,
+                     bool lockstep, stats_t *st)
 {
     char my_name[MAX_NAME_LEN];
     ui_get_name(my_name, sizeof(my_name));
@@ -319,6 +356,7 @@ static void run_host(int port, stats_t *st)
         getch();
         return;
     }
+    srv.overflow = overflow;
 
     char ip[64];
     net_get_local_ip(ip, sizeof(ip));
@@ -370,27 +408,55 @@ static void run_host(int port, stats_t *st)
     peer_name[MAX_NAME_LEN - 1] = '\0';
 
     srv.clients[player_idx].is_player = true;
+    srv.clients[player_idx].greeted = true;
     srv.clients[player_idx].player_id = 2;
     strncpy(srv.clients[player_idx].name, peer_name, MAX_NAME_LEN - 1);
 
+    /* The welcome, the datagram offer and the start leave together */
+    net_server_begin_batch(&srv);
     uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
     int wn = proto_pack_welcome(send_buf, sizeof(send_buf), my_name, peer_name, 2);
     if (wn > 0)
-        net_send(srv.clients[player_idx].fd, send_buf, (size_t)wn, 1000);
+        net_server_send(&srv, player_idx, send_buf, (size_t)wn);
+
+    /* Offer a datagram port for snapshots and input. The player answers
+     * on it once the game runs; until then, or if it never gets through,
+     * everything keeps flowing over TCP. */
+    net_udp_t udp;
+    udp.fd = BYTES_INVALID_SOCKET;
+    if (use_udp) {
+        int uport = net_udp_open(&udp, port);
+        if (uport < 0)
+            uport = net_udp_open(&udp, 0);
+        if (uport > 0) {
+            udp.token = (uint32_t)platform_mono_us() ^
+                        ((uint32_t)time(NULL) * 2654435761u);
+            int on = proto_pack_udp_offer(send_buf, sizeof(send_buf),
+                                          (uint16_t)uport, udp.token);
+            if (on > 0)
+                net_server_send(&srv, player_idx, send_buf, (size_t)on);
+        }
+    }
 
     ui_player_joined(my_name, peer_name);
 
-    int gn = proto_pack_game_start(send_buf, sizeof(send_buf),
-                                   GAME_PONG, my_name, peer_name);
+    /* The start carries our field size and seed; in lockstep the player
+     * simulates from exactly those */
+    const game_def_t *def = game_get_def(GAME_PONG);
+    game_session_t gs;
+    game_session_init(&gs, def, my_name, peer_name, true, false, 1);
+    game_session_seed(&gs, game_random_seed());
+    gs.lockstep = lockstep;
+
+    int gn = game_pack_start(&gs, send_buf, sizeof(send_buf));
     if (gn > 0)
         net_send_to_all(&srv, send_buf, (size_t)gn);
+    net_server_end_batch(&srv);
 
     ui_countdown(my_name, peer_name);
 
-    const game_def_t *def = game_get_def(GAME_PONG);
-    game_session_t gs;
-    game_session_init(&gs, def, my_name, peer_name, true, false, 1);
-    game_run_server(&gs, &srv, player_idx);
+    game_run_server(&gs, &srv, player_idx,
+                    udp.fd != BYTES_INVALID_SOCKET ? &udp : NULL);
 
     if (def->is_over(gs.state)) {
         int winner = def->get_winner(gs.state);
@@ -398,17 +464,21 @@ static void run_host(int port, stats_t *st)
     }
 
     game_session_cleanup(&gs);
+    net_udp_close(&udp);
+    net_server_drain(&srv, 500);
     net_server_shutdown(&srv);
 }
 
-static void run_join(int default_port, stats_t *st)
+static void run_join(int default_port, bool use_udp, stats_t *st)
 {
     char my_name[MAX_NAME_LEN];
     ui_get_name(my_name, sizeof(my_name));
 
     char host[64];
+    char room[MAX_NAME_LEN];
     int port = default_port;
-    ui_get_host_and_port(host, sizeof(host), &port, default_port);
+    ui_get_host_and_port(host, sizeof(host), &port, default_port,
+                         room, sizeof(room));
 
     ui_show_message("Connecting...");
 
@@ -421,7 +491,7 @@ static void run_join(int default_port, stats_t *st)
     }
 
     uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
-    int hn = proto_pack_hello(send_buf, sizeof(send_buf), my_name, ROLE_PLAYER);
+    int hn = proto_pack_hello(send_buf, sizeof(send_buf), my_name, ROLE_PLAYER, room);
     if (hn > 0)
         net_send(conn.fd, send_buf, (size_t)hn, 1000);
 
@@ -453,10 +523,48 @@ static void run_join(int default_port, stats_t *st)
     host_name[MAX_NAME_LEN - 1] = '\0';
     uint8_t my_id = welcome.assigned_id;
 
-    ui_player_joined(host_name, my_name);
+    /* On a dedicated server the first player in a room waits for an
+     * opponent; 'q' gives up. */
+    if (my_id == 1) {
+        char waitbuf[96];
+        snprintf(waitbuf, sizeof(waitbuf), "Waiting for an opponent in room '%s'...",
+                 room[0] != '\0' ? room : SERVER_DEFAULT_ROOM);
+        ui_show_message(waitbuf);
+    } else {
+        ui_player_joined(host_name, my_name);
+    }
 
-    rr = net_recv(conn.fd, recv_buf, sizeof(recv_buf), 10000);
+    net_udp_t udp;
+    udp.fd = BYTES_INVALID_SOCKET;
+
+    nodelay(stdscr, TRUE);
+    rr = 0;
+    int64_t start_deadline = platform_mono_us() + 10000000;
+    while (rr == 0 && !g_quit) {
+        if (getch() == 'q')
+            break;
+        if (my_id != 1 && platform_mono_us() > start_deadline)
+            break;
+        rr = net_recv(conn.fd, recv_buf, sizeof(recv_buf), 200);
+
+        /* The host may offer a datagram channel before the game starts */
+        msg_udp_offer_t offer;
+        if (rr > 0 && recv_buf[0] == MSG_UDP_OFFER) {
+            proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+            if (use_udp && udp.fd == BYTES_INVALID_SOCKET &&
+                proto_unpack_udp_offer(recv_buf + MSG_HEADER_SIZE,
+                                       hdr.payload_len, &offer) == 0 &&
+                net_udp_open(&udp, 0) > 0) {
+                udp.token = offer.token;
+                if (net_udp_peer_from_tcp(&udp, conn.fd, offer.port) < 0)
+                    net_udp_close(&udp);
+            }
+            rr = 0;
+        }
+    }
+    nodelay(stdscr, FALSE);
     if (rr <= 0) {
+        net_udp_close(&udp);
         net_client_disconnect(&conn);
         ui_show_message("Timed out waiting for game start.");
         nodelay(stdscr, FALSE);
@@ -466,6 +574,7 @@ static void run_join(int default_port, stats_t *st)
 
     proto_unpack_header(recv_buf, (size_t)rr, &hdr);
     if (hdr.type != MSG_GAME_START) {
+        net_udp_close(&udp);
         net_client_disconnect(&conn);
         ui_show_message("Unexpected message.");
         nodelay(stdscr, FALSE);
@@ -480,6 +589,7 @@ static void run_join(int default_port, stats_t *st)
 
     const game_def_t *def = game_get_def((game_type_t)gs_msg.game_type);
     if (def == NULL) {
+        net_udp_close(&udp);
         net_client_disconnect(&conn);
         ui_show_message("Unknown game type.");
         nodelay(stdscr, FALSE);
@@ -488,8 +598,8 @@ static void run_join(int default_port, stats_t *st)
     }
 
     game_session_t gs;
-    game_session_init(&gs, def, gs_msg.p1_name, gs_msg.p2_name, false, false, my_id);
-    game_run_client(&gs, &conn);
+    game_session_init_start(&gs, &gs_msg, false, my_id);
+    game_run_client(&gs, &conn, udp.fd != BYTES_INVALID_SOCKET ? &udp : NULL);
 
     if (def->is_over(gs.state)) {
         int winner = def->get_winner(gs.state);
@@ -497,6 +607,7 @@ static void run_join(int default_port, stats_t *st)
     }
 
     game_session_cleanup(&gs);
+    net_udp_close(&udp);
     net_client_disconnect(&conn);
 }
 
@@ -506,8 +617,10 @@ static void run_watch(int default_port)
     ui_get_name(my_name, sizeof(my_name));
 
     char host[64];
+    char room[MAX_NAME_LEN];
     int port = default_port;
-    ui_get_host_and_port(host, sizeof(host), &port, default_port);
+    ui_get_host_and_port(host, sizeof(host), &port, default_port,
+                         room, sizeof(room));
 
     ui_show_message("Connecting as spectator...");
 
@@ -520,7 +633,7 @@ static void run_watch(int default_port)
     }
 
     uint8_t send_buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
-    int hn = proto_pack_hello(send_buf, sizeof(send_buf), my_name, ROLE_SPECTATOR);
+    int hn = proto_pack_hello(send_buf, sizeof(send_buf), my_name, ROLE_SPECTATOR, room);
     if (hn > 0)
         net_send(conn.fd, send_buf, (size_t)hn, 1000);
 
@@ -578,13 +691,123 @@ static void run_watch(int default_port)
     }
 
     game_session_t gs;
-    game_session_init(&gs, def, gs_msg.p1_name, gs_msg.p2_name, false, true, 0);
+    game_session_init_start(&gs, &gs_msg, true, 0);
     game_run_spectator(&gs, &conn);
 
     game_session_cleanup(&gs);
     net_client_disconnect(&conn);
 }
 
+/* ── Replay ─────────────────────────────────────────────────────── */
+
+#define REPLAY_MAX_SPEED 32
+#define REPLAY_JUMP_TICKS (TICK_RATE_HZ * 10)
+
+static void run_replay(const char *path)
+{
+    replay_reader_t rp;
+    if (replay_open(&rp, path) < 0) {
+        ui_show_message("Not a readable replay file.");
+        nodelay(stdscr, FALSE);
+        getch();
+        return;
+    }
+
+    const game_def_t *def = rp.def;
+    game_session_t gs;
+    game_session_init_sized(&gs, def, rp.start.p1_name, rp.start.p2_name,
+                            false, true, 0, rp.rows, rp.cols);
+    keypad(stdscr, TRUE);
+
+    platform_ticker_t ticker;
+    platform_ticker_init(&ticker, TICK_INTERVAL_US, false);
+    int speed = 1;
+    bool paused = false;
+    bool redraw = true;
+    bool full = true;
+    bool ok = true;
+
+    while (!g_quit && ok) {
+        /* Paused, nothing moves until a key */
+        timeout(paused ? -1 : platform_ticker_wait_ms(&ticker, platform_mono_us()));
+        int ch = getch();
+        if (ch == 'q' || ch == 27)
+            break;
+
+        /* Anything but a plain step forward goes back to the nearest
+         * keyframe and decodes up to the target */
+        uint32_t target = rp.tick;
+        switch (ch) {
+        case ' ':
+            paused = !paused;
+            platform_ticker_restart(&ticker, platform_mono_us());
+            break;
+        case KEY_RIGHT:
+            paused = true;
+            ok = replay_next(&rp) >= 0;
+            break;
+        case KEY_LEFT:
+            paused = true;
+            target = rp.tick > rp.first_tick ? rp.tick - 1 : rp.first_tick;
+            break;
+        case KEY_UP:
+            speed = speed < REPLAY_MAX_SPEED ? speed * 2 : speed;
+            break;
+        case KEY_DOWN:
+            speed = speed > 1 ? speed / 2 : 1;
+            break;
+        case ']': case KEY_NPAGE:
+            target = rp.tick + REPLAY_JUMP_TICKS;
+            break;
+        case '[': case KEY_PPAGE:
+            target = rp.tick - rp.first_tick > REPLAY_JUMP_TICKS
+                   ? rp.tick - REPLAY_JUMP_TICKS : rp.first_tick;
+            break;
+        case KEY_HOME:
+            target = rp.first_tick;
+            break;
+        default:
+            break;
+        }
+        if (ch != ERR)
+            redraw = true;
+        if (ok && target != rp.tick)
+            ok = replay_seek(&rp, target) == 0;
+
+        int steps = paused ? 0 : platform_ticker_due(&ticker, platform_mono_us());
+        for (int i = 0; ok && i < steps * speed; i++) {
+            int rc = replay_next(&rp);
+            ok = rc >= 0;
+            redraw = true;
+            if (rc == 0) {
+                paused = true;
+                break;
+            }
+        }
+
+        if (redraw && ok) {
+            replay_restore(&rp, gs.state);
+            game_render(&gs, full, true);
+            full = false;
+            ui_replay_bar(rp.rows, rp.tick - rp.first_tick,
+                          rp.last_tick - rp.first_tick, speed, paused);
+            term_present();
+            redraw = false;
+        }
+    }
+
+    if (!ok) {
+        ui_show_message("The replay file is damaged.");
+        nodelay(stdscr, FALSE);
+        getch();
+    }
+    nodelay(stdscr, FALSE);
+    game_session_cleanup(&gs);
+    replay_close(&rp);
+}
+
+#endif
+
 int main(int argc, char **argv)
 {
 #ifdef BYTES_WINDOWS
@@ -597,17 +820,85 @@ int main(int argc, char **argv)
     platform_net_init();
 
     int port = parse_port(argc, argv, DEFAULT_PORT);
+    const char *relay_opt = parse_str_opt(argc, argv, "--relay");
+    bool flag_server = parse_flag(argc, argv, "--server") ||
+                       parse_flag(argc, argv, "--headless");
+#ifdef BYTES_HEADLESS
+    /* With no terminal UI built in, serving is the default */
+    flag_server = flag_server || relay_opt == NULL;
+#endif
+
+    /* What to do with a client whose send queue is full */
+    net_overflow_policy_t overflow = NET_OVERFLOW_DROP_STATE;
+    const char *overflow_opt = parse_str_opt(argc, argv, "--overflow");
+    if (overflow_opt != NULL && strcmp(overflow_opt, "disconnect") == 0)
+        overflow = NET_OVERFLOW_DISCONNECT;
+
+    if (flag_server) {
+        server_config_t cfg;
+        cfg.port = port;
+        cfg.threads = parse_int_opt(argc, argv, "--threads", 0);
+        cfg.rows = parse_int_opt(argc, argv, "--rows", SERVER_FIELD_ROWS);
+        cfg.cols = parse_int_opt(argc, argv, "--cols", SERVER_FIELD_COLS);
+        cfg.overflow = overflow;
+        cfg.io_uring = parse_flag(argc, argv, "--io-uring");
+        cfg.record_dir = parse_str_opt(argc, argv, "--record");
+
+        if (cfg.rows < PONG_MIN_ROWS || cfg.rows > PONG_MAX_ROWS ||
+            cfg.cols < PONG_MIN_COLS || cfg.cols > PONG_MAX_COLS) {
+            fprintf(stderr, "The field must be %d-%d rows and %d-%d columns.\n",
+                    PONG_MIN_ROWS, PONG_MAX_ROWS, PONG_MIN_COLS, PONG_MAX_COLS);
+            platform_net_cleanup();
+            return 1;
+        }
+
+        int rc = server_run(&cfg, &g_quit);
+        platform_net_cleanup();
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (relay_opt != NULL) {
+        relay_config_t rcfg;
+        memset(&rcfg, 0, sizeof(rcfg));
+        net_parse_address(relay_opt, rcfg.host, sizeof(rcfg.host),
+                          &rcfg.upstream_port, DEFAULT_PORT,
+                          rcfg.room, sizeof(rcfg.room));
+        rcfg.port = port;
+        rcfg.overflow = overflow;
+        rcfg.io_uring = parse_flag(argc, argv, "--io-uring");
+
+        int rc = relay_run(&rcfg, &g_quit);
+        platform_net_cleanup();
+        return rc == 0 ? 0 : 1;
+    }
+
+#ifndef BYTES_HEADLESS
     bool flag_test_keys = parse_flag(argc, argv, "--test-keys");
     bool flag_solo = parse_flag(argc, argv, "--solo");
+    bool use_udp = !parse_flag(argc, argv, "--tcp-only");
+    bool lockstep = parse_flag(argc, argv, "--lockstep");
+    bool flag_ansi = parse_flag(argc, argv, "--ansi");
 
     stats_t stats;
     stats_init(&stats);
     stats_load(&stats);
 
     ui_init();
+    if (flag_ansi)
+        term_use_ansi();
 
     if (flag_test_keys) {
         run_test_keys();
+        stats_close(&stats);
+        ui_cleanup();
+        platform_net_cleanup();
+        return 0;
+    }
+
+    const char *replay_opt = parse_str_opt(argc, argv, "--replay");
+    if (replay_opt != NULL) {
+        run_replay(replay_opt);
+        stats_close(&stats);
         ui_cleanup();
         platform_net_cleanup();
         return 0;
@@ -615,6 +906,7 @@ int main(int argc, char **argv)
 
     if (flag_solo) {
         run_solo(&stats);
+        stats_close(&stats);
         ui_cleanup();
         platform_net_cleanup();
         return 0;
@@ -625,10 +917,10 @@ int main(int argc, char **argv)
 
         switch (choice) {
         case MENU_HOST:
-            run_host(port, &stats);
+            run_host(port, overflow, use_udp, lockstep, &stats);
             break;
         case MENU_JOIN:
-            run_join(port, &stats);
+            run_join(port, use_udp, &stats);
             break;
         case MENU_SOLO:
             run_solo(&stats);
@@ -647,7 +939,9 @@ int main(int argc, char **argv)
         }
     }
 
+    stats_close(&stats);
     ui_cleanup();
+#endif
     platform_net_cleanup();
     return 0;
 }
@@ -1,8 +1,65 @@
 #include "network.h"
+#include "protocol.h"
+#include "uring.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(BYTES_LINUX) && defined(__linux__)
+    #define BYTES_HAVE_EPOLL 1
+    #include <sys/epoll.h>
+#endif
+
+#ifndef BYTES_WINDOWS
+#include <sys/uio.h>
+#endif
+
+#ifdef BYTES_HAVE_URING
+
+#define NET_URING_ACCEPTS 64
+
+enum { UOP_NONE, UOP_RECV, UOP_POLL, UOP_ACCEPT, UOP_SEND };
+
+/* What the ring is doing for one tag. Completions carry the slot, the
+ * operation and a generation, so late ones for a closed fd are ignored. */
+typedef struct {
+    bytes_socket_t fd;
+    uint32_t       gen;
+    int            op;          /* armed read-side operation */
+    net_rxbuf_t   *rx;
+    bool           sending;
+    bool           sent;        /* completion waiting for net_server_flush */
+    int            send_res;
+    struct msghdr  msg;
+    struct iovec   iov[NET_SENDQ_FRAMES];
+} net_uslot_t;
+
+struct net_loop_uring {
+    uring_t        *ring;
+    net_uslot_t    *slots;      /* indexed by tag - NET_TAG_MIN */
+    int             nslots;
+    bytes_socket_t  accepted[NET_URING_ACCEPTS];
+    int             accepted_head;
+    int             accepted_count;
+};
+
+static uint64_t uslot_data(const net_uslot_t *s, int slot, int op)
+{
+    return ((uint64_t)(s->gen & 0xffffff) << 40) | ((uint64_t)op << 32) |
+           (uint32_t)slot;
+}
+
+static net_uslot_t *uslot_get(const net_loop_t *loop, int tag, int *slot)
+{
+    int i = tag - NET_TAG_MIN;
+    if (loop->uring == NULL || i < 0 || i >= loop->uring->nslots)
+        return NULL;
+    *slot = i;
+    return &loop->uring->slots[i];
+}
+#endif
+
 static int set_tcp_nodelay(bytes_socket_t fd)
 {
     int flag = 1;
@@ -38,6 +95,14 @@ static int set_keepalive(bytes_socket_t fd)
     return 0;
 }
 
+static void accepted_setup(bytes_socket_t fd)
+{
+    set_tcp_nodelay(fd);
+    platform_set_nonblocking(fd);
+    platform_set_nosigpipe(fd);
+    set_keepalive(fd);
+}
+
 static int net_poll_writable(bytes_socket_t fd, int timeout_ms)
 {
 #ifdef BYTES_WINDOWS
@@ -68,15 +133,11 @@ static int net_poll_writable(bytes_socket_t fd, int timeout_ms)
 #endif
 }
 
-int net_server_init(net_server_t *srv, int port)
+bytes_socket_t net_listen(int port, int backlog)
 {
-    memset(srv, 0, sizeof(*srv));
-    srv->port = port;
-    srv->listen_fd = BYTES_INVALID_SOCKET;
-
     bytes_socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd == BYTES_INVALID_SOCKET)
-        return -1;
+        return BYTES_INVALID_SOCKET;
 
     int opt = 1;
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
@@ -89,57 +150,124 @@ int net_server_init(net_server_t *srv, int port)
 
     if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         platform_close_socket(fd);
-        return -1;
+        return BYTES_INVALID_SOCKET;
     }
 
-    if (listen(fd, MAX_CLIENTS) < 0) {
+    if (listen(fd, backlog) < 0) {
         platform_close_socket(fd);
-        return -1;
+        return BYTES_INVALID_SOCKET;
     }
 
     platform_set_nonblocking(fd);
-    srv->listen_fd = fd;
-    srv->running = true;
+    return fd;
+}
+
+bytes_socket_t net_accept(bytes_socket_t listen_fd)
+{
+    struct sockaddr_in peer;
+    socklen_t peerlen = sizeof(peer);
+    bytes_socket_t cfd = accept(listen_fd, (struct sockaddr *)&peer, &peerlen);
+    if (cfd == BYTES_INVALID_SOCKET)
+        return BYTES_INVALID_SOCKET;
+
+    accepted_setup(cfd);
+    return cfd;
+}
+
+void net_server_reset(net_server_t *srv)
+{
+    memset(srv, 0, sizeof(*srv));
+    srv->listen_fd = BYTES_INVALID_SOCKET;
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         srv->clients[i].fd = BYTES_INVALID_SOCKET;
         srv->clients[i].connected = false;
     }
+}
 
+int net_server_init(net_server_t *srv, int port)
+{
+    net_server_reset(srv);
+    srv->port = port;
+
+    srv->listen_fd = net_listen(port, MAX_CLIENTS);
+    if (srv->listen_fd == BYTES_INVALID_SOCKET)
+        return -1;
+    if (net_frame_pool_init(&srv->own_pool, NET_FRAME_POOL_SIZE(MAX_CLIENTS)) < 0) {
+        platform_close_socket(srv->listen_fd);
+        srv->listen_fd = BYTES_INVALID_SOCKET;
+        return -1;
+    }
+    srv->pool = &srv->own_pool;
+
+    srv->running = true;
     return 0;
 }
 
+int net_server_adopt(net_server_t *srv, bytes_socket_t fd)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (srv->clients[i].connected)
+            continue;
+
+        srv->clients[i].fd = fd;
+        srv->clients[i].connected = true;
+        srv->clients[i].is_player = false;
+        srv->clients[i].greeted = false;
+        srv->clients[i].player_id = 0;
+        srv->clients[i].name[0] = '\0';
+        srv->clients[i].acked_tick = 0;
+        srv->clients[i].batched = false;
+        srv->clients[i].sendq.head = 0;
+        srv->clients[i].sendq.count = 0;
+        srv->clients[i].sendq.head_sent = 0;
+        srv->clients[i].sendq.in_flight = 0;
+        srv->clients[i].rx.start = 0;
+        srv->clients[i].rx.end = 0;
+        srv->clients[i].rx.by_loop = false;
+        srv->clients[i].rx.eof = false;
+        if (srv->loop != NULL &&
+            net_loop_add_stream(srv->loop, fd, srv->tag_base + i,
+                                &srv->clients[i].rx) < 0) {
+            srv->clients[i].connected = false;
+            return -1;
+        }
+        srv->client_count++;
+        return i;
+    }
+    return -1;
+}
+
 int net_server_accept(net_server_t *srv, int timeout_ms)
 {
-    if (net_poll_readable(srv->listen_fd, timeout_ms) <= 0)
+    /* The listen socket is non-blocking, so with no timeout accept()
+     * itself reports whether a connection is pending. */
+    if (timeout_ms > 0 && net_poll_readable(srv->listen_fd, timeout_ms) <= 0)
         return -1;
 
-    struct sockaddr_in peer;
-    socklen_t peerlen = sizeof(peer);
-    bytes_socket_t cfd = accept(srv->listen_fd,
-                                (struct sockaddr *)&peer, &peerlen);
-    if (cfd == BYTES_INVALID_SOCKET)
-        return -1;
+    for (;;) {
+        bytes_socket_t cfd = net_accept(srv->listen_fd);
+        if (cfd == BYTES_INVALID_SOCKET)
+            return -1;
 
-    set_tcp_nodelay(cfd);
-    platform_set_nonblocking(cfd);
-    platform_set_nosigpipe(cfd);
-    set_keepalive(cfd);
+        int idx = net_server_adopt(srv, cfd);
+        if (idx >= 0)
+            return idx;
 
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (!srv->clients[i].connected) {
-            srv->clients[i].fd = cfd;
-            srv->clients[i].connected = true;
-            srv->clients[i].is_player = false;
-            srv->clients[i].player_id = 0;
-            srv->clients[i].name[0] = '\0';
-            srv->client_count++;
-            return i;
-        }
+        /* Table full: reject this one and keep draining the backlog, an
+         * edge-triggered listener will not report the rest again. */
+        platform_close_socket(cfd);
     }
+}
 
-    platform_close_socket(cfd);
-    return -1;
+static void sendq_clear(net_sendq_t *q)
+{
+    for (int i = 0; i < q->count; i++)
+        net_frame_release(q->frames[(q->head + i) % NET_SENDQ_FRAMES]);
+    q->head = 0;
+    q->count = 0;
+    q->head_sent = 0;
+    q->in_flight = 0;
 }
 
 void net_server_close_client(net_server_t *srv, int idx)
@@ -149,7 +277,10 @@ void net_server_close_client(net_server_t *srv, int idx)
     if (!srv->clients[idx].connected)
         return;
 
+    if (srv->loop != NULL)
+        net_loop_remove(srv->loop, srv->clients[idx].fd);
     platform_close_socket(srv->clients[idx].fd);
+    sendq_clear(&srv->clients[idx].sendq);
     srv->clients[idx].fd = BYTES_INVALID_SOCKET;
     srv->clients[idx].connected = false;
     srv->client_count--;
@@ -157,19 +288,30 @@ void net_server_close_client(net_server_t *srv, int idx)
 
 void net_server_shutdown(net_server_t *srv)
 {
+    /* Whatever a batch still holds gets one try, like any other send */
+    net_server_end_batch(srv);
     srv->running = false;
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (srv->clients[i].connected) {
+            if (srv->loop != NULL)
+                net_loop_remove(srv->loop, srv->clients[i].fd);
             platform_close_socket(srv->clients[i].fd);
+            sendq_clear(&srv->clients[i].sendq);
             srv->clients[i].fd = BYTES_INVALID_SOCKET;
             srv->clients[i].connected = false;
         }
     }
     if (srv->listen_fd != BYTES_INVALID_SOCKET) {
+        if (srv->loop != NULL)
+            net_loop_remove(srv->loop, srv->listen_fd);
         platform_close_socket(srv->listen_fd);
         srv->listen_fd = BYTES_INVALID_SOCKET;
     }
     srv->client_count = 0;
+    srv->loop = NULL;
+    if (srv->pool == &srv->own_pool)
+        srv->pool = NULL;
+    net_frame_pool_close(&srv->own_pool);
 }
 
 int net_client_connect(net_connection_t *conn, const char *host, int port)
@@ -331,31 +473,390 @@ int net_recv(bytes_socket_t fd, uint8_t *buf, size_t buflen, int timeout_ms)
     return (int)total;
 }
 
+int net_recv_frame(bytes_socket_t fd, net_rxbuf_t *rx, const uint8_t **frame,
+                   int timeout_ms)
+{
+    for (;;) {
+        size_t avail = rx->end - rx->start;
+        if (avail >= MSG_HEADER_SIZE) {
+            const uint8_t *p = rx->data + rx->start;
+            size_t flen = MSG_HEADER_SIZE + (size_t)(p[1] | (p[2] << 8));
+            if (flen > MSG_HEADER_SIZE + MAX_MSG_PAYLOAD)
+                return -1;
+            if (avail >= flen) {
+                *frame = p;
+                rx->start += flen;
+                return (int)flen;
+            }
+        }
+        if (rx->by_loop)
+            return rx->eof ? -1 : 0;
+
+        /* Slide the partial frame to the front to make room behind it */
+        if (rx->start > 0) {
+            memmove(rx->data, rx->data + rx->start, avail);
+            rx->start = 0;
+            rx->end = avail;
+        }
+
+        if (timeout_ms > 0) {
+            int ready = net_poll_readable(fd, timeout_ms);
+            if (ready <= 0)
+                return ready;
+            timeout_ms = 0;
+        }
+
+        int n = recv(fd, (char *)(rx->data + rx->end),
+                     (int)(sizeof(rx->data) - rx->end), 0);
+        if (n < 0) {
+            int err = bytes_socket_error();
+            if (err == BYTES_EINTR)
+                continue;
+            if (err == BYTES_EAGAIN || err == BYTES_EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        if (n == 0)
+            return -1;
+        rx->end += (size_t)n;
+    }
+}
+
+/* ── Shared frames ──────────────────────────────────────────────── */
+
+int net_frame_pool_init(net_frame_pool_t *pool, int capacity)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->frames = calloc((size_t)capacity, sizeof(*pool->frames));
+    if (pool->frames == NULL)
+        return -1;
+    pool->capacity = capacity;
+
+    for (int i = capacity - 1; i >= 0; i--) {
+        pool->frames[i].pool = pool;
+        pool->frames[i].next_free = pool->free_list;
+        pool->free_list = &pool->frames[i];
+    }
+    return 0;
+}
+
+void net_frame_pool_close(net_frame_pool_t *pool)
+{
+    free(pool->frames);
+    memset(pool, 0, sizeof(*pool));
+}
+
+net_frame_t *net_frame_alloc(net_frame_pool_t *pool)
+{
+    if (pool == NULL || pool->free_list == NULL)
+        return NULL;
+
+    net_frame_t *f = pool->free_list;
+    pool->free_list = f->next_free;
+    f->next_free = NULL;
+    f->refs = 1;
+    f->len = 0;
+    return f;
+}
+
+net_frame_t *net_frame_ref(net_frame_t *f)
+{
+    f->refs++;
+    return f;
+}
+
+void net_frame_release(net_frame_t *f)
+{
+    if (f == NULL || --f->refs > 0)
+        return;
+    f->next_free = f->pool->free_list;
+    f->pool->free_list = f;
+}
+
+net_frame_t *net_frame_copy(net_frame_pool_t *pool, const uint8_t *buf,
+                            size_t len)
+{
+    if (len > MSG_HEADER_SIZE + MAX_MSG_PAYLOAD)
+        return NULL;
+
+    net_frame_t *f = net_frame_alloc(pool);
+    if (f != NULL) {
+        memcpy(f->data, buf, len);
+        f->len = (uint16_t)len;
+    }
+    return f;
+}
+
+/* State updates a newer one supersedes. A dropped MSG_SNAPSHOT is
+ * harmless: deltas only ever refer to snapshots the client acknowledged. */
+static bool frame_is_state(uint8_t type)
+{
+    return type == MSG_STATE || type == MSG_SNAPSHOT;
+}
+
+/* Queues a frame behind whatever the client hasn't taken yet. When the
+ * queue is full the server's overflow policy decides: drop the oldest
+ * state update that hasn't started going out, or give up on the client. */
+static int sendq_push(net_sendq_t *q, net_overflow_policy_t policy,
+                      net_frame_t *f)
+{
+    if (q->count == NET_SENDQ_FRAMES) {
+        if (policy == NET_OVERFLOW_DISCONNECT)
+            return -1;
+
+        /* Frames the kernel is reading from, or has started on, stay */
+        int first = q->in_flight > 0 ? q->in_flight : (q->head_sent > 0 ? 1 : 0);
+        int victim = -1;
+        for (int i = first; i < q->count; i++) {
+            if (frame_is_state(q->frames[(q->head + i) % NET_SENDQ_FRAMES]->data[0])) {
+                victim = i;
+                break;
+            }
+        }
+        if (victim < 0)
+            return frame_is_state(f->data[0]) ? 0 : -1;
+
+        net_frame_release(q->frames[(q->head + victim) % NET_SENDQ_FRAMES]);
+        for (int i = victim; i < q->count - 1; i++)
+            q->frames[(q->head + i) % NET_SENDQ_FRAMES] =
+                q->frames[(q->head + i + 1) % NET_SENDQ_FRAMES];
+        q->count--;
+    }
+
+    q->frames[(q->head + q->count) % NET_SENDQ_FRAMES] = net_frame_ref(f);
+    q->count++;
+    return 0;
+}
+
+int net_server_send_frame(net_server_t *srv, int idx, net_frame_t *f)
+{
+    net_client_t *c = &srv->clients[idx];
+    if (!c->connected)
+        return -1;
+
+    if (sendq_push(&c->sendq, srv->overflow, f) < 0) {
+        net_server_close_client(srv, idx);
+        return -1;
+    }
+    if (srv->batching) {
+        c->batched = true;
+        return (int)f->len;
+    }
+    return net_server_flush(srv, idx) < 0 ? -1 : (int)f->len;
+}
+
+void net_server_begin_batch(net_server_t *srv)
+{
+    srv->batching = true;
+}
+
+void net_server_end_batch(net_server_t *srv)
+{
+    srv->batching = false;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (srv->clients[i].batched) {
+            srv->clients[i].batched = false;
+            net_server_flush(srv, i);
+        }
+    }
+}
+
+/* Drops the done bytes the kernel has taken off the front of the queue */
+static void sendq_consume(net_sendq_t *q, size_t done)
+{
+    while (done > 0 && q->count > 0) {
+        net_frame_t *f = q->frames[q->head];
+        size_t rest = f->len - q->head_sent;
+        if (done < rest) {
+            q->head_sent += done;
+            break;
+        }
+        done -= rest;
+        net_frame_release(f);
+        q->head = (q->head + 1) % NET_SENDQ_FRAMES;
+        q->count--;
+        q->head_sent = 0;
+    }
+}
+
+int net_server_send(net_server_t *srv, int idx, const uint8_t *buf, size_t len)
+{
+    if (!srv->clients[idx].connected)
+        return -1;
+
+    net_frame_t *f = net_frame_copy(srv->pool, buf, len);
+    if (f == NULL)
+        return -1;
+    int n = net_server_send_frame(srv, idx, f);
+    net_frame_release(f);
+    return n;
+}
+
+#ifdef BYTES_HAVE_URING
+/* Everything queued goes out as one SENDMSG; the next one is prepared
+ * once the loop has seen this one complete. Nothing reaches the kernel
+ * before the loop's next wait, so one tick's sends share a syscall. */
+static int uring_flush(net_server_t *srv, int idx)
+{
+    net_client_t *c = &srv->clients[idx];
+    net_sendq_t *q = &c->sendq;
+    int slot;
+    net_uslot_t *s = uslot_get(srv->loop, srv->tag_base + idx, &slot);
+    if (s == NULL) {
+        net_server_close_client(srv, idx);
+        return -1;
+    }
+
+    if (q->in_flight > 0) {
+        if (!s->sent)
+            return q->count;
+        s->sent = false;
+        q->in_flight = 0;
+        if (s->send_res <= 0) {
+            net_server_close_client(srv, idx);
+            return -1;
+        }
+
+        srv->bytes_out += (uint64_t)s->send_res;
+        sendq_consume(q, (size_t)s->send_res);
+    }
+    if (q->count == 0)
+        return 0;
+
+    for (int i = 0; i < q->count; i++) {
+        net_frame_t *f = q->frames[(q->head + i) % NET_SENDQ_FRAMES];
+        size_t skip = (i == 0) ? q->head_sent : 0;
+        s->iov[i].iov_base = f->data + skip;
+        s->iov[i].iov_len = f->len - skip;
+    }
+    s->msg.msg_iov = s->iov;
+    s->msg.msg_iovlen = (size_t)q->count;
+
+    if (uring_sendmsg(srv->loop->uring->ring, c->fd, &s->msg,
+                      uslot_data(s, slot, UOP_SEND)) < 0) {
+        net_server_close_client(srv, idx);
+        return -1;
+    }
+    s->sending = true;
+    q->in_flight = q->count;
+    return q->count;
+}
+#endif
+
+/* As much of the queue as the kernel takes, in one call */
+static int sendq_write(bytes_socket_t fd, const net_sendq_t *q)
+{
+#ifdef BYTES_WINDOWS
+    net_frame_t *f = q->frames[q->head];
+    return send(fd, (const char *)(f->data + q->head_sent),
+                (int)(f->len - q->head_sent), BYTES_MSG_NOSIGNAL);
+#else
+    struct iovec iov[NET_SENDQ_FRAMES];
+    for (int i = 0; i < q->count; i++) {
+        net_frame_t *f = q->frames[(q->head + i) % NET_SENDQ_FRAMES];
+        size_t skip = (i == 0) ? q->head_sent : 0;
+        iov[i].iov_base = f->data + skip;
+        iov[i].iov_len = f->len - skip;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)q->count;
+    return (int)sendmsg(fd, &msg, BYTES_MSG_NOSIGNAL);
+#endif
+}
+
+int net_server_flush(net_server_t *srv, int idx)
+{
+    net_client_t *c = &srv->clients[idx];
+    net_sendq_t *q = &c->sendq;
+    if (!c->connected)
+        return -1;
+#ifdef BYTES_HAVE_URING
+    if (srv->loop != NULL && srv->loop->uring != NULL)
+        return uring_flush(srv, idx);
+#endif
+
+    while (q->count > 0) {
+        int n = sendq_write(c->fd, q);
+        if (n < 0) {
+            int err = bytes_socket_error();
+            if (err == BYTES_EINTR)
+                continue;
+            if (err == BYTES_EAGAIN || err == BYTES_EWOULDBLOCK)
+                break;
+            net_server_close_client(srv, idx);
+            return -1;
+        }
+        if (n == 0) {
+            net_server_close_client(srv, idx);
+            return -1;
+        }
+
+        srv->bytes_out += (uint64_t)n;
+        sendq_consume(q, (size_t)n);
+    }
+
+    if (srv->loop != NULL)
+        net_loop_want_write(srv->loop, c->fd, q->count > 0);
+    return q->count;
+}
+
+void net_server_drain(net_server_t *srv, int timeout_ms)
+{
+    int64_t deadline = platform_mono_us() + (int64_t)timeout_ms * 1000;
+
+    for (;;) {
+        bool pending = false;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (srv->clients[i].connected && srv->clients[i].sendq.count > 0 &&
+                net_server_flush(srv, i) > 0)
+                pending = true;
+        }
+        if (!pending || platform_mono_us() >= deadline)
+            return;
+#ifdef BYTES_HAVE_URING
+        /* Completions only arrive through the loop. This is the end of a
+         * session, so whatever else the wait reports can go unhandled. */
+        if (srv->loop != NULL && srv->loop->uring != NULL) {
+            net_event_t events[32];
+            net_loop_wait(srv->loop, events, 32, 2);
+            continue;
+        }
+#endif
+        platform_usleep(2000);
+    }
+}
+
+/* Broadcasts copy the bytes once; every queue shares the frame */
 int net_send_to_all(net_server_t *srv, const uint8_t *buf, size_t len)
 {
+    net_frame_t *f = net_frame_copy(srv->pool, buf, len);
+    if (f == NULL)
+        return 0;
+
     int count = 0;
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (srv->clients[i].connected) {
-            if (net_send(srv->clients[i].fd, buf, len, 100) > 0)
-                count++;
-            else
-                net_server_close_client(srv, i);
-        }
+        if (srv->clients[i].connected && net_server_send_frame(srv, i, f) > 0)
+            count++;
     }
+    net_frame_release(f);
     return count;
 }
 
 int net_send_to_spectators(net_server_t *srv, const uint8_t *buf, size_t len)
 {
+    net_frame_t *f = net_frame_copy(srv->pool, buf, len);
+    if (f == NULL)
+        return 0;
+
     int count = 0;
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (srv->clients[i].connected && !srv->clients[i].is_player) {
-            if (net_send(srv->clients[i].fd, buf, len, 100) > 0)
-                count++;
-            else
-                net_server_close_client(srv, i);
-        }
+        if (srv->clients[i].connected && !srv->clients[i].is_player &&
+            net_server_send_frame(srv, i, f) > 0)
+            count++;
     }
+    net_frame_release(f);
     return count;
 }
 
@@ -389,6 +890,647 @@ int net_poll_readable(bytes_socket_t fd, int timeout_ms)
 #endif
 }
 
+/* ── io_uring backend ────────────────────────────────────────────── */
+
+#ifdef BYTES_HAVE_URING
+
+static void uring_free(struct net_loop_uring *lu)
+{
+    for (int i = 0; i < lu->accepted_count; i++)
+        close(lu->accepted[(lu->accepted_head + i) % NET_URING_ACCEPTS]);
+    uring_close(lu->ring);
+    free(lu->slots);
+    free(lu);
+}
+
+static int uring_arm(net_loop_t *loop, bytes_socket_t fd, int tag,
+                     net_rxbuf_t *rx)
+{
+    int slot;
+    net_uslot_t *s = uslot_get(loop, tag, &slot);
+    if (s == NULL)
+        return -1;
+
+    uring_t *ring = loop->uring->ring;
+    s->fd = fd;
+    s->rx = rx;
+    s->sending = false;
+    s->sent = false;
+    if (rx != NULL) {
+        rx->by_loop = true;
+        rx->eof = false;
+        s->op = UOP_RECV;
+        return uring_recv_multishot(ring, fd, uslot_data(s, slot, UOP_RECV));
+    }
+    if (tag == NET_TAG_LISTEN) {
+        s->op = UOP_ACCEPT;
+        return uring_accept_multishot(ring, fd, uslot_data(s, slot, UOP_ACCEPT));
+    }
+    s->op = UOP_POLL;
+    return uring_poll_multishot(ring, fd, uslot_data(s, slot, UOP_POLL));
+}
+
+static void uring_disarm(net_loop_t *loop, int tag)
+{
+    int slot;
+    net_uslot_t *s = uslot_get(loop, tag, &slot);
+    if (s == NULL || s->op == UOP_NONE)
+        return;
+
+    uring_t *ring = loop->uring->ring;
+    uring_cancel(ring, uslot_data(s, slot, s->op), 0);
+    if (s->sending)
+        uring_cancel(ring, uslot_data(s, slot, UOP_SEND), 0);
+    /* Submit now, before the caller closes the fd: sends queued ahead
+     * of the cancellations still go out */
+    uring_enter(ring, false, 0);
+
+    if (s->rx != NULL)
+        s->rx->by_loop = false;
+    s->fd = BYTES_INVALID_SOCKET;
+    s->op = UOP_NONE;
+    s->rx = NULL;
+    s->sending = false;
+    s->sent = false;
+    s->gen++;
+}
+
+static bool rx_append(net_rxbuf_t *rx, const uint8_t *data, size_t len)
+{
+    if (rx->start > 0) {
+        memmove(rx->data, rx->data + rx->start, rx->end - rx->start);
+        rx->end -= rx->start;
+        rx->start = 0;
+    }
+    if (len > sizeof(rx->data) - rx->end)
+        return false;
+    memcpy(rx->data + rx->end, data, len);
+    rx->end += len;
+    return true;
+}
+
+/* Turns completions into events without a syscall. A completion that
+ * can't be taken yet (its rx buffer or the accept queue is full) stays
+ * in the ring; its event makes the handler drain, and the next wait
+ * picks it up again. */
+static int uring_harvest(net_loop_t *loop, net_event_t *events, int max_events)
+{
+    struct net_loop_uring *lu = loop->uring;
+    uring_t *ring = lu->ring;
+    int n = 0;
+    uring_cqe_t c;
+
+    while (n < max_events && uring_peek(ring, &c) == 1) {
+        int slot = (int)(uint32_t)c.user_data;
+        int op = (int)((c.user_data >> 32) & 0xff);
+        uint32_t gen = (uint32_t)(c.user_data >> 40);
+        net_uslot_t *s = (op != UOP_NONE && slot < lu->nslots) ? &lu->slots[slot] : NULL;
+
+        if (s == NULL || (s->gen & 0xffffff) != gen ||
+            (op != UOP_SEND && op != s->op)) {
+            if (c.buf_id >= 0)
+                uring_recycle(ring, c.buf_id);
+            uring_pop(ring);
+            continue;
+        }
+
+        net_event_t *ev = &events[n++];
+        ev->fd = s->fd;
+        ev->tag = slot + NET_TAG_MIN;
+        ev->events = NET_EV_READ;
+
+        if (op == UOP_RECV) {
+            if (c.res > 0 && c.buf_id >= 0) {
+                if (!rx_append(s->rx, uring_buffer(ring, c.buf_id), (size_t)c.res))
+                    break;
+                uring_recycle(ring, c.buf_id);
+            } else if (c.res != -ENOBUFS) {
+                s->rx->eof = true;
+                ev->events |= NET_EV_HUP;
+            }
+            if (!c.more && !s->rx->eof)
+                uring_recv_multishot(ring, s->fd, c.user_data);
+        } else if (op == UOP_POLL) {
+            if (c.res < 0 || (c.res & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)))
+                ev->events |= NET_EV_HUP;
+            if (!c.more && c.res >= 0)
+                uring_poll_multishot(ring, s->fd, c.user_data);
+        } else if (op == UOP_ACCEPT) {
+            if (c.res >= 0) {
+                if (lu->accepted_count == NET_URING_ACCEPTS)
+                    break;
+                lu->accepted[(lu->accepted_head + lu->accepted_count) %
+                             NET_URING_ACCEPTS] = c.res;
+                lu->accepted_count++;
+            }
+            if (!c.more)
+                uring_accept_multishot(ring, s->fd, c.user_data);
+        } else {
+            s->sending = false;
+            s->sent = true;
+            s->send_res = c.res;
+            ev->events = NET_EV_WRITE;
+        }
+        uring_pop(ring);
+    }
+    return n;
+}
+
+/* One io_uring_enter per wait: it submits whatever sends and re-arms
+ * piled up since the last one and blocks for the next completion. */
+static int uring_wait(net_loop_t *loop, net_event_t *events, int max_events,
+                      int timeout_ms)
+{
+    uring_t *ring = loop->uring->ring;
+
+    int n = uring_harvest(loop, events, max_events);
+    if (n > 0) {
+        if (uring_pending(ring))
+            uring_enter(ring, false, 0);
+        return n;
+    }
+    if (uring_enter(ring, true, timeout_ms) < 0)
+        return -1;
+    return uring_harvest(loop, events, max_events);
+}
+
+#endif
+
+int net_loop_use_uring(net_loop_t *loop)
+{
+#ifdef BYTES_HAVE_URING
+    if (loop->uring != NULL)
+        return 0;
+    if (loop->count > 0)
+        return -1;
+
+    struct net_loop_uring *lu = calloc(1, sizeof(*lu));
+    if (lu == NULL)
+        return -1;
+    lu->nslots = loop->capacity - NET_TAG_MIN;
+    lu->slots = calloc((size_t)lu->nslots, sizeof(*lu->slots));
+
+    unsigned entries = 64;
+    while (entries < (unsigned)lu->nslots && entries < 4096)
+        entries *= 2;
+    lu->ring = (lu->slots != NULL) ? uring_open(entries) : NULL;
+    if (lu->ring == NULL) {
+        uring_free(lu);
+        return -1;
+    }
+    for (int i = 0; i < lu->nslots; i++)
+        lu->slots[i].fd = BYTES_INVALID_SOCKET;
+
+#ifdef BYTES_HAVE_EPOLL
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+    loop->epoll_fd = -1;
+#endif
+    loop->uring = lu;
+    return 0;
+#else
+    (void)loop;
+    return -1;
+#endif
+}
+
+unsigned long net_loop_enters(const net_loop_t *loop)
+{
+#ifdef BYTES_HAVE_URING
+    if (loop->uring != NULL)
+        return uring_enters(loop->uring->ring);
+#else
+    (void)loop;
+#endif
+    return 0;
+}
+
+bytes_socket_t net_loop_accept(net_loop_t *loop, bytes_socket_t listen_fd)
+{
+#ifdef BYTES_HAVE_URING
+    struct net_loop_uring *lu = loop->uring;
+    if (lu != NULL) {
+        if (lu->accepted_count == 0)
+            return BYTES_INVALID_SOCKET;
+        bytes_socket_t fd = lu->accepted[lu->accepted_head];
+        lu->accepted_head = (lu->accepted_head + 1) % NET_URING_ACCEPTS;
+        lu->accepted_count--;
+        accepted_setup(fd);
+        return fd;
+    }
+#else
+    (void)loop;
+#endif
+    return net_accept(listen_fd);
+}
+
+/* ── Event loop ─────────────────────────────────────────────────── */
+
+int net_loop_init(net_loop_t *loop, int capacity)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->epoll_fd = -1;
+    loop->capacity = capacity;
+
+    loop->pollfds = calloc((size_t)capacity, sizeof(*loop->pollfds));
+    loop->tags = calloc((size_t)capacity, sizeof(*loop->tags));
+    if (loop->pollfds == NULL || loop->tags == NULL) {
+        net_loop_close(loop);
+        return -1;
+    }
+
+#ifdef BYTES_HAVE_EPOLL
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    return 0;
+}
+
+void net_loop_close(net_loop_t *loop)
+{
+#ifdef BYTES_HAVE_EPOLL
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+#endif
+#ifdef BYTES_HAVE_URING
+    if (loop->uring != NULL)
+        uring_free(loop->uring);
+#endif
+    loop->uring = NULL;
+    loop->epoll_fd = -1;
+    free(loop->pollfds);
+    free(loop->tags);
+    loop->pollfds = NULL;
+    loop->tags = NULL;
+    loop->count = 0;
+}
+
+static int loop_add(net_loop_t *loop, bytes_socket_t fd, int tag,
+                    net_rxbuf_t *rx)
+{
+    if (loop->count >= loop->capacity)
+        return -1;
+
+#ifdef BYTES_HAVE_URING
+    if (loop->uring != NULL && uring_arm(loop, fd, tag, rx) < 0)
+        return -1;
+#else
+    (void)rx;
+#endif
+#ifdef BYTES_HAVE_EPOLL
+    if (loop->epoll_fd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        /* Edge-triggered EPOLLOUT fires when a full send buffer drains,
+         * which is exactly when a client's queue can make progress. */
+        if (tag >= 0)
+            ev.events |= EPOLLOUT;
+        ev.data.u64 = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)tag;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            return -1;
+    }
+#endif
+
+    loop->pollfds[loop->count].fd = fd;
+#ifdef BYTES_WINDOWS
+    loop->pollfds[loop->count].events = POLLRDNORM;
+#else
+    loop->pollfds[loop->count].events = POLLIN;
+#endif
+    loop->pollfds[loop->count].revents = 0;
+    loop->tags[loop->count] = tag;
+    loop->count++;
+    return 0;
+}
+
+int net_loop_add(net_loop_t *loop, bytes_socket_t fd, int tag)
+{
+    return loop_add(loop, fd, tag, NULL);
+}
+
+int net_loop_add_stream(net_loop_t *loop, bytes_socket_t fd, int tag,
+                        net_rxbuf_t *rx)
+{
+    return loop_add(loop, fd, tag, rx);
+}
+
+void net_loop_remove(net_loop_t *loop, bytes_socket_t fd)
+{
+    for (int i = 0; i < loop->count; i++) {
+        if (loop->pollfds[i].fd != fd)
+            continue;
+
+#ifdef BYTES_HAVE_URING
+        if (loop->uring != NULL)
+            uring_disarm(loop, loop->tags[i]);
+#endif
+#ifdef BYTES_HAVE_EPOLL
+        if (loop->epoll_fd >= 0)
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+        loop->count--;
+        loop->pollfds[i] = loop->pollfds[loop->count];
+        loop->tags[i] = loop->tags[loop->count];
+        return;
+    }
+}
+
+void net_loop_want_write(net_loop_t *loop, bytes_socket_t fd, bool on)
+{
+    /* epoll watches EPOLLOUT edges all the time; poll() would spin on a
+     * writable socket, so it only asks while something is queued. */
+#ifdef BYTES_WINDOWS
+    short out = POLLWRNORM;
+#else
+    short out = POLLOUT;
+#endif
+    if (loop->epoll_fd >= 0 || loop->uring != NULL)
+        return;
+
+    for (int i = 0; i < loop->count; i++) {
+        if (loop->pollfds[i].fd == fd) {
+            if (on)
+                loop->pollfds[i].events |= out;
+            else
+                loop->pollfds[i].events &= (short)~out;
+            return;
+        }
+    }
+}
+
+int net_loop_add_stdin(net_loop_t *loop)
+{
+#ifdef BYTES_WINDOWS
+    /* Console handles can't go through WSAPoll; report stdin ready on
+     * every wait and let getch() in nodelay mode sort it out. */
+    loop->stdin_always_ready = true;
+    return 0;
+#else
+    if (net_loop_add(loop, STDIN_FILENO, NET_TAG_STDIN) < 0)
+        loop->stdin_always_ready = true;
+    return 0;
+#endif
+}
+
+int net_loop_wait(net_loop_t *loop, net_event_t *events, int max_events,
+                  int timeout_ms)
+{
+    int n = 0;
+
+    if (loop->stdin_always_ready) {
+        if (timeout_ms < 0 || timeout_ms > 10)
+            timeout_ms = 10;
+        if (max_events > 0) {
+            events[n].fd = BYTES_INVALID_SOCKET;
+            events[n].tag = NET_TAG_STDIN;
+            events[n].events = NET_EV_READ;
+            n++;
+        }
+    }
+
+#ifdef BYTES_HAVE_URING
+    if (loop->uring != NULL) {
+        int ret = uring_wait(loop, events + n, max_events - n, timeout_ms);
+        return (ret < 0) ? -1 : n + ret;
+    }
+#endif
+#ifdef BYTES_HAVE_EPOLL
+    if (loop->epoll_fd >= 0) {
+        struct epoll_event evs[64];
+        int want = max_events - n;
+        if (want > 64)
+            want = 64;
+        if (want <= 0)
+            return n;
+
+        int ret = epoll_wait(loop->epoll_fd, evs, want, timeout_ms);
+        if (ret < 0)
+            return (errno == EINTR) ? n : -1;
+
+        for (int i = 0; i < ret; i++) {
+            events[n].fd = (bytes_socket_t)(uint32_t)(evs[i].data.u64 >> 32);
+            events[n].tag = (int)(uint32_t)evs[i].data.u64;
+            events[n].events = 0;
+            if (evs[i].events & EPOLLIN)
+                events[n].events |= NET_EV_READ;
+            if (evs[i].events & EPOLLOUT)
+                events[n].events |= NET_EV_WRITE;
+            if (evs[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                events[n].events |= NET_EV_READ | NET_EV_HUP;
+            n++;
+        }
+        return n;
+    }
+#endif
+
+    if (loop->count == 0) {
+        if (timeout_ms > 0)
+            platform_usleep((unsigned)timeout_ms * 1000);
+        return n;
+    }
+
+#ifdef BYTES_WINDOWS
+    int ret = WSAPoll(loop->pollfds, (ULONG)loop->count, timeout_ms);
+#else
+    int ret = poll(loop->pollfds, (nfds_t)loop->count, timeout_ms);
+#endif
+    if (ret < 0) {
+        int err = bytes_socket_error();
+        return (err == BYTES_EINTR) ? n : -1;
+    }
+
+    for (int i = 0; i < loop->count && ret > 0 && n < max_events; i++) {
+        short rev = loop->pollfds[i].revents;
+        if (rev == 0)
+            continue;
+        ret--;
+        events[n].fd = loop->pollfds[i].fd;
+        events[n].tag = loop->tags[i];
+        events[n].events = 0;
+        if (rev & (POLLIN | POLLRDNORM))
+            events[n].events |= NET_EV_READ;
+        if (rev & (POLLOUT | POLLWRNORM))
+            events[n].events |= NET_EV_WRITE;
+        if (rev & (POLLERR | POLLHUP | POLLNVAL))
+            events[n].events |= NET_EV_READ | NET_EV_HUP;
+        n++;
+    }
+    return n;
+}
+
+int net_server_attach_loop(net_server_t *srv, net_loop_t *loop)
+{
+    if (srv->listen_fd != BYTES_INVALID_SOCKET &&
+        net_loop_add(loop, srv->listen_fd, NET_TAG_LISTEN) < 0)
+        return -1;
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (srv->clients[i].connected &&
+            net_loop_add_stream(loop, srv->clients[i].fd, srv->tag_base + i,
+                                &srv->clients[i].rx) < 0)
+            return -1;
+    }
+
+    srv->loop = loop;
+    return 0;
+}
+
+/* ── UDP channel ────────────────────────────────────────────────── */
+
+/* Binds a non-blocking datagram socket; port 0 picks any. Returns the
+ * bound port. */
+int net_udp_open(net_udp_t *udp, int port)
+{
+    memset(udp, 0, sizeof(*udp));
+    udp->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp->fd == BYTES_INVALID_SOCKET)
+        return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((uint16_t)port);
+
+    socklen_t alen = sizeof(addr);
+    if (bind(udp->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(udp->fd, (struct sockaddr *)&addr, &alen) < 0) {
+        net_udp_close(udp);
+        return -1;
+    }
+
+    platform_set_nonblocking(udp->fd);
+    return ntohs(addr.sin_port);
+}
+
+void net_udp_close(net_udp_t *udp)
+{
+    if (udp->fd != BYTES_INVALID_SOCKET)
+        platform_close_socket(udp->fd);
+    udp->fd = BYTES_INVALID_SOCKET;
+    udp->has_peer = false;
+    udp->active = false;
+}
+
+void net_udp_set_peer(net_udp_t *udp, const struct sockaddr_in *peer)
+{
+    udp->peer = *peer;
+    udp->has_peer = true;
+}
+
+/* The datagram peer is whoever is at the other end of the TCP session */
+int net_udp_peer_from_tcp(net_udp_t *udp, bytes_socket_t tcp_fd, int port)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    if (getpeername(tcp_fd, (struct sockaddr *)&addr, &alen) < 0 ||
+        addr.sin_family != AF_INET)
+        return -1;
+
+    addr.sin_port = htons((uint16_t)port);
+    net_udp_set_peer(udp, &addr);
+    return 0;
+}
+
+void net_udp_forget_peer(net_udp_t *udp)
+{
+    udp->has_peer = false;
+    udp->active = false;
+}
+
+/* Fire and forget: returns 0 when the datagram couldn't be queued */
+int net_udp_send(net_udp_t *udp, const uint8_t *buf, size_t len)
+{
+    if (udp->fd == BYTES_INVALID_SOCKET || !udp->has_peer)
+        return -1;
+
+    for (;;) {
+        int n = (int)sendto(udp->fd, (const char *)buf, (int)len, 0,
+                            (const struct sockaddr *)&udp->peer,
+                            sizeof(udp->peer));
+        if (n >= 0) {
+            udp->bytes_out += (uint64_t)n;
+            return n;
+        }
+
+        int err = bytes_socket_error();
+        if (err == BYTES_EINTR)
+            continue;
+        if (err == BYTES_EAGAIN || err == BYTES_EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+}
+
+/* Returns the next datagram, 0 when none is pending. Once a peer is set
+ * anything from elsewhere is silently discarded. */
+int net_udp_recv(net_udp_t *udp, uint8_t *buf, size_t buflen,
+                 struct sockaddr_in *from)
+{
+    for (;;) {
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        int n = (int)recvfrom(udp->fd, (char *)buf, (int)buflen, 0,
+                              (struct sockaddr *)&addr, &alen);
+        if (n < 0) {
+            int err = bytes_socket_error();
+            if (err == BYTES_EINTR)
+                continue;
+#ifdef BYTES_WINDOWS
+            /* ICMP port unreachable from an earlier send */
+            if (err == WSAECONNRESET)
+                continue;
+#endif
+            if (err == BYTES_EAGAIN || err == BYTES_EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+
+        if (udp->has_peer &&
+            (addr.sin_addr.s_addr != udp->peer.sin_addr.s_addr ||
+             addr.sin_port != udp->peer.sin_port))
+            continue;
+        if (n < MSG_HEADER_SIZE)
+            continue;
+
+        if (from != NULL)
+            *from = addr;
+        udp->bytes_in += (uint64_t)n;
+        return n;
+    }
+}
+
+void net_parse_address(const char *addr, char *host, size_t hostlen, int *port,
+                       int default_port, char *room, size_t roomlen)
+{
+    char input[64];
+    strncpy(input, addr, sizeof(input) - 1);
+    input[sizeof(input) - 1] = '\0';
+
+    room[0] = '\0';
+    char *slash = strchr(input, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+        strncpy(room, slash + 1, roomlen - 1);
+        room[roomlen - 1] = '\0';
+    }
+
+    *port = default_port;
+    char *colon = strrchr(input, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+        int p = atoi(colon + 1);
+        if (p > 0 && p < 65536)
+            *port = p;
+    }
+
+    if (input[0] == '\0')
+        strncpy(host, "127.0.0.1", hostlen - 1);
+    else
+        strncpy(host, input, hostlen - 1);
+    host[hostlen - 1] = '\0';
+}
+
 char *net_get_local_ip(char *buf, size_t buflen)
 {
     return platform_get_local_ip(buf, buflen);
@@ -5,6 +5,19 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef BYTES_WINDOWS
+#include <io.h>
+#else
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+#if defined(BYTES_LINUX) && defined(__linux__)
+#define BYTES_HAVE_TIMERFD 1
+#include <sys/timerfd.h>
+#endif
+
 /* ── Network init / cleanup ─────────────────────────────────────── */
 
 #ifdef BYTES_WINDOWS
@@ -128,6 +141,147 @@ void platform_usleep(unsigned us)
 
 #endif
 
+/* ── Tick scheduling ────────────────────────────────────────────── */
+
+/* Arms the timerfd to fire at next_us and every interval after; both
+ * sides read CLOCK_MONOTONIC, so it stays on the same grid */
+static void ticker_arm(platform_ticker_t *t)
+{
+#ifdef BYTES_HAVE_TIMERFD
+    if (t->fd < 0)
+        return;
+    struct itimerspec its;
+    its.it_value.tv_sec = (time_t)(t->next_us / 1000000);
+    its.it_value.tv_nsec = (long)(t->next_us % 1000000) * 1000;
+    its.it_interval.tv_sec = (time_t)(t->interval_us / 1000000);
+    its.it_interval.tv_nsec = (long)(t->interval_us % 1000000) * 1000;
+    if (timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        close(t->fd);
+        t->fd = -1;
+    }
+#else
+    (void)t;
+#endif
+}
+
+void platform_ticker_init(platform_ticker_t *t, int64_t interval_us,
+                          bool want_fd)
+{
+    memset(t, 0, sizeof(*t));
+    t->interval_us = interval_us;
+    t->fd = -1;
+#ifdef BYTES_HAVE_TIMERFD
+    if (want_fd)
+        t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#else
+    (void)want_fd;
+#endif
+    platform_ticker_restart(t, platform_mono_us());
+}
+
+void platform_ticker_close(platform_ticker_t *t)
+{
+#ifndef BYTES_WINDOWS
+    if (t->fd >= 0)
+        close(t->fd);
+#endif
+    t->fd = -1;
+}
+
+void platform_ticker_restart(platform_ticker_t *t, int64_t now_us)
+{
+    t->next_us = now_us + t->interval_us;
+    ticker_arm(t);
+}
+
+int platform_ticker_due(platform_ticker_t *t, int64_t now_us)
+{
+#ifdef BYTES_HAVE_TIMERFD
+    /* Event loops watch the fd edge-triggered; empty it every time */
+    uint64_t expirations;
+    while (t->fd >= 0 && read(t->fd, &expirations, sizeof(expirations)) > 0)
+        ;
+#endif
+    if (now_us < t->next_us)
+        return 0;
+
+    int64_t owed = (now_us - t->next_us) / t->interval_us + 1;
+    int64_t run = owed < PLATFORM_TICKER_CATCHUP ? owed : PLATFORM_TICKER_CATCHUP;
+    t->next_us += owed * t->interval_us;
+    t->ticks += (uint64_t)run;
+    t->late += (uint64_t)(run - 1);
+    t->dropped += (uint64_t)(owed - run);
+    return (int)run;
+}
+
+int platform_ticker_wait_ms(const platform_ticker_t *t, int64_t now_us)
+{
+    if (t->fd >= 0)
+        return -1;
+    int64_t until = t->next_us - now_us;
+    return until > 0 ? (int)((until + 999) / 1000) : 0;
+}
+
+/* ── Cross-thread wake ──────────────────────────────────────────── */
+
+int platform_wake_init(platform_wake_t *w)
+{
+    w->fd = -1;
+    w->write_fd = -1;
+#ifdef BYTES_WINDOWS
+    return -1;
+#else
+    int fds[2];
+    if (pipe(fds) < 0)
+        return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        platform_set_nonblocking(fds[i]);
+    }
+    w->fd = fds[0];
+    w->write_fd = fds[1];
+    return 0;
+#endif
+}
+
+void platform_wake_close(platform_wake_t *w)
+{
+#ifndef BYTES_WINDOWS
+    if (w->fd >= 0)
+        close(w->fd);
+    if (w->write_fd >= 0)
+        close(w->write_fd);
+#endif
+    w->fd = -1;
+    w->write_fd = -1;
+}
+
+/* A full pipe already has a wake pending, so a failed write is fine */
+void platform_wake_signal(platform_wake_t *w)
+{
+#ifndef BYTES_WINDOWS
+    if (w->write_fd >= 0) {
+        char c = 0;
+        ssize_t n = write(w->write_fd, &c, 1);
+        (void)n;
+    }
+#else
+    (void)w;
+#endif
+}
+
+/* Event loops watch the fd edge-triggered; empty it every time */
+void platform_wake_drain(platform_wake_t *w)
+{
+#ifndef BYTES_WINDOWS
+    char buf[64];
+    while (w->fd >= 0 && read(w->fd, buf, sizeof(buf)) > 0)
+        ;
+#else
+    (void)w;
+#endif
+}
+
 /* ── Signal handling ────────────────────────────────────────────── */
 
 void platform_ignore_sigpipe(void)
@@ -137,6 +291,218 @@ void platform_ignore_sigpipe(void)
 #endif
 }
 
+/* ── Terminal ───────────────────────────────────────────────────── */
+
+bool platform_term_behind(int max_queued)
+{
+#ifndef BYTES_WINDOWS
+    struct pollfd p = { .fd = STDOUT_FILENO, .events = POLLOUT, .revents = 0 };
+    if (poll(&p, 1, 0) == 0)
+        return true;
+#ifdef TIOCOUTQ
+    int n = 0;
+    if (ioctl(STDOUT_FILENO, TIOCOUTQ, &n) == 0 && n > max_queued)
+        return true;
+#endif
+#endif
+    (void)max_queued;
+    return false;
+}
+
+/* ── Process resources ──────────────────────────────────────────── */
+
+#ifdef BYTES_WINDOWS
+
+int platform_cpu_count(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+}
+
+void platform_raise_fd_limit(void)
+{
+}
+
+#else
+
+int platform_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void platform_raise_fd_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+#endif
+
+/* ── Mapped files ───────────────────────────────────────────────── */
+
+#ifdef BYTES_WINDOWS
+
+const uint8_t *platform_map_file(const char *path, size_t *size)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER len;
+    const uint8_t *p = NULL;
+    if (GetFileSizeEx(file, &len) && len.QuadPart > 0) {
+        HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (map != NULL) {
+            p = (const uint8_t *)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(map);
+        }
+    }
+    CloseHandle(file);
+    if (p != NULL)
+        *size = (size_t)len.QuadPart;
+    return p;
+}
+
+void platform_unmap_file(const uint8_t *p, size_t size)
+{
+    (void)size;
+    UnmapViewOfFile(p);
+}
+
+#else
+
+const uint8_t *platform_map_file(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    *size = (size_t)st.st_size;
+    return (const uint8_t *)p;
+}
+
+void platform_unmap_file(const uint8_t *p, size_t size)
+{
+    munmap((void *)p, size);
+}
+
+#endif
+
+/* ── File locks and replacement ─────────────────────────────────── */
+
+#ifdef BYTES_WINDOWS
+
+int platform_lock(platform_lock_t *lk, const char *path)
+{
+    HANDLE h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        return -1;
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    if (!LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) {
+        CloseHandle(h);
+        return -1;
+    }
+    lk->handle = (intptr_t)h;
+    return 0;
+}
+
+void platform_unlock(platform_lock_t *lk)
+{
+    HANDLE h = (HANDLE)lk->handle;
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    UnlockFileEx(h, 0, 1, 0, &ov);
+    CloseHandle(h);
+}
+
+int platform_sync_file(FILE *f)
+{
+    if (fflush(f) != 0)
+        return -1;
+    return FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(f))) ? 0 : -1;
+}
+
+int platform_replace_file(const char *from, const char *to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING |
+                                 MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+}
+
+#else
+
+int platform_lock(platform_lock_t *lk, const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return -1;
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl) < 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    lk->handle = fd;
+    return 0;
+}
+
+/* Closing the file releases the lock */
+void platform_unlock(platform_lock_t *lk)
+{
+    close((int)lk->handle);
+}
+
+int platform_sync_file(FILE *f)
+{
+    if (fflush(f) != 0)
+        return -1;
+    return fsync(fileno(f));
+}
+
+/* The rename only lasts once the directory holding it is on disk too */
+int platform_replace_file(const char *from, const char *to)
+{
+    if (rename(from, to) < 0)
+        return -1;
+
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", to);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+        snprintf(dir, sizeof(dir), ".");
+    else if (slash == dir)
+        slash[1] = '\0';
+    else
+        *slash = '\0';
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+#endif
+
 /* ── Home directory ─────────────────────────────────────────────── */
 
 void platform_get_home_dir(char *buf, size_t len)
@@ -1,22 +1,36 @@
 #include "pong.h"
+#ifndef BYTES_HEADLESS
+#include "term.h"
 #include "ui.h"
+#endif
 
-#include <math.h>
-#include <stdlib.h>
 #include <string.h>
 
 /* Unicode characters */
-#define CH_BALL      "\u25CF"
-#define CH_PADDLE    "\u2588"
-#define CH_HLINE     "\u2500"
-#define CH_VLINE     "\u2502"
-#define CH_TL        "\u250C"
-#define CH_TR        "\u2510"
-#define CH_BL        "\u2514"
-#define CH_BR        "\u2518"
-#define CH_CENTER    "\u254E"
-#define CH_T_RIGHT   "\u251C"
-#define CH_T_LEFT    "\u2524"
+#define CH_BALL      L"\u25CF"
+#define CH_PADDLE    L"\u2588"
+#define CH_HLINE     L"\u2500"
+#define CH_VLINE     L"\u2502"
+#define CH_TL        L"\u250C"
+#define CH_TR        L"\u2510"
+#define CH_BL        L"\u2514"
+#define CH_BR        L"\u2518"
+#define CH_CENTER    L"\u254E"
+#define CH_T_RIGHT   L"\u251C"
+#define CH_T_LEFT    L"\u2524"
+
+/* ── Fixed point ────────────────────────────────────────────────── */
+
+/* Packed states carry hundredths of a cell */
+static int16_t fx_to_wire(pong_fx_t v)
+{
+    return (int16_t)((int64_t)v * 100 / PONG_FX_ONE);
+}
+
+static pong_fx_t fx_from_wire(int16_t v)
+{
+    return (pong_fx_t)((int64_t)v * PONG_FX_ONE / 100);
+}
 
 static void pong_init(void *state, int rows, int cols)
 {
@@ -31,10 +45,10 @@ static void pong_init(void *state, int rows, int cols)
     int field_h = s->field_bottom - s->field_top;
     int mid_y = s->field_top + field_h / 2;
 
-    s->ball.x = (float)(cols / 2);
-    s->ball.y = (float)mid_y;
-    s->ball.vx = 1.0f;
-    s->ball.vy = 0.5f;
+    s->ball.x = PONG_FX(cols / 2);
+    s->ball.y = PONG_FX(mid_y);
+    s->ball.vx = PONG_FX_ONE;
+    s->ball.vy = PONG_FX_ONE / 2;
     s->ball.speed = PONG_BALL_SPEED_INIT;
     s->ball.prev_x = s->ball.x;
     s->ball.prev_y = s->ball.y;
@@ -46,6 +60,13 @@ static void pong_init(void *state, int rows, int cols)
     s->p2.x = cols - 3;
     s->p2.y = mid_y - PONG_PADDLE_LEN / 2;
     s->p2.len = PONG_PADDLE_LEN;
+    s->rng = 1;
+}
+
+static void pong_seed(void *state, uint32_t seed)
+{
+    pong_state_t *s = (pong_state_t *)state;
+    s->rng = seed;
 }
 
 static void reset_ball(pong_state_t *s)
@@ -53,44 +74,72 @@ static void reset_ball(pong_state_t *s)
     int field_h = s->field_bottom - s->field_top;
     int mid_y = s->field_top + field_h / 2;
 
-    s->ball.x = (float)(s->cols / 2);
-    s->ball.y = (float)mid_y;
+    s->ball.x = PONG_FX(s->cols / 2);
+    s->ball.y = PONG_FX(mid_y);
     s->ball.speed = PONG_BALL_SPEED_INIT;
 
     /* Alternate direction based on who scored */
-    s->ball.vx = (s->score1 + s->score2) % 2 == 0 ? 1.0f : -1.0f;
-    s->ball.vy = ((float)(rand() % 100) / 100.0f) - 0.5f;
+    s->ball.vx = (s->score1 + s->score2) % 2 == 0 ? PONG_FX_ONE : -PONG_FX_ONE;
+    s->ball.vy = pong_serve_vy(&s->rng);
+}
+
+static void paddle_move(const pong_state_t *s, pong_paddle_t *p, int dy)
+{
+    p->y += dy;
+    if (p->y < s->field_top + 1)
+        p->y = s->field_top + 1;
+    if (p->y + p->len > s->field_bottom - 1)
+        p->y = s->field_bottom - 1 - p->len;
+}
+
+static uint8_t pong_key_action(int key)
+{
+    switch (key) {
+    case 'w': case 'W': case KEY_UP:
+        return PONG_HOLD_UP;
+    case 's': case 'S': case KEY_DOWN:
+        return PONG_HOLD_DOWN;
+    }
+    return 0;
 }
 
 static void pong_handle_input(void *state, int player_id, int key)
 {
     pong_state_t *s = (pong_state_t *)state;
-
-    if (player_id == 1) {
-        switch (key) {
-        case 'w': case 'W': case KEY_UP:
-            if (s->p1.y > s->field_top + 1)
-                s->p1.y--;
-            break;
-        case 's': case 'S': case KEY_DOWN:
-            if (s->p1.y + s->p1.len < s->field_bottom - 1)
-                s->p1.y++;
-            break;
-        }
-    } else {
-        switch (key) {
-        case KEY_UP: case 'w': case 'W':
-            if (s->p2.y > s->field_top + 1)
-                s->p2.y--;
-            break;
-        case KEY_DOWN: case 's': case 'S':
-            if (s->p2.y + s->p2.len < s->field_bottom - 1)
-                s->p2.y++;
-            break;
-        }
+    pong_paddle_t *p = (player_id == 1) ? &s->p1 : &s->p2;
+
+    switch (pong_key_action(key)) {
+    case PONG_HOLD_UP:
+        paddle_move(s, p, -1);
+        break;
+    case PONG_HOLD_DOWN:
+        paddle_move(s, p, 1);
+        break;
     }
 }
 
+static void pong_set_held(void *state, int player_id, uint8_t held)
+{
+    pong_state_t *s = (pong_state_t *)state;
+    pong_paddle_t *p = (player_id == 1) ? &s->p1 : &s->p2;
+    p->held = held;
+}
+
+/* Held keys move a paddle at a fixed rate, whatever the key repeat */
+static void paddle_drive(const pong_state_t *s, pong_paddle_t *p)
+{
+    if (p->held == PONG_HOLD_UP)
+        paddle_move(s, p, -PONG_PADDLE_SPEED);
+    else if (p->held == PONG_HOLD_DOWN)
+        paddle_move(s, p, PONG_PADDLE_SPEED);
+}
+
+static void pong_predict_tick(void *state, int player_id)
+{
+    pong_state_t *s = (pong_state_t *)state;
+    paddle_drive(s, (player_id == 1) ? &s->p1 : &s->p2);
+}
+
 static void pong_update(void *state)
 {
     pong_state_t *s = (pong_state_t *)state;
@@ -99,30 +148,33 @@ static void pong_update(void *state)
     s->ball.prev_y = s->ball.y;
     s->scored = false;
 
-    float nx = s->ball.x + s->ball.vx * s->ball.speed;
-    float ny = s->ball.y + s->ball.vy * s->ball.speed;
+    paddle_drive(s, &s->p1);
+    paddle_drive(s, &s->p2);
+
+    pong_fx_t nx = s->ball.x + pong_fx_mul(s->ball.vx, s->ball.speed);
+    pong_fx_t ny = s->ball.y + pong_fx_mul(s->ball.vy, s->ball.speed);
 
     /* Top/bottom wall bounce */
-    if ((int)ny <= s->field_top) {
-        ny = (float)(s->field_top + 1);
+    if (pong_fx_trunc(ny) <= s->field_top) {
+        ny = PONG_FX(s->field_top + 1);
         s->ball.vy = -s->ball.vy;
     }
-    if ((int)ny >= s->field_bottom - 1) {
-        ny = (float)(s->field_bottom - 2);
+    if (pong_fx_trunc(ny) >= s->field_bottom - 1) {
+        ny = PONG_FX(s->field_bottom - 2);
         s->ball.vy = -s->ball.vy;
     }
 
     /* Left paddle collision */
-    int bx = (int)roundf(nx);
-    int by = (int)roundf(ny);
+    int bx = pong_fx_round(nx);
+    int by = pong_fx_round(ny);
 
     if (bx <= s->p1.x + 1 && s->ball.vx < 0) {
         if (by >= s->p1.y && by < s->p1.y + s->p1.len) {
-            nx = (float)(s->p1.x + 2);
+            nx = PONG_FX(s->p1.x + 2);
             s->ball.vx = -s->ball.vx;
             /* Angle based on where ball hits paddle */
-            float offset = (float)(by - s->p1.y) / (float)s->p1.len - 0.5f;
-            s->ball.vy = offset * 2.0f;
+            pong_fx_t offset = PONG_FX(by - s->p1.y) / s->p1.len - PONG_FX_ONE / 2;
+            s->ball.vy = offset * 2;
             s->ball.speed += PONG_BALL_SPEED_INC;
             if (s->ball.speed > PONG_BALL_MAX_SPEED)
                 s->ball.speed = PONG_BALL_MAX_SPEED;
@@ -132,10 +184,10 @@ static void pong_update(void *state)
     /* Right paddle collision */
     if (bx >= s->p2.x - 1 && s->ball.vx > 0) {
         if (by >= s->p2.y && by < s->p2.y + s->p2.len) {
-            nx = (float)(s->p2.x - 2);
+            nx = PONG_FX(s->p2.x - 2);
             s->ball.vx = -s->ball.vx;
-            float offset = (float)(by - s->p2.y) / (float)s->p2.len - 0.5f;
-            s->ball.vy = offset * 2.0f;
+            pong_fx_t offset = PONG_FX(by - s->p2.y) / s->p2.len - PONG_FX_ONE / 2;
+            s->ball.vy = offset * 2;
             s->ball.speed += PONG_BALL_SPEED_INC;
             if (s->ball.speed > PONG_BALL_MAX_SPEED)
                 s->ball.speed = PONG_BALL_MAX_SPEED;
@@ -160,116 +212,214 @@ static void pong_update(void *state)
     s->ball.y = ny;
 }
 
+#ifndef BYTES_HEADLESS
+/* Glyphs with their colors, built once */
+static struct {
+    bool         ready;
+    term_glyph_t ball, trail, paddle1, paddle2, center, blank;
+    term_glyph_t hline, vline, tl, tr, bl, br, t_right, t_left;
+} g_glyph;
+
+/* What the last frame left on screen, so the next one redraws only the
+ * cells that changed. Cleared by pong_render_reset when the screen was. */
+static struct {
+    bool valid;
+    int  ball_x, ball_y;     /* -1 when not on screen */
+    int  trail_x, trail_y;
+    int  p1_y, p2_y;         /* -1 likewise */
+    int  score1, score2;
+    int  spectators;
+} g_shown;
+
+static void build_glyphs(void)
+{
+    term_glyph(&g_glyph.ball, CH_BALL, A_BOLD, COLOR_BALL);
+    term_glyph(&g_glyph.trail, CH_BALL, A_DIM, COLOR_DIM);
+    term_glyph(&g_glyph.paddle1, CH_PADDLE, A_BOLD, COLOR_P1);
+    term_glyph(&g_glyph.paddle2, CH_PADDLE, A_BOLD, COLOR_P2);
+    term_glyph(&g_glyph.center, CH_CENTER, A_DIM, COLOR_BORDER);
+    term_glyph(&g_glyph.blank, L" ", A_NORMAL, 0);
+    term_glyph(&g_glyph.hline, CH_HLINE, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.vline, CH_VLINE, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.tl, CH_TL, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.tr, CH_TR, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.bl, CH_BL, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.br, CH_BR, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.t_right, CH_T_RIGHT, A_NORMAL, COLOR_BORDER);
+    term_glyph(&g_glyph.t_left, CH_T_LEFT, A_NORMAL, COLOR_BORDER);
+    g_glyph.ready = true;
+}
+
+static void pong_render_reset(void)
+{
+    g_shown.valid = false;
+}
+
+static bool on_paddle(const pong_paddle_t *p, int y, int x)
+{
+    return x == p->x && y >= p->y && y < p->y + p->len;
+}
+
+/* Whatever is at a field cell apart from the ball and its trail */
+static void draw_under(const pong_state_t *s, int y, int x)
+{
+    if (on_paddle(&s->p1, y, x))
+        term_put(y, x, &g_glyph.paddle1);
+    else if (on_paddle(&s->p2, y, x))
+        term_put(y, x, &g_glyph.paddle2);
+    else if (x == s->cols / 2)
+        term_put(y, x, &g_glyph.center);
+    else
+        term_put(y, x, &g_glyph.blank);
+}
+
+static bool in_field(const pong_state_t *s, int y, int x)
+{
+    return x > 0 && x < s->cols - 1 && y > s->field_top && y < s->field_bottom;
+}
+
+/* Paddles cover the ball, as they always have */
+static void draw_ball(const pong_state_t *s, int y, int x, const term_glyph_t *g)
+{
+    if (!on_paddle(&s->p1, y, x) && !on_paddle(&s->p2, y, x))
+        term_put(y, x, g);
+}
+
 static void draw_field(const pong_state_t *s)
 {
     int w = s->cols;
     int top = s->field_top - 1;
     int bot = s->field_bottom;
 
-    attron(COLOR_PAIR(COLOR_BORDER));
-
     /* Top border with title */
-    mvaddstr(top, 0, CH_TL);
-    int title_pos = (w - 8) / 2;
-    for (int i = 1; i < w - 1; i++) {
-        if (i == title_pos) {
-            attroff(COLOR_PAIR(COLOR_BORDER));
-            attron(COLOR_PAIR(COLOR_MENU) | A_BOLD);
-            addstr(" PONG ");
-            attroff(COLOR_PAIR(COLOR_MENU) | A_BOLD);
-            attron(COLOR_PAIR(COLOR_BORDER));
-            i += 5;
-        } else {
-            addstr(CH_HLINE);
-        }
-    }
-    addstr(CH_TR);
-
-    /* Separator below header */
-    mvaddstr(s->field_top, 0, CH_T_RIGHT);
-    for (int i = 1; i < w - 1; i++)
-        addstr(CH_HLINE);
-    addstr(CH_T_LEFT);
+    term_put(top, 0, &g_glyph.tl);
+    term_hline(top, 1, &g_glyph.hline, w - 2);
+    term_put(top, w - 1, &g_glyph.tr);
+    term_text(top, (w - 8) / 2, A_BOLD, COLOR_MENU, " PONG ");
 
     /* Side borders and center line */
-    for (int y = s->field_top + 1; y < bot; y++) {
-        mvaddstr(y, 0, CH_VLINE);
-        mvaddstr(y, w - 1, CH_VLINE);
+    term_vline(s->field_top + 1, 0, &g_glyph.vline, bot - s->field_top - 1);
+    term_vline(s->field_top + 1, w - 1, &g_glyph.vline, bot - s->field_top - 1);
+    term_vline(s->field_top + 1, w / 2, &g_glyph.center, bot - s->field_top - 1);
+}
 
-        attron(A_DIM);
-        mvaddstr(y, w / 2, CH_CENTER);
-        attroff(A_DIM);
-    }
+/* Separator below the title, with the scores on it */
+static void draw_header(const pong_state_t *s, const char *p1_name,
+                        const char *p2_name)
+{
+    int w = s->cols;
+    int y = s->field_top;
 
-    /* Bottom border */
-    mvaddstr(bot, 0, CH_BL);
-    for (int i = 1; i < w - 1; i++)
-        addstr(CH_HLINE);
-    addstr(CH_BR);
+    term_put(y, 0, &g_glyph.t_right);
+    term_hline(y, 1, &g_glyph.hline, w - 2);
+    term_put(y, w - 1, &g_glyph.t_left);
 
-    attroff(COLOR_PAIR(COLOR_BORDER));
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%s: %d", p1_name, s->score1);
+    term_text(y, 2, A_BOLD, COLOR_P1, buf);
+
+    snprintf(buf, sizeof(buf), "%d :%s", s->score2, p2_name);
+    term_text(y, w - 2 - (int)strlen(buf), A_BOLD, COLOR_P2, buf);
 }
 
-static void pong_render(void *state, const char *p1_name, const char *p2_name,
-                        bool is_spectator, int spectator_count)
+/* Bottom border, with the spectator labels on it */
+static void draw_footer(const pong_state_t *s, bool is_spectator,
+                        int spectator_count)
 {
-    pong_state_t *s = (pong_state_t *)state;
     int w = s->cols;
+    int y = s->field_bottom;
+
+    term_put(y, 0, &g_glyph.bl);
+    term_hline(y, 1, &g_glyph.hline, w - 2);
+    term_put(y, w - 1, &g_glyph.br);
 
-    draw_field(s);
+    if (is_spectator)
+        term_text(y, (w - 16) / 2, A_DIM, COLOR_DIM, " [SPECTATING] ");
+    if (spectator_count > 0) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), " %d watching ", spectator_count);
+        term_text(y, w - 18, A_DIM, COLOR_DIM, buf);
+    }
+}
 
-    /* Score header */
-    int header_y = s->field_top - 1;
+/* Moves a paddle on screen: clears the cells it left, fills the new.
+ * old_y is -1 when it isn't on screen yet. */
+static void draw_paddle(const pong_state_t *s, const pong_paddle_t *p,
+                        int old_y, const term_glyph_t *g)
+{
+    bool shown = old_y >= 0;
+    for (int y = old_y; shown && y < old_y + p->len; y++) {
+        if (y < p->y || y >= p->y + p->len)
+            draw_under(s, y, p->x);
+    }
+    for (int y = p->y; y < p->y + p->len; y++) {
+        if (!shown || y < old_y || y >= old_y + p->len)
+            term_put(y, p->x, g);
+    }
+}
 
-    attron(COLOR_PAIR(COLOR_P1) | A_BOLD);
-    mvprintw(header_y + 1, 2, "%s: %d", p1_name, s->score1);
-    attroff(COLOR_PAIR(COLOR_P1) | A_BOLD);
+static void pong_render(void *state, const char *p1_name, const char *p2_name,
+                        bool is_spectator, int spectator_count)
+{
+    pong_state_t *s = (pong_state_t *)state;
 
-    char p2buf[48];
-    snprintf(p2buf, sizeof(p2buf), "%d :%s", s->score2, p2_name);
-    attron(COLOR_PAIR(COLOR_P2) | A_BOLD);
-    mvaddstr(header_y + 1, w - 2 - (int)strlen(p2buf), p2buf);
-    attroff(COLOR_PAIR(COLOR_P2) | A_BOLD);
+    if (!g_glyph.ready)
+        build_glyphs();
+
+    /* Everything once; after that only what moved or changed */
+    if (!g_shown.valid) {
+        draw_field(s);
+        g_shown.valid = true;
+        g_shown.ball_x = g_shown.trail_x = -1;
+        g_shown.ball_y = g_shown.trail_y = -1;
+        g_shown.p1_y = g_shown.p2_y = -1;
+        g_shown.score1 = g_shown.score2 = -1;
+        g_shown.spectators = -1;
+    }
 
-    /* Ball trail (dim previous position) */
-    int px = (int)roundf(s->ball.prev_x);
-    int py = (int)roundf(s->ball.prev_y);
-    if (px > 0 && px < w - 1 && py > s->field_top && py < s->field_bottom) {
-        attron(COLOR_PAIR(COLOR_DIM) | A_DIM);
-        mvaddstr(py, px, CH_BALL);
-        attroff(COLOR_PAIR(COLOR_DIM) | A_DIM);
+    if (s->score1 != g_shown.score1 || s->score2 != g_shown.score2) {
+        draw_header(s, p1_name, p2_name);
+        g_shown.score1 = s->score1;
+        g_shown.score2 = s->score2;
     }
+    if (spectator_count != g_shown.spectators) {
+        draw_footer(s, is_spectator, spectator_count);
+        g_shown.spectators = spectator_count;
+    }
+
+    /* The ball and trail come off first, so a paddle moving through
+     * where they were is drawn over them */
+    if (g_shown.trail_x >= 0)
+        draw_under(s, g_shown.trail_y, g_shown.trail_x);
+    if (g_shown.ball_x >= 0)
+        draw_under(s, g_shown.ball_y, g_shown.ball_x);
 
-    /* Ball */
-    int bx = (int)roundf(s->ball.x);
-    int by = (int)roundf(s->ball.y);
-    if (bx > 0 && bx < w - 1 && by > s->field_top && by < s->field_bottom) {
-        attron(COLOR_PAIR(COLOR_BALL) | A_BOLD);
-        mvaddstr(by, bx, CH_BALL);
-        attroff(COLOR_PAIR(COLOR_BALL) | A_BOLD);
+    if (s->p1.y != g_shown.p1_y) {
+        draw_paddle(s, &s->p1, g_shown.p1_y, &g_glyph.paddle1);
+        g_shown.p1_y = s->p1.y;
+    }
+    if (s->p2.y != g_shown.p2_y) {
+        draw_paddle(s, &s->p2, g_shown.p2_y, &g_glyph.paddle2);
+        g_shown.p2_y = s->p2.y;
     }
 
-    /* Paddles */
-    attron(COLOR_PAIR(COLOR_P1) | A_BOLD);
-    for (int i = 0; i < s->p1.len; i++)
-        mvaddstr(s->p1.y + i, s->p1.x, CH_PADDLE);
-    attroff(COLOR_PAIR(COLOR_P1) | A_BOLD);
-
-    attron(COLOR_PAIR(COLOR_P2) | A_BOLD);
-    for (int i = 0; i < s->p2.len; i++)
-        mvaddstr(s->p2.y + i, s->p2.x, CH_PADDLE);
-    attroff(COLOR_PAIR(COLOR_P2) | A_BOLD);
-
-    /* Spectator label */
-    if (is_spectator) {
-        attron(COLOR_PAIR(COLOR_DIM) | A_DIM);
-        mvprintw(s->field_bottom, (w - 16) / 2, " [SPECTATING] ");
-        attroff(COLOR_PAIR(COLOR_DIM) | A_DIM);
+    /* Ball trail (dim previous position), then the ball */
+    int px = pong_fx_round(s->ball.prev_x);
+    int py = pong_fx_round(s->ball.prev_y);
+    g_shown.trail_x = g_shown.trail_y = -1;
+    if (in_field(s, py, px)) {
+        draw_ball(s, py, px, &g_glyph.trail);
+        g_shown.trail_x = px;
+        g_shown.trail_y = py;
     }
-    if (spectator_count > 0) {
-        attron(COLOR_PAIR(COLOR_DIM) | A_DIM);
-        mvprintw(s->field_bottom, w - 18, " %d watching ", spectator_count);
-        attroff(COLOR_PAIR(COLOR_DIM) | A_DIM);
+
+    int bx = pong_fx_round(s->ball.x);
+    int by = pong_fx_round(s->ball.y);
+    g_shown.ball_x = g_shown.ball_y = -1;
+    if (in_field(s, by, bx)) {
+        draw_ball(s, by, bx, &g_glyph.ball);
+        g_shown.ball_x = bx;
+        g_shown.ball_y = by;
     }
 
     /* Terminal bell on score */
@@ -278,50 +428,60 @@ static void pong_render(void *state, const char *p1_name, const char *p2_name,
         fflush(stdout);
     }
 }
+#endif
+
+/* ── State on the wire ──────────────────────────────────────────── */
+
+#define PONG_WIRE_FIELDS(F) \
+    F(i16, ball_x) F(i16, ball_y) F(i16, ball_vx) F(i16, ball_vy) \
+    F(i16, ball_speed) F(i16, p1_y) F(i16, p2_y) F(i16, score1) \
+    F(i16, score2) F(i16, ball_prev_x) F(i16, ball_prev_y)
+
+typedef struct { PONG_WIRE_FIELDS(PROTO_WIRE_FIELD) } pong_wire_t;
+_Static_assert(sizeof(pong_wire_t) == 22, "pong_wire_t must be its bytes and nothing else");
 
 static int pong_pack_state(const void *state, uint8_t *buf, size_t buflen)
 {
     const pong_state_t *s = (const pong_state_t *)state;
-    size_t need = 10 * sizeof(int16_t) + sizeof(int16_t);
-    if (buflen < need)
+    if (buflen < sizeof(pong_wire_t))
         return -1;
 
-    int16_t *d = (int16_t *)buf;
-    d[0] = (int16_t)(s->ball.x * 100.0f);
-    d[1] = (int16_t)(s->ball.y * 100.0f);
-    d[2] = (int16_t)(s->ball.vx * 100.0f);
-    d[3] = (int16_t)(s->ball.vy * 100.0f);
-    d[4] = (int16_t)(s->ball.speed * 100.0f);
-    d[5] = (int16_t)s->p1.y;
-    d[6] = (int16_t)s->p2.y;
-    d[7] = (int16_t)s->score1;
-    d[8] = (int16_t)s->score2;
-    d[9] = (int16_t)(s->ball.prev_x * 100.0f);
-    d[10] = (int16_t)(s->ball.prev_y * 100.0f);
-
-    return (int)need;
+    pong_wire_t *w = (pong_wire_t *)buf;
+    proto_put_i16(&w->ball_x, fx_to_wire(s->ball.x));
+    proto_put_i16(&w->ball_y, fx_to_wire(s->ball.y));
+    proto_put_i16(&w->ball_vx, fx_to_wire(s->ball.vx));
+    proto_put_i16(&w->ball_vy, fx_to_wire(s->ball.vy));
+    proto_put_i16(&w->ball_speed, fx_to_wire(s->ball.speed));
+    proto_put_i16(&w->p1_y, (int16_t)s->p1.y);
+    proto_put_i16(&w->p2_y, (int16_t)s->p2.y);
+    proto_put_i16(&w->score1, (int16_t)s->score1);
+    proto_put_i16(&w->score2, (int16_t)s->score2);
+    proto_put_i16(&w->ball_prev_x, fx_to_wire(s->ball.prev_x));
+    proto_put_i16(&w->ball_prev_y, fx_to_wire(s->ball.prev_y));
+
+    return (int)sizeof(pong_wire_t);
 }
 
 static int pong_unpack_state(void *state, const uint8_t *buf, size_t len)
 {
     pong_state_t *s = (pong_state_t *)state;
-    size_t need = 11 * sizeof(int16_t);
-    if (len < need)
+    if (len < sizeof(pong_wire_t))
         return -1;
 
-    const int16_t *d = (const int16_t *)buf;
-    s->ball.x = (float)d[0] / 100.0f;
-    s->ball.y = (float)d[1] / 100.0f;
-    s->ball.vx = (float)d[2] / 100.0f;
-    s->ball.vy = (float)d[3] / 100.0f;
-    s->ball.speed = (float)d[4] / 100.0f;
-    s->p1.y = (int)d[5];
-    s->p2.y = (int)d[6];
-    s->score1 = (int)d[7];
-    s->score2 = (int)d[8];
-    s->ball.prev_x = (float)d[9] / 100.0f;
-    s->ball.prev_y = (float)d[10] / 100.0f;
-
+    const pong_wire_t *w = (const pong_wire_t *)buf;
+    s->ball.x = fx_from_wire(proto_get_i16(&w->ball_x));
+    s->ball.y = fx_from_wire(proto_get_i16(&w->ball_y));
+    s->ball.vx = fx_from_wire(proto_get_i16(&w->ball_vx));
+    s->ball.vy = fx_from_wire(proto_get_i16(&w->ball_vy));
+    s->ball.speed = fx_from_wire(proto_get_i16(&w->ball_speed));
+    s->p1.y = (int)proto_get_i16(&w->p1_y);
+    s->p2.y = (int)proto_get_i16(&w->p2_y);
+    s->score1 = (int)proto_get_i16(&w->score1);
+    s->score2 = (int)proto_get_i16(&w->score2);
+    s->ball.prev_x = fx_from_wire(proto_get_i16(&w->ball_prev_x));
+    s->ball.prev_y = fx_from_wire(proto_get_i16(&w->ball_prev_y));
+
+#ifndef BYTES_HEADLESS
     /* Derive field dimensions from terminal if not set */
     if (s->rows == 0) {
         int rows, cols;
@@ -335,10 +495,30 @@ static int pong_unpack_state(void *state, const uint8_t *buf, size_t len)
         s->p1.len = PONG_PADDLE_LEN;
         s->p2.len = PONG_PADDLE_LEN;
     }
+#endif
 
     return 0;
 }
 
+/* Every field at full precision: the wire state rounds the ball to
+ * hundredths and leaves out the serve PRNG and held keys */
+static uint32_t pong_hash_state(const void *state)
+{
+    const pong_state_t *s = (const pong_state_t *)state;
+    const int32_t fields[] = {
+        s->ball.x, s->ball.y, s->ball.vx, s->ball.vy,
+        s->ball.prev_x, s->ball.prev_y, s->ball.speed,
+        s->p1.x, s->p1.y, s->p1.len, s->p1.held,
+        s->p2.x, s->p2.y, s->p2.len, s->p2.held,
+        s->score1, s->score2, s->rows, s->cols,
+        s->field_top, s->field_bottom, s->scored,
+    };
+    uint32_t h = GAME_HASH_INIT;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+        h = game_hash_u32(h, (uint32_t)fields[i]);
+    return game_hash_u32(h, s->rng);
+}
+
 static bool pong_is_over(const void *state)
 {
     const pong_state_t *s = (const pong_state_t *)state;
@@ -358,11 +538,19 @@ const game_def_t pong_game_def = {
     .type         = GAME_PONG,
     .state_size   = sizeof(pong_state_t),
     .init         = pong_init,
+    .seed         = pong_seed,
     .handle_input = pong_handle_input,
+    .key_action   = pong_key_action,
+    .set_held     = pong_set_held,
     .update       = pong_update,
+    .predict_tick = pong_predict_tick,
+#ifndef BYTES_HEADLESS
     .render       = pong_render,
+    .render_reset = pong_render_reset,
+#endif
     .pack_state   = pong_pack_state,
     .unpack_state = pong_unpack_state,
+    .hash_state   = pong_hash_state,
     .is_over      = pong_is_over,
     .get_winner   = pong_get_winner
 };
@@ -0,0 +1,385 @@
+#include "pong_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BATCH_ARRAYS 15   /* pointers in pong_batch_t, all 32-bit lanes */
+
+int pong_batch_init(pong_batch_t *b, int count, int rows, int cols)
+{
+    memset(b, 0, sizeof(*b));
+    if (count <= 0)
+        return -1;
+
+    b->count = count;
+    b->capacity = (count + PONG_BATCH_LANES - 1) / PONG_BATCH_LANES * PONG_BATCH_LANES;
+    int32_t *block = calloc((size_t)b->capacity * BATCH_ARRAYS, sizeof(int32_t));
+    if (block == NULL)
+        return -1;
+
+    int32_t **arrays[BATCH_ARRAYS - 1] = {
+        &b->x, &b->y, &b->vx, &b->vy, &b->prev_x, &b->prev_y, &b->speed,
+        &b->p1_y, &b->p2_y, &b->held1, &b->held2, &b->score1, &b->score2,
+        &b->scored
+    };
+    for (int a = 0; a < BATCH_ARRAYS - 1; a++)
+        *arrays[a] = block + (size_t)a * (size_t)b->capacity;
+    b->rng = (uint32_t *)(block + (size_t)(BATCH_ARRAYS - 1) * (size_t)b->capacity);
+
+    pong_state_t s;
+    pong_game_def.init(&s, rows, cols);
+    b->rows = s.rows;
+    b->cols = s.cols;
+    b->field_top = s.field_top;
+    b->field_bottom = s.field_bottom;
+    b->p1_x = s.p1.x;
+    b->p2_x = s.p2.x;
+    for (int k = 0; k < PONG_PADDLE_LEN; k++)
+        b->angle[k] = (PONG_FX(k) / PONG_PADDLE_LEN - PONG_FX_ONE / 2) * 2;
+
+    for (int i = 0; i < b->capacity; i++)
+        pong_batch_load(b, i, &s);
+    return 0;
+}
+
+void pong_batch_free(pong_batch_t *b)
+{
+    free(b->x);
+    memset(b, 0, sizeof(*b));
+}
+
+void pong_batch_load(pong_batch_t *b, int i, const pong_state_t *s)
+{
+    b->x[i] = s->ball.x;
+    b->y[i] = s->ball.y;
+    b->vx[i] = s->ball.vx;
+    b->vy[i] = s->ball.vy;
+    b->prev_x[i] = s->ball.prev_x;
+    b->prev_y[i] = s->ball.prev_y;
+    b->speed[i] = s->ball.speed;
+    b->p1_y[i] = s->p1.y;
+    b->p2_y[i] = s->p2.y;
+    b->held1[i] = s->p1.held;
+    b->held2[i] = s->p2.held;
+    b->score1[i] = s->score1;
+    b->score2[i] = s->score2;
+    b->scored[i] = s->scored;
+    b->rng[i] = s->rng;
+}
+
+void pong_batch_store(const pong_batch_t *b, int i, pong_state_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->rows = b->rows;
+    s->cols = b->cols;
+    s->field_top = b->field_top;
+    s->field_bottom = b->field_bottom;
+    s->p1.x = b->p1_x;
+    s->p2.x = b->p2_x;
+    s->p1.len = PONG_PADDLE_LEN;
+    s->p2.len = PONG_PADDLE_LEN;
+
+    s->ball.x = b->x[i];
+    s->ball.y = b->y[i];
+    s->ball.vx = b->vx[i];
+    s->ball.vy = b->vy[i];
+    s->ball.prev_x = b->prev_x[i];
+    s->ball.prev_y = b->prev_y[i];
+    s->ball.speed = b->speed[i];
+    s->p1.y = b->p1_y[i];
+    s->p2.y = b->p2_y[i];
+    s->p1.held = (uint8_t)b->held1[i];
+    s->p2.held = (uint8_t)b->held2[i];
+    s->score1 = b->score1[i];
+    s->score2 = b->score2[i];
+    s->scored = b->scored[i] != 0;
+    s->rng = b->rng[i];
+}
+
+/* ── Scalar ─────────────────────────────────────────────────────── */
+
+/* A point in game i: scores, then serves as reset_ball() in pong.c */
+static void batch_point(pong_batch_t *b, int i, bool p1_scored)
+{
+    if (p1_scored)
+        b->score1[i]++;
+    else
+        b->score2[i]++;
+    b->scored[i] = 1;
+
+    int mid_y = b->field_top + (b->field_bottom - b->field_top) / 2;
+    b->x[i] = PONG_FX(b->cols / 2);
+    b->y[i] = PONG_FX(mid_y);
+    b->speed[i] = PONG_BALL_SPEED_INIT;
+    b->vx[i] = (b->score1[i] + b->score2[i]) % 2 == 0 ? PONG_FX_ONE : -PONG_FX_ONE;
+    b->vy[i] = pong_serve_vy(&b->rng[i]);
+}
+
+static int32_t paddle_drive(const pong_batch_t *b, int32_t y, int32_t held)
+{
+    int dy = (held == PONG_HOLD_UP)   ? -PONG_PADDLE_SPEED
+           : (held == PONG_HOLD_DOWN) ?  PONG_PADDLE_SPEED : 0;
+    if (dy == 0)
+        return y;
+    y += dy;
+    if (y < b->field_top + 1)
+        y = b->field_top + 1;
+    if (y + PONG_PADDLE_LEN > b->field_bottom - 1)
+        y = b->field_bottom - 1 - PONG_PADDLE_LEN;
+    return y;
+}
+
+static void update_one(pong_batch_t *b, int i)
+{
+    b->prev_x[i] = b->x[i];
+    b->prev_y[i] = b->y[i];
+    b->scored[i] = 0;
+
+    b->p1_y[i] = paddle_drive(b, b->p1_y[i], b->held1[i]);
+    b->p2_y[i] = paddle_drive(b, b->p2_y[i], b->held2[i]);
+
+    pong_fx_t nx = b->x[i] + pong_fx_mul(b->vx[i], b->speed[i]);
+    pong_fx_t ny = b->y[i] + pong_fx_mul(b->vy[i], b->speed[i]);
+
+    if (pong_fx_trunc(ny) <= b->field_top) {
+        ny = PONG_FX(b->field_top + 1);
+        b->vy[i] = -b->vy[i];
+    }
+    if (pong_fx_trunc(ny) >= b->field_bottom - 1) {
+        ny = PONG_FX(b->field_bottom - 2);
+        b->vy[i] = -b->vy[i];
+    }
+
+    int bx = pong_fx_round(nx);
+    int by = pong_fx_round(ny);
+
+    if (bx <= b->p1_x + 1 && b->vx[i] < 0 &&
+        by >= b->p1_y[i] && by < b->p1_y[i] + PONG_PADDLE_LEN) {
+        nx = PONG_FX(b->p1_x + 2);
+        b->vx[i] = -b->vx[i];
+        b->vy[i] = b->angle[by - b->p1_y[i]];
+        b->speed[i] += PONG_BALL_SPEED_INC;
+        if (b->speed[i] > PONG_BALL_MAX_SPEED)
+            b->speed[i] = PONG_BALL_MAX_SPEED;
+    }
+    if (bx >= b->p2_x - 1 && b->vx[i] > 0 &&
+        by >= b->p2_y[i] && by < b->p2_y[i] + PONG_PADDLE_LEN) {
+        nx = PONG_FX(b->p2_x - 2);
+        b->vx[i] = -b->vx[i];
+        b->vy[i] = b->angle[by - b->p2_y[i]];
+        b->speed[i] += PONG_BALL_SPEED_INC;
+        if (b->speed[i] > PONG_BALL_MAX_SPEED)
+            b->speed[i] = PONG_BALL_MAX_SPEED;
+    }
+
+    if (bx <= 0) {
+        batch_point(b, i, false);
+        return;
+    }
+    if (bx >= b->cols - 1) {
+        batch_point(b, i, true);
+        return;
+    }
+    b->x[i] = nx;
+    b->y[i] = ny;
+}
+
+void pong_batch_update_scalar(pong_batch_t *b)
+{
+    for (int i = 0; i < b->capacity; i++)
+        update_one(b, i);
+}
+
+/* ── SSE2 ───────────────────────────────────────────────────────── */
+
+#if defined(__SSE2__)
+
+/* SSE2 has no 32-bit min, max or blend; these do with compares */
+static __m128i v_select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static __m128i v_min(__m128i a, __m128i b)
+{
+    return v_select(_mm_cmplt_epi32(a, b), a, b);
+}
+
+static __m128i v_max(__m128i a, __m128i b)
+{
+    return v_select(_mm_cmpgt_epi32(a, b), a, b);
+}
+
+static __m128i v_neg(__m128i a)
+{
+    return _mm_sub_epi32(_mm_setzero_si128(), a);
+}
+
+/* pong_fx_mul(). SSE2 only multiplies unsigned, and only the even lanes,
+ * so this multiplies magnitudes two lanes at a time and then puts the
+ * sign back, which also truncates toward zero as the division does. */
+static __m128i v_fx_mul(__m128i a, __m128i b)
+{
+    __m128i sa = _mm_srai_epi32(a, 31);
+    __m128i sb = _mm_srai_epi32(b, 31);
+    __m128i ua = _mm_sub_epi32(_mm_xor_si128(a, sa), sa);
+    __m128i ub = _mm_sub_epi32(_mm_xor_si128(b, sb), sb);
+
+    __m128i even = _mm_mul_epu32(ua, ub);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(ua, 32), _mm_srli_epi64(ub, 32));
+    even = _mm_srli_epi64(even, 16);
+    odd = _mm_slli_epi64(_mm_srli_epi64(odd, 16), 32);
+    __m128i mag = _mm_or_si128(_mm_and_si128(even, _mm_set_epi32(0, -1, 0, -1)), odd);
+
+    __m128i sign = _mm_xor_si128(sa, sb);
+    return _mm_sub_epi32(_mm_xor_si128(mag, sign), sign);
+}
+
+/* pong_fx_trunc(): negatives are biased up so the shift rounds to zero */
+static __m128i v_fx_trunc(__m128i v)
+{
+    __m128i bias = _mm_srli_epi32(_mm_srai_epi32(v, 31), 16);
+    return _mm_srai_epi32(_mm_add_epi32(v, bias), 16);
+}
+
+/* pong_fx_round(): v + 1/2, less one unit for negatives, then floor */
+static __m128i v_fx_round(__m128i v)
+{
+    __m128i half = _mm_set1_epi32(PONG_FX_ONE / 2);
+    return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(v, half),
+                                        _mm_srai_epi32(v, 31)), 16);
+}
+
+static __m128i v_paddle_drive(const pong_batch_t *b, __m128i y, __m128i held)
+{
+    __m128i up = _mm_cmpeq_epi32(held, _mm_set1_epi32(PONG_HOLD_UP));
+    __m128i down = _mm_cmpeq_epi32(held, _mm_set1_epi32(PONG_HOLD_DOWN));
+    __m128i dy = _mm_sub_epi32(_mm_and_si128(down, _mm_set1_epi32(PONG_PADDLE_SPEED)),
+                               _mm_and_si128(up, _mm_set1_epi32(PONG_PADDLE_SPEED)));
+    __m128i moved = _mm_add_epi32(y, dy);
+    moved = v_max(moved, _mm_set1_epi32(b->field_top + 1));
+    moved = v_min(moved, _mm_set1_epi32(b->field_bottom - 1 - PONG_PADDLE_LEN));
+    return v_select(_mm_or_si128(up, down), moved, y);
+}
+
+/* Bounces the lanes in hit off a paddle: k is where on it they landed */
+static void v_paddle_hit(const pong_batch_t *b, __m128i hit, __m128i k,
+                         pong_fx_t to_x, __m128i *nx, __m128i *vx,
+                         __m128i *vy, __m128i *speed)
+{
+    *nx = v_select(hit, _mm_set1_epi32(to_x), *nx);
+    *vx = v_select(hit, v_neg(*vx), *vx);
+    for (int j = 0; j < PONG_PADDLE_LEN; j++) {
+        __m128i at = _mm_and_si128(hit, _mm_cmpeq_epi32(k, _mm_set1_epi32(j)));
+        *vy = v_select(at, _mm_set1_epi32(b->angle[j]), *vy);
+    }
+    __m128i faster = v_min(_mm_add_epi32(*speed, _mm_set1_epi32(PONG_BALL_SPEED_INC)),
+                           _mm_set1_epi32(PONG_BALL_MAX_SPEED));
+    *speed = v_select(hit, faster, *speed);
+}
+
+static void update_sse2(pong_batch_t *b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i len = _mm_set1_epi32(PONG_PADDLE_LEN);
+    const __m128i top_cell = _mm_set1_epi32(b->field_top + 1);
+    const __m128i bottom_cell = _mm_set1_epi32(b->field_bottom - 2);
+    const __m128i p1_reach = _mm_set1_epi32(b->p1_x + 2);
+    const __m128i p2_reach = _mm_set1_epi32(b->p2_x - 2);
+    const __m128i left_goal = _mm_set1_epi32(1);
+    const __m128i right_goal = _mm_set1_epi32(b->cols - 2);
+
+    for (int i = 0; i < b->capacity; i += PONG_BATCH_LANES) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(b->x + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b->y + i));
+        __m128i vx = _mm_loadu_si128((const __m128i *)(b->vx + i));
+        __m128i vy = _mm_loadu_si128((const __m128i *)(b->vy + i));
+        __m128i speed = _mm_loadu_si128((const __m128i *)(b->speed + i));
+        __m128i p1y = _mm_loadu_si128((const __m128i *)(b->p1_y + i));
+        __m128i p2y = _mm_loadu_si128((const __m128i *)(b->p2_y + i));
+
+        _mm_storeu_si128((__m128i *)(b->prev_x + i), x);
+        _mm_storeu_si128((__m128i *)(b->prev_y + i), y);
+        _mm_storeu_si128((__m128i *)(b->scored + i), zero);
+
+        p1y = v_paddle_drive(b, p1y, _mm_loadu_si128((const __m128i *)(b->held1 + i)));
+        p2y = v_paddle_drive(b, p2y, _mm_loadu_si128((const __m128i *)(b->held2 + i)));
+
+        __m128i nx = _mm_add_epi32(x, v_fx_mul(vx, speed));
+        __m128i ny = _mm_add_epi32(y, v_fx_mul(vy, speed));
+
+        /* Walls, one after the other as in the scalar code */
+        __m128i wall = _mm_cmpgt_epi32(top_cell, v_fx_trunc(ny));
+        ny = v_select(wall, _mm_slli_epi32(top_cell, 16), ny);
+        vy = v_select(wall, v_neg(vy), vy);
+        wall = _mm_cmpgt_epi32(v_fx_trunc(ny), bottom_cell);
+        ny = v_select(wall, _mm_slli_epi32(bottom_cell, 16), ny);
+        vy = v_select(wall, v_neg(vy), vy);
+
+        __m128i bx = v_fx_round(nx);
+        __m128i by = v_fx_round(ny);
+
+        /* Paddles; a return off the left one has vx > 0 for the right */
+        __m128i k = _mm_sub_epi32(by, p1y);
+        __m128i hit = _mm_and_si128(_mm_cmpgt_epi32(p1_reach, bx),
+                                    _mm_cmplt_epi32(vx, zero));
+        hit = _mm_and_si128(hit, _mm_andnot_si128(_mm_cmplt_epi32(k, zero),
+                                                  _mm_cmplt_epi32(k, len)));
+        if (_mm_movemask_epi8(hit) != 0)
+            v_paddle_hit(b, hit, k, PONG_FX(b->p1_x + 2), &nx, &vx, &vy, &speed);
+
+        k = _mm_sub_epi32(by, p2y);
+        hit = _mm_and_si128(_mm_cmpgt_epi32(bx, p2_reach),
+                            _mm_cmpgt_epi32(vx, zero));
+        hit = _mm_and_si128(hit, _mm_andnot_si128(_mm_cmplt_epi32(k, zero),
+                                                  _mm_cmplt_epi32(k, len)));
+        if (_mm_movemask_epi8(hit) != 0)
+            v_paddle_hit(b, hit, k, PONG_FX(b->p2_x - 2), &nx, &vx, &vy, &speed);
+
+        _mm_storeu_si128((__m128i *)(b->x + i), nx);
+        _mm_storeu_si128((__m128i *)(b->y + i), ny);
+        _mm_storeu_si128((__m128i *)(b->vx + i), vx);
+        _mm_storeu_si128((__m128i *)(b->vy + i), vy);
+        _mm_storeu_si128((__m128i *)(b->speed + i), speed);
+        _mm_storeu_si128((__m128i *)(b->p1_y + i), p1y);
+        _mm_storeu_si128((__m128i *)(b->p2_y + i), p2y);
+
+        /* Points are rare enough to serve one game at a time */
+        __m128i left = _mm_cmpgt_epi32(left_goal, bx);
+        __m128i right = _mm_andnot_si128(left, _mm_cmpgt_epi32(bx, right_goal));
+        int goals = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(left, right)));
+        int rights = _mm_movemask_ps(_mm_castsi128_ps(right));
+        for (int l = 0; goals != 0; l++, goals >>= 1, rights >>= 1) {
+            if (goals & 1)
+                batch_point(b, i + l, (rights & 1) != 0);
+        }
+    }
+}
+
+void pong_batch_update(pong_batch_t *b)
+{
+    update_sse2(b);
+}
+
+const char *pong_batch_kernel(void)
+{
+    return "sse2";
+}
+
+#else
+
+void pong_batch_update(pong_batch_t *b)
+{
+    pong_batch_update_scalar(b);
+}
+
+const char *pong_batch_kernel(void)
+{
+    return "scalar";
+}
+
+#endif
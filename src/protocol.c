@@ -1,236 +1,238 @@
 #include "protocol.h"
 
+#include <stdalign.h>
 #include <string.h>
 
-static void write_u16_le(uint8_t *buf, uint16_t val)
-{
-    buf[0] = (uint8_t)(val & 0xFF);
-    buf[1] = (uint8_t)((val >> 8) & 0xFF);
-}
-
-static uint16_t read_u16_le(const uint8_t *buf)
-{
-    return (uint16_t)(buf[0] | (buf[1] << 8));
-}
-
-static void write_i32_le(uint8_t *buf, int32_t val)
-{
-    uint32_t u;
-    memcpy(&u, &val, sizeof(u));
-    buf[0] = (uint8_t)(u & 0xFF);
-    buf[1] = (uint8_t)((u >> 8) & 0xFF);
-    buf[2] = (uint8_t)((u >> 16) & 0xFF);
-    buf[3] = (uint8_t)((u >> 24) & 0xFF);
-}
-
-static int32_t read_i32_le(const uint8_t *buf)
-{
-    uint32_t u = (uint32_t)buf[0]
-               | ((uint32_t)buf[1] << 8)
-               | ((uint32_t)buf[2] << 16)
-               | ((uint32_t)buf[3] << 24);
-    int32_t val;
-    memcpy(&val, &u, sizeof(val));
-    return val;
-}
-
-static void safe_copy_name(char *dst, const char *src)
-{
-    strncpy(dst, src, MAX_NAME_LEN - 1);
-    dst[MAX_NAME_LEN - 1] = '\0';
-}
+/* ── Generated messages ─────────────────────────────────────────── */
+
+#define PROTO_SIZE_u8   1
+#define PROTO_SIZE_u16  2
+#define PROTO_SIZE_i16  2
+#define PROTO_SIZE_u32  4
+#define PROTO_SIZE_i32  4
+#define PROTO_SIZE_u64  8
+#define PROTO_SIZE_name MAX_NAME_LEN
+
+#define PROTO_SIZE(kind, f)  + PROTO_SIZE_##kind
+#define PROTO_PUT(kind, f)   proto_put_##kind(&w->f, f);
+
+#define PROTO_GET_u8(f)   out->f = proto_get_u8(&w->f);
+#define PROTO_GET_u16(f)  out->f = proto_get_u16(&w->f);
+#define PROTO_GET_i16(f)  out->f = proto_get_i16(&w->f);
+#define PROTO_GET_u32(f)  out->f = proto_get_u32(&w->f);
+#define PROTO_GET_i32(f)  out->f = proto_get_i32(&w->f);
+#define PROTO_GET_u64(f)  out->f = proto_get_u64(&w->f);
+#define PROTO_GET_name(f) proto_get_name(&w->f, out->f);
+#define PROTO_GET(kind, f) \
+    if (PROTO_FIELD_END(w, f) <= len) \
+        PROTO_GET_##kind(f)
+
+#define PROTO_DEFINE(msg, TYPE, last) \
+    _Static_assert(sizeof(msg_##msg##_wire_t) == 0 MSG_##TYPE##_FIELDS(PROTO_SIZE) && \
+                   alignof(msg_##msg##_wire_t) == 1, \
+                   "msg_" #msg "_wire_t must be its bytes and nothing else"); \
+    \
+    int proto_pack_##msg(uint8_t *buf, size_t buflen \
+                         MSG_##TYPE##_FIELDS(PROTO_ARG)) \
+    { \
+        if (buflen < MSG_HEADER_SIZE + (size_t)MSG_##TYPE##_SIZE) \
+            return -1; \
+        proto_pack_header(buf, buflen, MSG_##TYPE, MSG_##TYPE##_SIZE); \
+        msg_##msg##_wire_t *w = (msg_##msg##_wire_t *)(buf + MSG_HEADER_SIZE); \
+        MSG_##TYPE##_FIELDS(PROTO_PUT) \
+        return MSG_HEADER_SIZE + MSG_##TYPE##_SIZE; \
+    } \
+    \
+    int proto_unpack_##msg(const uint8_t *payload, size_t len, \
+                           msg_##msg##_t *out) \
+    { \
+        if (len < MSG_##TYPE##_MIN) \
+            return -1; \
+        const msg_##msg##_wire_t *w = (const msg_##msg##_wire_t *)payload; \
+        memset(out, 0, sizeof(*out)); \
+        MSG_##TYPE##_FIELDS(PROTO_GET) \
+        return 0; \
+    }
+
+PROTO_MESSAGES(PROTO_DEFINE)
+
+/* ── Hand-written messages ──────────────────────────────────────── */
 
 int proto_pack_header(uint8_t *buf, size_t buflen, uint8_t type, uint16_t payload_len)
 {
     if (buflen < MSG_HEADER_SIZE)
         return -1;
     buf[0] = type;
-    write_u16_le(buf + 1, payload_len);
+    buf[1] = (uint8_t)(payload_len & 0xFF);
+    buf[2] = (uint8_t)(payload_len >> 8);
     return MSG_HEADER_SIZE;
 }
 
-int proto_pack_hello(uint8_t *buf, size_t buflen, const char *name, uint8_t role)
+int proto_unpack_header(const uint8_t *buf, size_t len, msg_header_t *hdr)
 {
-    uint16_t plen = MAX_NAME_LEN + 1;
-    if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
+    if (len < MSG_HEADER_SIZE)
         return -1;
-
-    proto_pack_header(buf, buflen, MSG_HELLO, plen);
-    uint8_t *p = buf + MSG_HEADER_SIZE;
-    memset(p, 0, MAX_NAME_LEN);
-    safe_copy_name((char *)p, name);
-    p[MAX_NAME_LEN] = role;
-
-    return MSG_HEADER_SIZE + plen;
+    hdr->type = buf[0];
+    hdr->payload_len = (uint16_t)(buf[1] | (buf[2] << 8));
+    return 0;
 }
 
-int proto_pack_welcome(uint8_t *buf, size_t buflen, const char *host_name,
-                       const char *opponent_name, uint8_t assigned_id)
+int proto_pack_resume(uint8_t *buf, size_t buflen)
 {
-    uint16_t plen = MAX_NAME_LEN * 2 + 1;
-    if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
+    if (buflen < MSG_HEADER_SIZE)
         return -1;
-
-    proto_pack_header(buf, buflen, MSG_WELCOME, plen);
-    uint8_t *p = buf + MSG_HEADER_SIZE;
-    memset(p, 0, MAX_NAME_LEN * 2);
-    safe_copy_name((char *)p, host_name);
-    safe_copy_name((char *)(p + MAX_NAME_LEN), opponent_name);
-    p[MAX_NAME_LEN * 2] = assigned_id;
-
-    return MSG_HEADER_SIZE + plen;
+    return proto_pack_header(buf, buflen, MSG_RESUME, 0);
 }
 
-int proto_pack_game_start(uint8_t *buf, size_t buflen, uint8_t game_type,
-                          const char *p1_name, const char *p2_name)
+int proto_pack_quit(uint8_t *buf, size_t buflen)
 {
-    uint16_t plen = 1 + MAX_NAME_LEN * 2;
-    if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
+    if (buflen < MSG_HEADER_SIZE)
         return -1;
-
-    proto_pack_header(buf, buflen, MSG_GAME_START, plen);
-    uint8_t *p = buf + MSG_HEADER_SIZE;
-    p[0] = game_type;
-    memset(p + 1, 0, MAX_NAME_LEN * 2);
-    safe_copy_name((char *)(p + 1), p1_name);
-    safe_copy_name((char *)(p + 1 + MAX_NAME_LEN), p2_name);
-
-    return MSG_HEADER_SIZE + plen;
+    return proto_pack_header(buf, buflen, MSG_QUIT, 0);
 }
 
-int proto_pack_input(uint8_t *buf, size_t buflen, int32_t key)
+int proto_pack_snapshot(uint8_t *buf, size_t buflen, uint32_t tick, uint8_t base_age,
+                        const uint8_t *body, uint16_t body_len)
 {
-    uint16_t plen = 4;
-    if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
+    if (buflen < MSG_SNAPSHOT_BODY + (size_t)body_len)
         return -1;
-
-    proto_pack_header(buf, buflen, MSG_INPUT, plen);
-    write_i32_le(buf + MSG_HEADER_SIZE, key);
-
-    return MSG_HEADER_SIZE + plen;
+    memmove(buf + MSG_SNAPSHOT_BODY, body, body_len);
+    return proto_finish_snapshot(buf, buflen, tick, base_age, body_len);
 }
 
-int proto_pack_state(uint8_t *buf, size_t buflen, const uint8_t *state_data, uint16_t state_len)
+int proto_finish_snapshot(uint8_t *buf, size_t buflen, uint32_t tick,
+                          uint8_t base_age, uint16_t body_len)
 {
-    if (buflen < (size_t)(MSG_HEADER_SIZE + state_len))
+    size_t plen = 4 + 1 + (size_t)body_len;
+    if (plen > MAX_MSG_PAYLOAD || buflen < MSG_HEADER_SIZE + plen)
         return -1;
 
-    proto_pack_header(buf, buflen, MSG_STATE, state_len);
-    memcpy(buf + MSG_HEADER_SIZE, state_data, state_len);
+    proto_pack_header(buf, buflen, MSG_SNAPSHOT, (uint16_t)plen);
+    uint8_t *p = buf + MSG_HEADER_SIZE;
+    proto_put_le32(p, tick);
+    p[4] = base_age;
 
-    return MSG_HEADER_SIZE + state_len;
+    return (int)(MSG_HEADER_SIZE + plen);
 }
 
-int proto_pack_game_over(uint8_t *buf, size_t buflen, uint8_t winner_id, const char *winner_name)
+int proto_pack_udp_input(uint8_t *buf, size_t buflen, uint32_t seq,
+                         const int32_t *keys, uint8_t count)
 {
-    uint16_t plen = 1 + MAX_NAME_LEN;
+    if (count > UDP_INPUT_REDUNDANCY)
+        count = UDP_INPUT_REDUNDANCY;
+    uint16_t plen = (uint16_t)(4 + 1 + 4 * count);
     if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
         return -1;
 
-    proto_pack_header(buf, buflen, MSG_GAME_OVER, plen);
+    proto_pack_header(buf, buflen, MSG_UDP_INPUT, plen);
     uint8_t *p = buf + MSG_HEADER_SIZE;
-    p[0] = winner_id;
-    memset(p + 1, 0, MAX_NAME_LEN);
-    safe_copy_name((char *)(p + 1), winner_name);
+    proto_put_le32(p, seq);
+    p[4] = count;
+    for (int i = 0; i < count; i++)
+        proto_put_i32((proto_i32_t *)(p + 5 + 4 * i), keys[i]);
 
     return MSG_HEADER_SIZE + plen;
 }
 
-int proto_pack_pause(uint8_t *buf, size_t buflen, uint8_t reason)
+int proto_pack_lockstep_input(uint8_t *buf, size_t buflen,
+                              const msg_lockstep_input_t *in)
 {
-    uint16_t plen = 1;
-    if (buflen < (size_t)(MSG_HEADER_SIZE + plen))
+    if (in->count > LOCKSTEP_WINDOW)
         return -1;
-
-    proto_pack_header(buf, buflen, MSG_PAUSE, plen);
-    buf[MSG_HEADER_SIZE] = reason;
-
-    return MSG_HEADER_SIZE + plen;
-}
-
-int proto_pack_resume(uint8_t *buf, size_t buflen)
-{
-    if (buflen < MSG_HEADER_SIZE)
+    size_t plen = 10;
+    for (int i = 0; i < in->count; i++)
+        plen += (in->keys[i] != -1) ? 5 : 1;
+    if (buflen < MSG_HEADER_SIZE + plen)
         return -1;
-    return proto_pack_header(buf, buflen, MSG_RESUME, 0);
-}
 
-int proto_pack_quit(uint8_t *buf, size_t buflen)
-{
-    if (buflen < MSG_HEADER_SIZE)
-        return -1;
-    return proto_pack_header(buf, buflen, MSG_QUIT, 0);
-}
+    proto_pack_header(buf, buflen, MSG_LOCKSTEP_INPUT, (uint16_t)plen);
+    uint8_t *p = buf + MSG_HEADER_SIZE;
+    proto_put_le32(p, in->tick);
+    proto_put_le32(p + 4, in->ack);
+    p[8] = (uint8_t)in->advantage;
+    p[9] = in->count;
+    p += 10;
+    for (int i = 0; i < in->count; i++) {
+        uint8_t held = in->held[i] & (uint8_t)~MSG_LOCKSTEP_KEY;
+        if (in->keys[i] == -1) {
+            *p++ = held;
+        } else {
+            *p++ = held | MSG_LOCKSTEP_KEY;
+            proto_put_i32((proto_i32_t *)p, in->keys[i]);
+            p += 4;
+        }
+    }
 
-int proto_unpack_header(const uint8_t *buf, size_t len, msg_header_t *hdr)
-{
-    if (len < MSG_HEADER_SIZE)
-        return -1;
-    hdr->type = buf[0];
-    hdr->payload_len = read_u16_le(buf + 1);
-    return 0;
+    return MSG_HEADER_SIZE + (int)plen;
 }
 
-int proto_unpack_hello(const uint8_t *payload, size_t len, msg_hello_t *out)
+int proto_unpack_snapshot(const uint8_t *payload, size_t len, msg_snapshot_t *out)
 {
-    if (len < (size_t)(MAX_NAME_LEN + 1))
+    if (len < 5)
         return -1;
-    memset(out, 0, sizeof(*out));
-    memcpy(out->name, payload, MAX_NAME_LEN);
-    out->name[MAX_NAME_LEN - 1] = '\0';
-    out->role = payload[MAX_NAME_LEN];
-    return 0;
+    out->tick = proto_le32(payload);
+    out->base_age = payload[4];
+    return 5;
 }
 
-int proto_unpack_welcome(const uint8_t *payload, size_t len, msg_welcome_t *out)
+int proto_unpack_udp_input(const uint8_t *payload, size_t len, msg_udp_input_t *out)
 {
-    if (len < (size_t)(MAX_NAME_LEN * 2 + 1))
+    if (len < 5)
         return -1;
     memset(out, 0, sizeof(*out));
-    memcpy(out->host_name, payload, MAX_NAME_LEN);
-    out->host_name[MAX_NAME_LEN - 1] = '\0';
-    memcpy(out->opponent_name, payload + MAX_NAME_LEN, MAX_NAME_LEN);
-    out->opponent_name[MAX_NAME_LEN - 1] = '\0';
-    out->assigned_id = payload[MAX_NAME_LEN * 2];
-    return 0;
-}
-
-int proto_unpack_game_start(const uint8_t *payload, size_t len, msg_game_start_t *out)
-{
-    if (len < (size_t)(1 + MAX_NAME_LEN * 2))
+    out->seq = proto_le32(payload);
+    out->count = payload[4];
+    if (out->count > UDP_INPUT_REDUNDANCY || len < (size_t)(5 + 4 * out->count))
         return -1;
-    memset(out, 0, sizeof(*out));
-    out->game_type = payload[0];
-    memcpy(out->p1_name, payload + 1, MAX_NAME_LEN);
-    out->p1_name[MAX_NAME_LEN - 1] = '\0';
-    memcpy(out->p2_name, payload + 1 + MAX_NAME_LEN, MAX_NAME_LEN);
-    out->p2_name[MAX_NAME_LEN - 1] = '\0';
+    for (int i = 0; i < out->count; i++)
+        out->keys[i] = proto_get_i32((const proto_i32_t *)(payload + 5 + 4 * i));
     return 0;
 }
 
-int proto_unpack_input(const uint8_t *payload, size_t len, msg_input_t *out)
+int proto_unpack_lockstep_input(const uint8_t *payload, size_t len,
+                                msg_lockstep_input_t *out)
 {
-    if (len < 4)
+    if (len < 10)
         return -1;
-    out->key = read_i32_le(payload);
+    memset(out, 0, sizeof(*out));
+    out->tick = proto_le32(payload);
+    out->ack = proto_le32(payload + 4);
+    out->advantage = (int8_t)payload[8];
+    out->count = payload[9];
+    if (out->count > LOCKSTEP_WINDOW)
+        return -1;
+
+    size_t off = 10;
+    for (int i = 0; i < out->count; i++) {
+        if (off >= len)
+            return -1;
+        uint8_t held = payload[off++];
+        out->held[i] = held & (uint8_t)~MSG_LOCKSTEP_KEY;
+        out->keys[i] = -1;
+        if (held & MSG_LOCKSTEP_KEY) {
+            if (off + 4 > len)
+                return -1;
+            out->keys[i] = proto_get_i32((const proto_i32_t *)(payload + off));
+            off += 4;
+        }
+    }
     return 0;
 }
 
-int proto_unpack_game_over(const uint8_t *payload, size_t len, msg_game_over_t *out)
+int proto_pack_input_seqs(uint8_t *body, size_t len, const uint32_t seqs[2])
 {
-    if (len < (size_t)(1 + MAX_NAME_LEN))
+    if (len < MSG_SNAPSHOT_INPUTS)
         return -1;
-    memset(out, 0, sizeof(*out));
-    out->winner_id = payload[0];
-    memcpy(out->winner_name, payload + 1, MAX_NAME_LEN);
-    out->winner_name[MAX_NAME_LEN - 1] = '\0';
-    return 0;
+    proto_put_le32(body, seqs[0]);
+    proto_put_le32(body + 4, seqs[1]);
+    return MSG_SNAPSHOT_INPUTS;
 }
 
-int proto_unpack_pause(const uint8_t *payload, size_t len, msg_pause_t *out)
+int proto_unpack_input_seqs(const uint8_t *body, size_t len, uint32_t seqs[2])
 {
-    if (len < 1)
+    if (len < MSG_SNAPSHOT_INPUTS)
         return -1;
-    out->reason = payload[0];
-    return 0;
+    seqs[0] = proto_le32(body);
+    seqs[1] = proto_le32(body + 4);
+    return MSG_SNAPSHOT_INPUTS;
 }
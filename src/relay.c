@@ -0,0 +1,422 @@
+#include "relay.h"
+#include "game.h"
+#include "protocol.h"
+#include "snapshot.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RELAY_MAX_EVENTS 256
+
+typedef struct {
+    const relay_config_t *cfg;
+    net_loop_t         loop;
+    bytes_socket_t     listen_fd;
+    net_connection_t   upstream;
+    msg_welcome_t      welcome;
+    net_server_t       groups[RELAY_GROUPS];
+    net_frame_pool_t   frames;       /* shared by every group's queues */
+    int                viewers;
+    const game_def_t  *def;          /* known once MSG_GAME_START arrives */
+    snapshot_history_t history;
+    uint8_t            start_frame[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    int                start_len;
+    bool               paused;
+    bool               done;
+} relay_t;
+
+static void relay_log(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+    fflush(stdout);
+}
+
+/* ── Downstream ─────────────────────────────────────────────────── */
+
+/* Sends from one pass of the loop go out together, per viewer */
+static void relay_batch(relay_t *r, bool begin)
+{
+    for (int g = 0; g < RELAY_GROUPS; g++) {
+        if (begin)
+            net_server_begin_batch(&r->groups[g]);
+        else
+            net_server_end_batch(&r->groups[g]);
+    }
+}
+
+static void relay_send_all(relay_t *r, const uint8_t *buf, int n)
+{
+    net_frame_t *f = (n > 0) ? net_frame_copy(&r->frames, buf, (size_t)n) : NULL;
+    if (f == NULL)
+        return;
+
+    for (int g = 0; g < RELAY_GROUPS; g++) {
+        net_server_t *srv = &r->groups[g];
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (srv->clients[i].connected && srv->clients[i].greeted)
+                net_server_send_frame(srv, i, f);
+        }
+    }
+    net_frame_release(f);
+}
+
+static void relay_accept(relay_t *r)
+{
+    for (;;) {
+        bytes_socket_t fd = net_loop_accept(&r->loop, r->listen_fd);
+        if (fd == BYTES_INVALID_SOCKET)
+            return;
+
+        int g = 0;
+        while (g < RELAY_GROUPS && net_server_adopt(&r->groups[g], fd) < 0)
+            g++;
+        if (g == RELAY_GROUPS) {
+            relay_log("Relay full, turning a viewer away.");
+            platform_close_socket(fd);
+        }
+    }
+}
+
+static void relay_greet(relay_t *r, net_server_t *srv, int idx,
+                        const msg_hello_t *hello)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    net_client_t *c = &srv->clients[idx];
+
+    c->greeted = true;
+    strncpy(c->name, hello->name, MAX_NAME_LEN - 1);
+    r->viewers++;
+
+    /* Whatever the viewer asked for, it gets to watch */
+    int n = proto_pack_welcome(buf, sizeof(buf), r->welcome.host_name,
+                               r->welcome.opponent_name, 0);
+    if (n > 0)
+        net_server_send(srv, idx, buf, (size_t)n);
+    if (r->start_len > 0)
+        net_server_send(srv, idx, r->start_frame, (size_t)r->start_len);
+    if (r->paused) {
+        n = proto_pack_pause(buf, sizeof(buf), 0);
+        if (n > 0)
+            net_server_send(srv, idx, buf, (size_t)n);
+    }
+
+    relay_log("Viewer '%s' joined (%d watching).", c->name, r->viewers);
+}
+
+static void relay_read_viewer(relay_t *r, net_server_t *srv, int idx)
+{
+    const uint8_t *recv_buf;
+
+    while (srv->clients[idx].connected) {
+        net_client_t *c = &srv->clients[idx];
+        int rr = net_recv_frame(c->fd, &c->rx, &recv_buf, 0);
+        if (rr == 0)
+            return;
+        if (rr < 0) {
+            net_server_close_client(srv, idx);
+            return;
+        }
+
+        msg_header_t hdr;
+        proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+        const uint8_t *payload = recv_buf + MSG_HEADER_SIZE;
+
+        if (!c->greeted) {
+            msg_hello_t hello;
+            if (hdr.type == MSG_HELLO &&
+                proto_unpack_hello(payload, hdr.payload_len, &hello) == 0)
+                relay_greet(r, srv, idx, &hello);
+            continue;
+        }
+
+        msg_state_ack_t ack;
+        const msg_ping_wire_t *ping;
+        if (hdr.type == MSG_STATE_ACK &&
+            proto_unpack_state_ack(payload, hdr.payload_len, &ack) == 0) {
+            snapshot_note_ack(c, ack.tick);
+        } else if (hdr.type == MSG_PING &&
+                   (ping = proto_view_ping(payload, hdr.payload_len)) != NULL) {
+            /* Viewers measure the hop to the relay, not to the server */
+            uint8_t buf[MSG_HEADER_SIZE + MSG_PONG_SIZE];
+            int n = proto_pack_pong(buf, sizeof(buf), proto_get_u32(&ping->seq),
+                                    proto_get_u64(&ping->time_us));
+            if (n > 0)
+                net_server_send(srv, idx, buf, (size_t)n);
+        }
+    }
+}
+
+/* Viewers closed by a read or a failed send */
+static void relay_reap(relay_t *r)
+{
+    for (int g = 0; g < RELAY_GROUPS; g++) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            net_client_t *c = &r->groups[g].clients[i];
+            if (c->connected || !c->greeted)
+                continue;
+            c->greeted = false;
+            r->viewers--;
+            relay_log("Viewer '%s' left (%d watching).", c->name, r->viewers);
+        }
+    }
+}
+
+/* ── Upstream ───────────────────────────────────────────────────── */
+
+static void relay_ack_upstream(relay_t *r, uint32_t tick)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MSG_STATE_ACK_SIZE];
+    int n = proto_pack_state_ack(buf, sizeof(buf), tick);
+    if (n > 0)
+        net_send(r->upstream.fd, buf, (size_t)n, 100);
+}
+
+static void relay_publish(relay_t *r, bool *fresh)
+{
+    if (!*fresh)
+        return;
+    *fresh = false;
+
+    net_frame_t *key = snapshot_keyframe(&r->history, &r->frames);
+    if (key == NULL)
+        return;
+
+    /* One fan-out across all groups, so viewers on the same baseline
+     * share a frame wherever they sit */
+    snapshot_fanout_t fo;
+    snapshot_fanout_begin(&fo, r->def, &r->history, key);
+    for (int g = 0; g < RELAY_GROUPS; g++)
+        snapshot_fanout_send(&fo, &r->groups[g], -1);
+    snapshot_fanout_end(&fo);
+}
+
+/* Snapshots are decoded against the relay's own history and re-encoded
+ * per viewer against what each of them acknowledged; everything else
+ * is passed through untouched. */
+static void relay_read_upstream(relay_t *r)
+{
+    const uint8_t *recv_buf;
+    int64_t ack = -1;
+    bool fresh = false;
+
+    while (!r->done) {
+        int rr = net_recv_frame(r->upstream.fd, &r->upstream.rx, &recv_buf, 0);
+        if (rr == 0)
+            break;
+        if (rr < 0) {
+            uint8_t buf[MSG_HEADER_SIZE];
+            relay_send_all(r, buf, proto_pack_quit(buf, sizeof(buf)));
+            relay_log("Lost the upstream connection.");
+            r->done = true;
+            break;
+        }
+
+        msg_header_t hdr;
+        proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+        const uint8_t *payload = recv_buf + MSG_HEADER_SIZE;
+
+        switch (hdr.type) {
+        case MSG_GAME_START: {
+            msg_game_start_t start;
+            if (proto_unpack_game_start(payload, hdr.payload_len, &start) < 0)
+                break;
+            r->def = game_get_def((game_type_t)start.game_type);
+            if (r->def == NULL) {
+                relay_log("Upstream started unknown game type %d.",
+                          start.game_type);
+                r->done = true;
+                break;
+            }
+            memcpy(r->start_frame, recv_buf, (size_t)rr);
+            r->start_len = rr;
+            snapshot_history_reset(&r->history);
+            relay_send_all(r, recv_buf, rr);
+            relay_log("Match started: %s vs %s.", start.p1_name, start.p2_name);
+            break;
+        }
+        case MSG_SNAPSHOT: {
+            if (r->def == NULL)
+                break;
+            int n = snapshot_unpack(r->def, &r->history, payload, hdr.payload_len);
+            if (n < 0) {
+                ack = 0;
+            } else if (n > 0) {
+                ack = r->history.latest;
+                fresh = true;
+            }
+            break;
+        }
+        case MSG_PAUSE:
+        case MSG_RESUME:
+            r->paused = (hdr.type == MSG_PAUSE);
+            relay_publish(r, &fresh);
+            relay_send_all(r, recv_buf, rr);
+            break;
+        case MSG_GAME_OVER:
+        case MSG_QUIT:
+            relay_publish(r, &fresh);
+            relay_send_all(r, recv_buf, rr);
+            relay_log("Match over.");
+            r->done = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (ack >= 0)
+        relay_ack_upstream(r, (uint32_t)ack);
+    relay_publish(r, &fresh);
+}
+
+static int relay_connect(relay_t *r)
+{
+    const relay_config_t *cfg = r->cfg;
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+
+    if (net_client_connect(&r->upstream, cfg->host, cfg->upstream_port) < 0) {
+        relay_log("Cannot reach %s:%d.", cfg->host, cfg->upstream_port);
+        return -1;
+    }
+
+    int n = proto_pack_hello(buf, sizeof(buf), "relay", ROLE_SPECTATOR, cfg->room);
+    if (n <= 0 || net_send(r->upstream.fd, buf, (size_t)n, 1000) < 0)
+        return -1;
+
+    msg_header_t hdr;
+    int rr = net_recv(r->upstream.fd, buf, sizeof(buf), 5000);
+    if (rr <= 0 ||
+        proto_unpack_header(buf, (size_t)rr, &hdr) < 0 ||
+        hdr.type != MSG_WELCOME ||
+        proto_unpack_welcome(buf + MSG_HEADER_SIZE, hdr.payload_len,
+                             &r->welcome) < 0) {
+        relay_log("No welcome from %s:%d.", cfg->host, cfg->upstream_port);
+        return -1;
+    }
+    return 0;
+}
+
+/* ── Entry point ────────────────────────────────────────────────── */
+
+static int relay_open(relay_t *r)
+{
+    const relay_config_t *cfg = r->cfg;
+
+    if (net_loop_init(&r->loop, RELAY_GROUPS * MAX_CLIENTS + 2) < 0 ||
+        net_frame_pool_init(&r->frames,
+                            NET_FRAME_POOL_SIZE(RELAY_GROUPS * MAX_CLIENTS)) < 0)
+        return -1;
+    if (cfg->io_uring && net_loop_use_uring(&r->loop) < 0)
+        relay_log("io_uring unavailable, using epoll.");
+    if (relay_connect(r) < 0)
+        return -1;
+
+    r->listen_fd = net_listen(cfg->port, 128);
+    if (r->listen_fd == BYTES_INVALID_SOCKET) {
+        relay_log("Failed to listen on port %d.", cfg->port);
+        return -1;
+    }
+
+    if (net_loop_add(&r->loop, r->listen_fd, NET_TAG_LISTEN) < 0 ||
+        net_loop_add_stream(&r->loop, r->upstream.fd, NET_TAG_UPSTREAM,
+                            &r->upstream.rx) < 0)
+        return -1;
+
+    for (int g = 0; g < RELAY_GROUPS; g++) {
+        r->groups[g].loop = &r->loop;
+        r->groups[g].tag_base = g * MAX_CLIENTS;
+        r->groups[g].overflow = cfg->overflow;
+        r->groups[g].pool = &r->frames;
+    }
+    return 0;
+}
+
+static void relay_close(relay_t *r)
+{
+    for (int g = 0; g < RELAY_GROUPS; g++)
+        net_server_shutdown(&r->groups[g]);
+    if (r->listen_fd != BYTES_INVALID_SOCKET)
+        platform_close_socket(r->listen_fd);
+    net_client_disconnect(&r->upstream);
+    net_loop_close(&r->loop);
+    net_frame_pool_close(&r->frames);
+}
+
+/* Gives viewers a moment to take the final frames */
+static void relay_drain(relay_t *r, int timeout_ms)
+{
+    int64_t deadline = platform_mono_us() + (int64_t)timeout_ms * 1000;
+
+    for (int g = 0; g < RELAY_GROUPS; g++) {
+        int64_t left = deadline - platform_mono_us();
+        if (left <= 0)
+            return;
+        net_server_drain(&r->groups[g], (int)(left / 1000));
+    }
+}
+
+int relay_run(const relay_config_t *cfg, volatile int *quit)
+{
+    platform_raise_fd_limit();
+
+    relay_t *r = calloc(1, sizeof(relay_t));
+    if (r == NULL)
+        return -1;
+    r->cfg = cfg;
+    r->loop.epoll_fd = -1;
+    r->listen_fd = BYTES_INVALID_SOCKET;
+    r->upstream.fd = BYTES_INVALID_SOCKET;
+    for (int g = 0; g < RELAY_GROUPS; g++)
+        net_server_reset(&r->groups[g]);
+
+    if (relay_open(r) < 0) {
+        relay_close(r);
+        free(r);
+        return -1;
+    }
+
+    relay_log("Relaying %s:%d%s%s on port %d, up to %d viewers.",
+              cfg->host, cfg->upstream_port, cfg->room[0] ? "/" : "",
+              cfg->room, cfg->port, RELAY_GROUPS * MAX_CLIENTS);
+
+    /* Anything already buffered upstream won't raise another edge */
+    relay_read_upstream(r);
+
+    net_event_t events[RELAY_MAX_EVENTS];
+    while (!*quit && !r->done) {
+        relay_batch(r, false);
+        int nev = net_loop_wait(&r->loop, events, RELAY_MAX_EVENTS, 1000);
+        relay_batch(r, true);
+
+        for (int i = 0; i < nev && !r->done; i++) {
+            int tag = events[i].tag;
+            if (tag == NET_TAG_LISTEN) {
+                relay_accept(r);
+            } else if (tag == NET_TAG_UPSTREAM) {
+                relay_read_upstream(r);
+            } else if (tag >= 0 && tag < RELAY_GROUPS * MAX_CLIENTS) {
+                net_server_t *srv = &r->groups[tag / MAX_CLIENTS];
+                int idx = tag % MAX_CLIENTS;
+                if (events[i].events & NET_EV_WRITE)
+                    net_server_flush(srv, idx);
+                if (events[i].events & NET_EV_READ)
+                    relay_read_viewer(r, srv, idx);
+            }
+        }
+        relay_reap(r);
+    }
+
+    relay_batch(r, false);
+    relay_drain(r, 500);
+    relay_close(r);
+    free(r);
+
+    relay_log("Relay stopped.");
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include "replay.h"
+#include "platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC      "BYTESRPL"
+#define REPLAY_IDX_MAGIC  "BYTESIDX"
+#define REPLAY_HEADER     18     /* magic .. cols, start frame length */
+#define REPLAY_REC_HEADER 7
+#define REPLAY_FOOTER     16
+
+static void put_u16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t)(val & 0xFF);
+    buf[1] = (uint8_t)(val >> 8);
+}
+
+static void put_u32(uint8_t *buf, uint32_t val)
+{
+    put_u16(buf, (uint16_t)(val & 0xFFFF));
+    put_u16(buf + 2, (uint16_t)(val >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *buf)
+{
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+    return (uint32_t)get_u16(buf) | ((uint32_t)get_u16(buf + 2) << 16);
+}
+
+/* ── Recording ──────────────────────────────────────────────────── */
+
+replay_writer_t *replay_writer_open(const char *path, const game_def_t *def,
+                                    const uint8_t *start, size_t start_len,
+                                    int rows, int cols)
+{
+    if (start_len > MSG_HEADER_SIZE + MAX_MSG_PAYLOAD)
+        return NULL;
+
+    replay_writer_t *w = calloc(1, sizeof(*w));
+    if (w == NULL)
+        return NULL;
+    w->fp = fopen(path, "wb");
+    if (w->fp == NULL) {
+        free(w);
+        return NULL;
+    }
+    w->def = def;
+
+    uint8_t hdr[REPLAY_HEADER];
+    memcpy(hdr, REPLAY_MAGIC, 8);
+    put_u16(hdr + 8, REPLAY_VERSION);
+    put_u16(hdr + 10, TICK_RATE_HZ);
+    put_u16(hdr + 12, (uint16_t)rows);
+    put_u16(hdr + 14, (uint16_t)cols);
+    put_u16(hdr + 16, (uint16_t)start_len);
+    if (fwrite(hdr, 1, sizeof(hdr), w->fp) != sizeof(hdr) ||
+        fwrite(start, 1, start_len, w->fp) != start_len) {
+        fclose(w->fp);
+        free(w);
+        return NULL;
+    }
+    w->offset = (uint32_t)(sizeof(hdr) + start_len);
+    return w;
+}
+
+static void writer_record(replay_writer_t *w, uint8_t kind, uint32_t tick,
+                          const uint8_t *data, size_t len)
+{
+    uint8_t rec[REPLAY_REC_HEADER];
+    rec[0] = kind;
+    put_u32(rec + 1, tick);
+    put_u16(rec + 5, (uint16_t)len);
+    fwrite(rec, 1, sizeof(rec), w->fp);
+    fwrite(data, 1, len, w->fp);
+    w->offset += (uint32_t)(sizeof(rec) + len);
+}
+
+void replay_writer_tick(replay_writer_t *w, const snapshot_history_t *h)
+{
+    const snapshot_frame_t *cur = snapshot_history_get(h, h->latest);
+    if (cur == NULL)
+        return;
+
+    const game_def_t *def = w->def;
+    bool key_due = w->prev_len == 0 ||
+                   cur->tick - w->last_key >= REPLAY_KEYFRAME_TICKS;
+    uint8_t delta[MAX_MSG_PAYLOAD];
+    int n = -1;
+    if (!key_due) {
+        n = (def->delta_encode != NULL)
+          ? def->delta_encode(w->prev, w->prev_len, cur->data, cur->len,
+                              delta, sizeof(delta))
+          : snapshot_xor_encode(w->prev, w->prev_len, cur->data, cur->len,
+                                delta, sizeof(delta));
+    }
+
+    /* A delta no smaller than the state is written as the state; only
+     * the scheduled keyframes go in the index */
+    if (n >= 0 && n < cur->len) {
+        writer_record(w, REPLAY_REC_DELTA, cur->tick, delta, (size_t)n);
+    } else {
+        if (key_due) {
+            if (w->nkeys < REPLAY_MAX_KEYFRAMES) {
+                w->keys[w->nkeys].tick = cur->tick;
+                w->keys[w->nkeys].offset = w->offset;
+                w->nkeys++;
+            }
+            w->last_key = cur->tick;
+        }
+        writer_record(w, REPLAY_REC_KEY, cur->tick, cur->data, cur->len);
+    }
+
+    memcpy(w->prev, cur->data, cur->len);
+    w->prev_len = cur->len;
+}
+
+int replay_writer_close(replay_writer_t *w)
+{
+    if (w == NULL)
+        return 0;
+
+    uint8_t buf[REPLAY_FOOTER];
+    uint32_t index_offset = w->offset;
+    for (uint32_t i = 0; i < w->nkeys; i++) {
+        put_u32(buf, w->keys[i].tick);
+        put_u32(buf + 4, w->keys[i].offset);
+        fwrite(buf, 1, 8, w->fp);
+    }
+    put_u32(buf, w->nkeys);
+    put_u32(buf + 4, index_offset);
+    memcpy(buf + 8, REPLAY_IDX_MAGIC, 8);
+    fwrite(buf, 1, sizeof(buf), w->fp);
+
+    int rc = ferror(w->fp) ? -1 : 0;
+    if (fclose(w->fp) != 0)
+        rc = -1;
+    free(w);
+    return rc;
+}
+
+/* ── Playback ───────────────────────────────────────────────────── */
+
+/* Reads the record header at off. Returns 1, 0 past the last whole
+ * record (a recording cut short just ends there), -1 if corrupt. */
+static int record_at(const replay_reader_t *r, uint32_t off, uint8_t *kind,
+                     uint32_t *tick, uint16_t *len)
+{
+    if ((size_t)off + REPLAY_REC_HEADER > r->end)
+        return 0;
+    const uint8_t *p = r->data + off;
+    *kind = p[0];
+    *tick = get_u32(p + 1);
+    *len = get_u16(p + 5);
+    if (*kind != REPLAY_REC_KEY && *kind != REPLAY_REC_DELTA)
+        return -1;
+    if ((size_t)off + REPLAY_REC_HEADER + *len > r->end)
+        return 0;
+    return 1;
+}
+
+static int reader_header(replay_reader_t *r)
+{
+    const uint8_t *d = r->data;
+    if (r->size < REPLAY_HEADER || memcmp(d, REPLAY_MAGIC, 8) != 0 ||
+        get_u16(d + 8) != REPLAY_VERSION)
+        return -1;
+    r->rows = get_u16(d + 12);
+    r->cols = get_u16(d + 14);
+
+    size_t start_len = get_u16(d + 16);
+    if (REPLAY_HEADER + start_len > r->size)
+        return -1;
+    msg_header_t hdr;
+    if (proto_unpack_header(d + REPLAY_HEADER, start_len, &hdr) < 0 ||
+        hdr.type != MSG_GAME_START ||
+        MSG_HEADER_SIZE + (size_t)hdr.payload_len > start_len ||
+        proto_unpack_game_start(d + REPLAY_HEADER + MSG_HEADER_SIZE,
+                                hdr.payload_len, &r->start) < 0)
+        return -1;
+
+    r->def = game_get_def((game_type_t)r->start.game_type);
+    r->records = (uint32_t)(REPLAY_HEADER + start_len);
+    return r->def != NULL ? 0 : -1;
+}
+
+/* Loads the trailing index, or builds one from the keyframes when the
+ * recording never got to write it */
+static int reader_index(replay_reader_t *r)
+{
+    const uint8_t *d = r->data;
+    r->end = r->size;
+
+    if (r->size >= (size_t)r->records + REPLAY_FOOTER &&
+        memcmp(d + r->size - 8, REPLAY_IDX_MAGIC, 8) == 0) {
+        uint32_t count = get_u32(d + r->size - REPLAY_FOOTER);
+        uint32_t offset = get_u32(d + r->size - REPLAY_FOOTER + 4);
+        if (offset < r->records ||
+            (size_t)offset + (size_t)count * 8 != r->size - REPLAY_FOOTER)
+            return -1;
+        r->end = offset;
+        r->keys = calloc(count + 1, sizeof(replay_key_t));
+        if (r->keys == NULL)
+            return -1;
+        for (uint32_t i = 0; i < count; i++) {
+            r->keys[i].tick = get_u32(d + offset + i * 8);
+            r->keys[i].offset = get_u32(d + offset + i * 8 + 4);
+            if (r->keys[i].offset < r->records || r->keys[i].offset >= r->end)
+                return -1;
+        }
+        r->nkeys = count;
+        return 0;
+    }
+
+    uint8_t kind;
+    uint32_t tick;
+    uint16_t len;
+    uint32_t count = 0;
+    int rc;
+    for (uint32_t off = r->records;
+         (rc = record_at(r, off, &kind, &tick, &len)) > 0;
+         off += REPLAY_REC_HEADER + len) {
+        if (kind == REPLAY_REC_KEY)
+            count++;
+    }
+    if (rc < 0)
+        return -1;
+
+    r->keys = calloc(count + 1, sizeof(replay_key_t));
+    if (r->keys == NULL)
+        return -1;
+    for (uint32_t off = r->records;
+         record_at(r, off, &kind, &tick, &len) > 0;
+         off += REPLAY_REC_HEADER + len) {
+        if (kind == REPLAY_REC_KEY) {
+            r->keys[r->nkeys].tick = tick;
+            r->keys[r->nkeys].offset = off;
+            r->nkeys++;
+        }
+    }
+    return 0;
+}
+
+int replay_open(replay_reader_t *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    r->data = platform_map_file(path, &r->size);
+    if (r->data == NULL)
+        return -1;
+
+    if (reader_header(r) < 0 || reader_index(r) < 0) {
+        replay_close(r);
+        return -1;
+    }
+    r->pos = r->records;
+    if (replay_next(r) != 1) {
+        replay_close(r);
+        return -1;
+    }
+    r->first_tick = r->tick;
+
+    /* The last tick is at most a keyframe interval past the last key */
+    if (replay_seek(r, UINT32_MAX) < 0) {
+        replay_close(r);
+        return -1;
+    }
+    r->last_tick = r->tick;
+    return replay_seek(r, r->first_tick);
+}
+
+void replay_close(replay_reader_t *r)
+{
+    free(r->keys);
+    if (r->data != NULL)
+        platform_unmap_file(r->data, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+int replay_next(replay_reader_t *r)
+{
+    uint8_t kind;
+    uint32_t tick;
+    uint16_t len;
+    int rc = record_at(r, r->pos, &kind, &tick, &len);
+    if (rc <= 0)
+        return rc;
+
+    const uint8_t *body = r->data + r->pos + REPLAY_REC_HEADER;
+    if (kind == REPLAY_REC_KEY) {
+        if (len > sizeof(r->body))
+            return -1;
+        memcpy(r->body, body, len);
+        r->body_len = len;
+    } else {
+        const game_def_t *def = r->def;
+        uint8_t out[MAX_MSG_PAYLOAD];
+        if (r->body_len == 0)
+            return -1;
+        int n = (def->delta_decode != NULL)
+              ? def->delta_decode(r->body, r->body_len, body, len,
+                                  out, sizeof(out))
+              : snapshot_xor_decode(r->body, r->body_len, body, len,
+                                    out, sizeof(out));
+        if (n < 0)
+            return -1;
+        memcpy(r->body, out, (size_t)n);
+        r->body_len = (uint16_t)n;
+    }
+
+    r->tick = tick;
+    r->pos += REPLAY_REC_HEADER + len;
+    return 1;
+}
+
+int replay_seek(replay_reader_t *r, uint32_t tick)
+{
+    /* Newest keyframe at or before tick */
+    uint32_t lo = 0, hi = r->nkeys;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (r->keys[mid].tick <= tick)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    r->pos = (lo > 0) ? r->keys[lo - 1].offset : r->records;
+    r->body_len = 0;
+    r->tick = 0;
+
+    for (;;) {
+        uint8_t kind;
+        uint32_t next;
+        uint16_t len;
+        int rc = record_at(r, r->pos, &kind, &next, &len);
+        if (rc < 0)
+            return -1;
+        if (rc == 0 || (r->body_len > 0 && next > tick))
+            return 0;
+        if (replay_next(r) < 0)
+            return -1;
+    }
+}
+
+int replay_restore(const replay_reader_t *r, void *state)
+{
+    if (r->body_len < MSG_SNAPSHOT_INPUTS)
+        return -1;
+    return r->def->unpack_state(state, r->body + MSG_SNAPSHOT_INPUTS,
+                                r->body_len - MSG_SNAPSHOT_INPUTS);
+}
@@ -0,0 +1,835 @@
+#include "server.h"
+#include "game.h"
+#include "network.h"
+#include "protocol.h"
+#include "replay.h"
+#include "snapshot.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SHARD_INBOX_SIZE  64
+#define SHARD_MAX_EVENTS  256
+#define SHARD_EARLY_BYTES 256   /* what a client may send behind its HELLO */
+
+typedef struct {
+    bytes_socket_t fd;
+    msg_hello_t    hello;
+    uint8_t        early[SHARD_EARLY_BYTES];  /* read past the HELLO */
+    size_t         early_len;
+} handoff_t;
+
+typedef struct {
+    bool           in_use;
+    bool           started;
+    char           name[MAX_NAME_LEN];
+    net_server_t   net;
+    game_session_t gs;
+    int            seat[2];          /* client index of players 1 and 2 */
+    uint32_t       input_seq[2];     /* newest input taken from each seat */
+    int            spectators;
+    int64_t        disconnect_time;
+    uint32_t       tick;
+    snapshot_history_t history;
+    replay_writer_t *rec;            /* NULL unless recording */
+} room_t;
+
+typedef struct {
+    int                    id;
+    pthread_t              thread;
+    pthread_mutex_t        lock;
+    handoff_t              inbox[SHARD_INBOX_SIZE];
+    int                    inbox_head;
+    int                    inbox_count;
+    room_t                *rooms;
+    net_loop_t             loop;
+    net_frame_pool_t       frames;   /* shared by every room's queues */
+    const server_config_t *cfg;
+    int                   *stop;     /* set by the listener, atomically */
+    platform_wake_t        wake;     /* the inbox has handoffs, or stop was set */
+} shard_t;
+
+typedef struct {
+    bytes_socket_t fd;
+    int64_t        deadline;
+    net_rxbuf_t    rx;       /* the HELLO as far as it has come */
+    msg_hello_t    hello;    /* read, but its shard had no room for it */
+    shard_t       *shard;    /* set while it waits on that shard */
+} pending_t;
+
+static void server_log(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+    fflush(stdout);
+}
+
+static uint32_t room_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p != '\0'; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* ── Rooms ──────────────────────────────────────────────────────── */
+
+static void room_send_all(room_t *room, const uint8_t *buf, int n)
+{
+    if (n > 0)
+        net_send_to_all(&room->net, buf, (size_t)n);
+}
+
+static void room_send_one(room_t *room, int idx, const uint8_t *buf, int n)
+{
+    if (n > 0)
+        net_server_send(&room->net, idx, buf, (size_t)n);
+}
+
+static room_t *room_find(shard_t *sh, const char *name)
+{
+    for (int i = 0; i < SERVER_ROOMS_PER_SHARD; i++) {
+        if (sh->rooms[i].in_use && strcmp(sh->rooms[i].name, name) == 0)
+            return &sh->rooms[i];
+    }
+    return NULL;
+}
+
+static room_t *room_open(shard_t *sh, const char *name)
+{
+    for (int i = 0; i < SERVER_ROOMS_PER_SHARD; i++) {
+        room_t *room = &sh->rooms[i];
+        if (room->in_use)
+            continue;
+
+        memset(room, 0, sizeof(*room));
+        net_server_reset(&room->net);
+        room->net.loop = &sh->loop;
+        room->net.tag_base = i * MAX_CLIENTS;
+        room->net.overflow = sh->cfg->overflow;
+        room->net.pool = &sh->frames;
+        room->in_use = true;
+        room->seat[0] = -1;
+        room->seat[1] = -1;
+        strncpy(room->name, name, MAX_NAME_LEN - 1);
+
+        server_log("[shard %d] room '%s' opened", sh->id, room->name);
+        return room;
+    }
+    return NULL;
+}
+
+static void room_close(shard_t *sh, room_t *room)
+{
+    if (room->rec != NULL && replay_writer_close(room->rec) < 0)
+        server_log("[shard %d] room '%s': recording incomplete", sh->id,
+                   room->name);
+    room->rec = NULL;
+    net_server_shutdown(&room->net);
+    if (room->started)
+        game_session_cleanup(&room->gs);
+    room->in_use = false;
+    room->started = false;
+
+    server_log("[shard %d] room '%s' closed", sh->id, room->name);
+}
+
+/* Nobody seated and nobody watching: nothing keeps the room open */
+static void room_close_if_empty(shard_t *sh, room_t *room)
+{
+    if (room->seat[0] < 0 && room->seat[1] < 0 && room->spectators == 0)
+        room_close(sh, room);
+}
+
+static void room_finish(shard_t *sh, room_t *room, int winner)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    const char *wname = (winner == 1) ? room->gs.p1_name : room->gs.p2_name;
+
+    room_send_all(room, buf, proto_pack_game_over(buf, sizeof(buf),
+                                                  (uint8_t)winner, wname));
+    server_log("[shard %d] room '%s': %s wins %s vs %s", sh->id, room->name,
+               wname, room->gs.p1_name, room->gs.p2_name);
+    room_close(sh, room);
+}
+
+/* Files are named after the room and start time; anything in the room
+ * name that doesn't belong in a file name becomes '_' */
+static void room_record(shard_t *sh, room_t *room, const uint8_t *start,
+                        int start_len)
+{
+    char name[MAX_NAME_LEN];
+    size_t i = 0;
+    for (; room->name[i] != '\0' && i < sizeof(name) - 1; i++) {
+        char ch = room->name[i];
+        bool safe = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                    (ch >= '0' && ch <= '9') || ch == '-' || ch == '_';
+        name[i] = safe ? ch : '_';
+    }
+    name[i] = '\0';
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s-%lld%s", sh->cfg->record_dir, name,
+             (long long)time(NULL), REPLAY_EXT);
+    room->rec = replay_writer_open(path, room->gs.def, start,
+                                   (size_t)start_len, sh->cfg->rows,
+                                   sh->cfg->cols);
+    if (room->rec == NULL)
+        server_log("[shard %d] room '%s': can't record to %s", sh->id,
+                   room->name, path);
+    else
+        server_log("[shard %d] room '%s': recording to %s", sh->id,
+                   room->name, path);
+}
+
+static void room_start(shard_t *sh, room_t *room)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    const game_def_t *def = game_get_def(GAME_PONG);
+    const char *p1 = room->net.clients[room->seat[0]].name;
+    const char *p2 = room->net.clients[room->seat[1]].name;
+
+    game_session_init_sized(&room->gs, def, p1, p2, true, false, 0,
+                            sh->cfg->rows, sh->cfg->cols);
+    game_session_seed(&room->gs, game_random_seed());
+    room->gs.spectator_count = room->spectators;
+    room->started = true;
+
+    int n = game_pack_start(&room->gs, buf, sizeof(buf));
+    room_send_all(room, buf, n);
+    server_log("[shard %d] room '%s': %s vs %s started", sh->id, room->name,
+               p1, p2);
+    if (sh->cfg->record_dir != NULL && n > 0)
+        room_record(sh, room, buf, n);
+}
+
+/* The client's index in *out, or -1 when it couldn't be taken in */
+static int room_join(shard_t *sh, const handoff_t *h, room_t **out)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+
+    room_t *room = room_find(sh, h->hello.room);
+    if (room == NULL)
+        room = room_open(sh, h->hello.room);
+    if (room == NULL) {
+        server_log("[shard %d] no free room for '%s'", sh->id, h->hello.room);
+        platform_close_socket(h->fd);
+        return -1;
+    }
+
+    int idx = net_server_adopt(&room->net, h->fd);
+    if (idx < 0) {
+        server_log("[shard %d] room '%s' is full", sh->id, room->name);
+        platform_close_socket(h->fd);
+        room_close_if_empty(sh, room);
+        return -1;
+    }
+
+    net_client_t *c = &room->net.clients[idx];
+    memcpy(c->rx.data, h->early, h->early_len);
+    c->rx.end = h->early_len;
+    *out = room;
+    c->greeted = true;
+    strncpy(c->name, h->hello.name, MAX_NAME_LEN - 1);
+
+    int seat = -1;
+    if (h->hello.role == ROLE_PLAYER)
+        seat = (room->seat[0] < 0) ? 0 : (room->seat[1] < 0) ? 1 : -1;
+
+    if (seat < 0) {
+        room->spectators++;
+        room->gs.spectator_count = room->spectators;
+
+        room_send_one(room, idx, buf, proto_pack_welcome(buf, sizeof(buf),
+                      room->gs.p1_name, room->gs.p2_name, 0));
+        if (room->started) {
+            room_send_one(room, idx, buf,
+                          game_pack_start(&room->gs, buf, sizeof(buf)));
+            if (room->gs.paused)
+                room_send_one(room, idx, buf, proto_pack_pause(buf, sizeof(buf), 0));
+        }
+        server_log("[shard %d] room '%s': %s watching", sh->id, room->name, c->name);
+        return idx;
+    }
+
+    room->seat[seat] = idx;
+    room->input_seq[seat] = 0;
+    c->is_player = true;
+    c->player_id = (uint8_t)(seat + 1);
+
+    if (!room->started) {
+        const char *p1 = room->net.clients[room->seat[0]].name;
+        const char *p2 = room->seat[1] >= 0 ? room->net.clients[room->seat[1]].name : "";
+        room_send_one(room, idx, buf, proto_pack_welcome(buf, sizeof(buf),
+                      p1, p2, c->player_id));
+        server_log("[shard %d] room '%s': %s seated as player %d", sh->id,
+                   room->name, c->name, seat + 1);
+
+        if (room->seat[0] >= 0 && room->seat[1] >= 0)
+            room_start(sh, room);
+        return idx;
+    }
+
+    /* Reconnect into a running match */
+    room_send_one(room, idx, buf, proto_pack_welcome(buf, sizeof(buf),
+                  room->gs.p1_name, room->gs.p2_name, c->player_id));
+    room_send_one(room, idx, buf, game_pack_start(&room->gs, buf, sizeof(buf)));
+    server_log("[shard %d] room '%s': %s rejoined as player %d", sh->id,
+               room->name, c->name, seat + 1);
+
+    if (room->seat[0] >= 0 && room->seat[1] >= 0 && room->gs.paused) {
+        room->gs.paused = false;
+        room_send_all(room, buf, proto_pack_resume(buf, sizeof(buf)));
+    }
+    return idx;
+}
+
+static void room_drop(shard_t *sh, room_t *room, int idx, int64_t now)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    net_client_t *c = &room->net.clients[idx];
+    bool was_player = c->is_player;
+    int pid = c->player_id;
+
+    c->greeted = false;
+    net_server_close_client(&room->net, idx);
+
+    if (!was_player) {
+        room->spectators--;
+        room->gs.spectator_count = room->spectators;
+        room_close_if_empty(sh, room);
+        return;
+    }
+
+    room->seat[pid - 1] = -1;
+    if (room->started)
+        game_apply_input(room->gs.def, room->gs.state, pid, GAME_INPUT_HELD);
+
+    if (room->seat[0] < 0 && room->seat[1] < 0) {
+        room_send_all(room, buf, proto_pack_quit(buf, sizeof(buf)));
+        room_close(sh, room);
+        return;
+    }
+
+    if (room->started && !room->gs.paused) {
+        room->gs.paused = true;
+        room->disconnect_time = now;
+        room_send_all(room, buf, proto_pack_pause(buf, sizeof(buf), 0));
+        server_log("[shard %d] room '%s': player %d disconnected, paused",
+                   sh->id, room->name, pid);
+    }
+}
+
+/* Sends give up on clients (write error or queue overflow) without
+ * telling anyone; catch up on those after every burst of traffic. */
+static void room_reap(shard_t *sh, room_t *room, int64_t now)
+{
+    for (int i = 0; i < MAX_CLIENTS && room->in_use; i++) {
+        net_client_t *c = &room->net.clients[i];
+        if (!c->connected && c->greeted)
+            room_drop(sh, room, i, now);
+    }
+}
+
+static void room_read(shard_t *sh, room_t *room, int idx, int64_t now)
+{
+    const uint8_t *recv_buf;
+
+    while (room->in_use && room->net.clients[idx].connected) {
+        net_client_t *c = &room->net.clients[idx];
+        int rr = net_recv_frame(c->fd, &c->rx, &recv_buf, 0);
+        if (rr == 0)
+            return;
+        if (rr < 0) {
+            room_drop(sh, room, idx, now);
+            return;
+        }
+
+        msg_header_t hdr;
+        proto_unpack_header(recv_buf, (size_t)rr, &hdr);
+
+        if (hdr.type == MSG_STATE_ACK) {
+            msg_state_ack_t ack;
+            if (proto_unpack_state_ack(recv_buf + MSG_HEADER_SIZE,
+                                       hdr.payload_len, &ack) == 0)
+                snapshot_note_ack(c, ack.tick);
+            continue;
+        }
+        if (hdr.type == MSG_PING) {
+            const msg_ping_wire_t *ping =
+                proto_view_ping(recv_buf + MSG_HEADER_SIZE, hdr.payload_len);
+            uint8_t buf[MSG_HEADER_SIZE + MSG_PONG_SIZE];
+            if (ping != NULL)
+                room_send_one(room, idx, buf,
+                              proto_pack_pong(buf, sizeof(buf),
+                                              proto_get_u32(&ping->seq),
+                                              proto_get_u64(&ping->time_us)));
+            continue;
+        }
+
+        if (!c->is_player || !room->started)
+            continue;
+
+        if (hdr.type == MSG_INPUT) {
+            /* Inputs sent during a pause are dropped but still count as
+             * taken, or the client would keep predicting them */
+            const msg_input_wire_t *inp =
+                proto_view_input(recv_buf + MSG_HEADER_SIZE, hdr.payload_len);
+            if (inp == NULL)
+                continue;
+            room->input_seq[c->player_id - 1] = proto_get_u32(&inp->seq);
+            if (!room->gs.paused)
+                game_apply_input(room->gs.def, room->gs.state, c->player_id,
+                                 proto_get_i32(&inp->key));
+        } else if (hdr.type == MSG_INPUT_HELD) {
+            const msg_input_held_wire_t *held =
+                proto_view_input_held(recv_buf + MSG_HEADER_SIZE, hdr.payload_len);
+            if (held == NULL)
+                continue;
+            room->input_seq[c->player_id - 1] = proto_get_u32(&held->seq);
+            if (!room->gs.paused)
+                game_apply_input(room->gs.def, room->gs.state, c->player_id,
+                                 GAME_INPUT_HELD | proto_get_u8(&held->held));
+        } else if (hdr.type == MSG_QUIT) {
+            room_finish(sh, room, c->player_id == 1 ? 2 : 1);
+            return;
+        }
+    }
+}
+
+static void room_tick(shard_t *sh, room_t *room, int steps, int64_t now)
+{
+    game_session_t *gs = &room->gs;
+    const game_def_t *def = gs->def;
+
+    if (!room->started)
+        return;
+
+    if (gs->paused) {
+        if (now - room->disconnect_time >= (int64_t)RECONNECT_TIMEOUT_SEC * 1000000)
+            room_finish(sh, room, room->seat[0] >= 0 ? 1 : 2);
+        return;
+    }
+
+    /* Ticks owed after a stall are simulated back to back; clients only
+     * need the state they end in */
+    for (int i = 0; i < steps && !def->is_over(gs->state); i++) {
+        def->update(gs->state);
+        room->tick++;
+    }
+
+    net_frame_t *key = snapshot_capture(def, gs->state, room->input_seq,
+                                        &room->history, room->tick,
+                                        room->net.pool);
+    if (key != NULL) {
+        if (room->rec != NULL)
+            replay_writer_tick(room->rec, &room->history);
+
+        snapshot_fanout_t fo;
+        snapshot_fanout_begin(&fo, def, &room->history, key);
+        snapshot_fanout_send(&fo, &room->net, -1);
+        snapshot_fanout_end(&fo);
+    }
+
+    if (def->is_over(gs->state))
+        room_finish(sh, room, def->get_winner(gs->state));
+    else
+        room_reap(sh, room, now);
+}
+
+/* ── Shards ─────────────────────────────────────────────────────── */
+
+static int shard_post(shard_t *sh, bytes_socket_t fd, const msg_hello_t *hello,
+                      const uint8_t *early, size_t early_len)
+{
+    int rc = -1;
+    pthread_mutex_lock(&sh->lock);
+    if (sh->inbox_count < SHARD_INBOX_SIZE) {
+        int slot = (sh->inbox_head + sh->inbox_count) % SHARD_INBOX_SIZE;
+        sh->inbox[slot].fd = fd;
+        sh->inbox[slot].hello = *hello;
+        memcpy(sh->inbox[slot].early, early, early_len);
+        sh->inbox[slot].early_len = early_len;
+        sh->inbox_count++;
+        rc = 0;
+    }
+    bool wake = (rc == 0 && sh->inbox_count == 1);
+    pthread_mutex_unlock(&sh->lock);
+    /* One signal per empty inbox filled; the shard takes them all */
+    if (wake)
+        platform_wake_signal(&sh->wake);
+    return rc;
+}
+
+static void shard_drain_inbox(shard_t *sh, int64_t now)
+{
+    handoff_t batch[SHARD_INBOX_SIZE];
+    int n = 0;
+
+    pthread_mutex_lock(&sh->lock);
+    while (sh->inbox_count > 0) {
+        batch[n++] = sh->inbox[sh->inbox_head];
+        sh->inbox_head = (sh->inbox_head + 1) % SHARD_INBOX_SIZE;
+        sh->inbox_count--;
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    for (int i = 0; i < n; i++) {
+        room_t *room;
+        int idx = room_join(sh, &batch[i], &room);
+        /* No read event will come for frames that are already buffered */
+        if (idx >= 0 && batch[i].early_len > 0)
+            room_read(sh, room, idx, now);
+    }
+}
+
+/* Every room's sends from one pass of the loop go out together */
+static void shard_batch(shard_t *sh, bool begin)
+{
+    for (int r = 0; r < SERVER_ROOMS_PER_SHARD; r++) {
+        if (!sh->rooms[r].in_use)
+            continue;
+        if (begin)
+            net_server_begin_batch(&sh->rooms[r].net);
+        else
+            net_server_end_batch(&sh->rooms[r].net);
+    }
+}
+
+static void *shard_main(void *arg)
+{
+    shard_t *sh = (shard_t *)arg;
+    net_event_t events[SHARD_MAX_EVENTS];
+    platform_ticker_t ticker;
+
+    platform_ticker_init(&ticker, TICK_INTERVAL_US, true);
+    if (ticker.fd >= 0 && net_loop_add(&sh->loop, ticker.fd, NET_TAG_TIMER) < 0)
+        platform_ticker_close(&ticker);
+    /* Without it handoffs wait for the next tick */
+    if (sh->wake.fd >= 0)
+        net_loop_add(&sh->loop, sh->wake.fd, NET_TAG_WAKE);
+
+    while (!__atomic_load_n(sh->stop, __ATOMIC_ACQUIRE)) {
+        int64_t now = platform_mono_us();
+        shard_batch(sh, false);
+        int nev = net_loop_wait(&sh->loop, events, SHARD_MAX_EVENTS,
+                                platform_ticker_wait_ms(&ticker, now));
+        now = platform_mono_us();
+        shard_batch(sh, true);
+        platform_wake_drain(&sh->wake);
+
+        for (int i = 0; i < nev; i++) {
+            if (events[i].tag < 0)
+                continue;
+            int r = events[i].tag / MAX_CLIENTS;
+            int idx = events[i].tag % MAX_CLIENTS;
+            if (r < 0 || r >= SERVER_ROOMS_PER_SHARD || !sh->rooms[r].in_use)
+                continue;
+            room_t *room = &sh->rooms[r];
+            if (events[i].events & NET_EV_WRITE)
+                net_server_flush(&room->net, idx);
+            if (events[i].events & NET_EV_READ)
+                room_read(sh, room, idx, now);
+            if (room->in_use)
+                room_reap(sh, room, now);
+        }
+
+        /* New connections are picked up on the wake, and at least once
+         * per tick */
+        shard_drain_inbox(sh, now);
+
+        int steps = platform_ticker_due(&ticker, now);
+        if (steps > 0) {
+            for (int r = 0; r < SERVER_ROOMS_PER_SHARD; r++) {
+                if (sh->rooms[r].in_use)
+                    room_tick(sh, &sh->rooms[r], steps, now);
+            }
+        }
+    }
+
+    shard_batch(sh, false);
+    uint8_t buf[MSG_HEADER_SIZE];
+    for (int r = 0; r < SERVER_ROOMS_PER_SHARD; r++) {
+        if (sh->rooms[r].in_use) {
+            room_send_all(&sh->rooms[r], buf, proto_pack_quit(buf, sizeof(buf)));
+            room_close(sh, &sh->rooms[r]);
+        }
+    }
+
+    if (ticker.late > 0 || ticker.dropped > 0)
+        server_log("[shard %d] %llu of %llu ticks ran late, %llu dropped",
+                   sh->id, (unsigned long long)ticker.late,
+                   (unsigned long long)ticker.ticks,
+                   (unsigned long long)ticker.dropped);
+    unsigned long enters = net_loop_enters(&sh->loop);
+    if (enters > 0 && ticker.ticks > 0)
+        server_log("[shard %d] %.1f io_uring_enter calls per tick",
+                   sh->id, (double)enters / (double)ticker.ticks);
+    if (ticker.fd >= 0)
+        net_loop_remove(&sh->loop, ticker.fd);
+    platform_ticker_close(&ticker);
+    if (sh->wake.fd >= 0)
+        net_loop_remove(&sh->loop, sh->wake.fd);
+    return NULL;
+}
+
+/* ── Listener ───────────────────────────────────────────────────── */
+
+static void pending_drop(net_loop_t *loop, pending_t *p)
+{
+    if (p->shard)
+        server_log("[listener] shard %d is backed up, dropping %s",
+                   p->shard->id, p->hello.name);
+    else
+        net_loop_remove(loop, p->fd);
+    platform_close_socket(p->fd);
+    p->fd = BYTES_INVALID_SOCKET;
+    p->shard = NULL;
+}
+
+/* Hands a connection to its shard; false if the inbox is full, and the
+ * connection stays in its slot to be tried again */
+static bool pending_post(pending_t *p, shard_t *sh)
+{
+    if (shard_post(sh, p->fd, &p->hello, p->rx.data + p->rx.start,
+                   p->rx.end - p->rx.start) < 0) {
+        p->shard = sh;
+        return false;
+    }
+    p->fd = BYTES_INVALID_SOCKET;
+    p->shard = NULL;
+    return true;
+}
+
+/* Never waits: a HELLO still on its way stays in p->rx until the next
+ * read event, or until the deadline drops the connection */
+static void listener_read(net_loop_t *loop, pending_t *p,
+                          shard_t *shards, int nshards)
+{
+    const uint8_t *frame;
+
+    int rr = net_recv_frame(p->fd, &p->rx, &frame, 0);
+    if (rr == 0)
+        return;
+
+    msg_header_t hdr;
+    msg_hello_t *hello = &p->hello;
+    size_t early = (rr < 0) ? 0 : p->rx.end - p->rx.start;
+    if (rr < 0 ||
+        proto_unpack_header(frame, (size_t)rr, &hdr) < 0 ||
+        hdr.type != MSG_HELLO ||
+        proto_unpack_hello(frame + MSG_HEADER_SIZE, hdr.payload_len, hello) < 0 ||
+        early > SHARD_EARLY_BYTES) {
+        pending_drop(loop, p);
+        return;
+    }
+
+    if (hello->room[0] == '\0')
+        strncpy(hello->room, SERVER_DEFAULT_ROOM, MAX_NAME_LEN - 1);
+
+    /* The shard owns the socket from here on, or will once it has room */
+    net_loop_remove(loop, p->fd);
+    pending_post(p, &shards[room_hash(hello->room) % (uint32_t)nshards]);
+}
+
+/* Takes connections for as long as there are pending slots to put them
+ * in. Returns false when it stopped for want of one: the rest wait in
+ * the listen backlog rather than being dropped. */
+static bool listener_accept(net_loop_t *loop, bytes_socket_t lfd,
+                            pending_t *pending, int64_t now)
+{
+    for (;;) {
+        int slot = -1;
+        for (int s = 0; s < SERVER_MAX_PENDING; s++) {
+            if (pending[s].fd == BYTES_INVALID_SOCKET) {
+                slot = s;
+                break;
+            }
+        }
+        if (slot < 0)
+            return false;
+
+        bytes_socket_t cfd = net_loop_accept(loop, lfd);
+        if (cfd == BYTES_INVALID_SOCKET)
+            return true;
+        if (net_loop_add(loop, cfd, slot) < 0) {
+            platform_close_socket(cfd);
+            continue;
+        }
+        pending_t *p = &pending[slot];
+        p->fd = cfd;
+        p->deadline = now + (int64_t)SERVER_HELLO_TIMEOUT_MS * 1000;
+        p->rx.start = 0;
+        p->rx.end = 0;
+        p->rx.by_loop = false;
+        p->rx.eof = false;
+        p->shard = NULL;
+    }
+}
+
+int server_run(const server_config_t *cfg, volatile int *quit)
+{
+    platform_raise_fd_limit();
+
+    bytes_socket_t lfd = net_listen(cfg->port, SERVER_LISTEN_BACKLOG);
+    if (lfd == BYTES_INVALID_SOCKET) {
+        server_log("Failed to listen on port %d.", cfg->port);
+        return -1;
+    }
+
+    net_loop_t loop;
+    if (net_loop_init(&loop, SERVER_MAX_PENDING + 1) < 0) {
+        platform_close_socket(lfd);
+        return -1;
+    }
+    /* Shards follow the listener: all on io_uring or none */
+    bool uring = cfg->io_uring && net_loop_use_uring(&loop) == 0;
+    if (net_loop_add(&loop, lfd, NET_TAG_LISTEN) < 0) {
+        net_loop_close(&loop);
+        platform_close_socket(lfd);
+        return -1;
+    }
+
+    int nshards = cfg->threads > 0 ? cfg->threads : platform_cpu_count();
+    shard_t *shards = calloc((size_t)nshards, sizeof(shard_t));
+    pending_t *pending = calloc(SERVER_MAX_PENDING, sizeof(pending_t));
+    if (shards == NULL || pending == NULL) {
+        free(shards);
+        free(pending);
+        net_loop_close(&loop);
+        platform_close_socket(lfd);
+        return -1;
+    }
+
+    int stop = 0;
+    int started = 0;
+    for (; started < nshards; started++) {
+        shard_t *sh = &shards[started];
+        sh->id = started;
+        sh->cfg = cfg;
+        sh->stop = &stop;
+        sh->rooms = calloc(SERVER_ROOMS_PER_SHARD, sizeof(room_t));
+        if (sh->rooms == NULL)
+            break;
+        if (net_frame_pool_init(&sh->frames, NET_FRAME_POOL_SIZE(
+                                SERVER_ROOMS_PER_SHARD * MAX_CLIENTS)) < 0) {
+            free(sh->rooms);
+            break;
+        }
+        /* Two more for the tick timer and the wake */
+        if (net_loop_init(&sh->loop, SERVER_ROOMS_PER_SHARD * MAX_CLIENTS + 2) < 0) {
+            net_frame_pool_close(&sh->frames);
+            free(sh->rooms);
+            break;
+        }
+        if (uring && net_loop_use_uring(&sh->loop) < 0) {
+            net_loop_close(&sh->loop);
+            net_frame_pool_close(&sh->frames);
+            free(sh->rooms);
+            break;
+        }
+        pthread_mutex_init(&sh->lock, NULL);
+        platform_wake_init(&sh->wake);
+        if (pthread_create(&sh->thread, NULL, shard_main, sh) != 0) {
+            platform_wake_close(&sh->wake);
+            pthread_mutex_destroy(&sh->lock);
+            net_loop_close(&sh->loop);
+            net_frame_pool_close(&sh->frames);
+            free(sh->rooms);
+            break;
+        }
+    }
+
+    for (int i = 0; i < SERVER_MAX_PENDING; i++)
+        pending[i].fd = BYTES_INVALID_SOCKET;
+
+    if (started == nshards)
+        server_log("Serving on port %d with %d shard%s, %d rooms each.",
+                   cfg->port, nshards, nshards == 1 ? "" : "s",
+                   SERVER_ROOMS_PER_SHARD);
+    else
+        server_log("Failed to start worker shards.");
+    if (cfg->io_uring && !uring)
+        server_log("io_uring unavailable, using epoll.");
+
+    net_event_t events[SERVER_MAX_PENDING + 1];
+    bool held_back = false;   /* connections may be waiting for a slot */
+    bool warned = false;
+    bool waiting = false;     /* some are read and waiting on a shard */
+    while (started == nshards && !*quit) {
+        /* A backed-up shard is usually clear by its next drain */
+        int nev = net_loop_wait(&loop, events, SERVER_MAX_PENDING + 1,
+                                waiting ? 1 : 200);
+        int64_t now = platform_mono_us();
+
+        for (int i = 0; i < nev; i++) {
+            if (events[i].tag != NET_TAG_LISTEN) {
+                if (!(events[i].events & NET_EV_READ))
+                    continue;
+                pending_t *p = &pending[events[i].tag];
+                if (p->fd != BYTES_INVALID_SOCKET && !p->shard)
+                    listener_read(&loop, p, shards, nshards);
+                continue;
+            }
+
+            held_back = !listener_accept(&loop, lfd, pending, now);
+        }
+
+        waiting = false;
+        for (int s = 0; s < SERVER_MAX_PENDING; s++) {
+            pending_t *p = &pending[s];
+            if (p->fd == BYTES_INVALID_SOCKET)
+                continue;
+            if (p->shard && pending_post(p, p->shard))
+                continue;
+            if (now > p->deadline)
+                pending_drop(&loop, p);
+            else if (p->shard)
+                waiting = true;
+        }
+
+        /* The listen socket won't report connections it already has */
+        if (held_back) {
+            if (!warned)
+                server_log("[listener] all %d pending slots busy, holding back "
+                           "new connections", SERVER_MAX_PENDING);
+            warned = true;
+            held_back = !listener_accept(&loop, lfd, pending, now);
+        } else {
+            warned = false;
+        }
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++)
+        platform_wake_signal(&shards[i].wake);
+    for (int i = 0; i < started; i++) {
+        pthread_join(shards[i].thread, NULL);
+        platform_wake_close(&shards[i].wake);
+        pthread_mutex_destroy(&shards[i].lock);
+        net_loop_close(&shards[i].loop);
+        net_frame_pool_close(&shards[i].frames);
+        free(shards[i].rooms);
+    }
+    free(shards);
+
+    for (int s = 0; s < SERVER_MAX_PENDING; s++) {
+        if (pending[s].fd != BYTES_INVALID_SOCKET)
+            pending_drop(&loop, &pending[s]);
+    }
+    free(pending);
+    net_loop_close(&loop);
+    platform_close_socket(lfd);
+
+    server_log("Server stopped.");
+    return started == nshards ? 0 : -1;
+}
@@ -0,0 +1,270 @@
+#include "snapshot.h"
+#include "protocol.h"
+
+#include <string.h>
+
+void snapshot_history_reset(snapshot_history_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void snapshot_history_put(snapshot_history_t *h, uint32_t tick,
+                          const uint8_t *data, size_t len)
+{
+    snapshot_frame_t *f = &h->frames[tick % SNAPSHOT_HISTORY];
+    if (len > sizeof(f->data))
+        return;
+
+    f->tick = tick;
+    f->len = (uint16_t)len;
+    memcpy(f->data, data, len);
+    h->latest = tick;
+}
+
+const snapshot_frame_t *snapshot_history_get(const snapshot_history_t *h,
+                                             uint32_t tick)
+{
+    const snapshot_frame_t *f = &h->frames[tick % SNAPSHOT_HISTORY];
+    if (tick == 0 || f->tick != tick)
+        return NULL;
+    return f;
+}
+
+/* ── Generic XOR codec ──────────────────────────────────────────── */
+
+int snapshot_xor_encode(const uint8_t *base, size_t base_len,
+                        const uint8_t *cur, size_t cur_len,
+                        uint8_t *out, size_t outlen)
+{
+    if (base_len != cur_len)
+        return -1;
+
+    size_t fields = (cur_len + 1) / 2;
+    size_t mask_len = (fields + 7) / 8;
+    if (outlen < mask_len)
+        return -1;
+    memset(out, 0, mask_len);
+
+    size_t n = mask_len;
+    for (size_t i = 0; i < fields; i++) {
+        size_t off = i * 2;
+        size_t width = (off + 1 < cur_len) ? 2 : 1;
+
+        uint8_t x0 = cur[off] ^ base[off];
+        uint8_t x1 = (width == 2) ? (uint8_t)(cur[off + 1] ^ base[off + 1]) : 0;
+        if (x0 == 0 && x1 == 0)
+            continue;
+
+        if (n + width > outlen)
+            return -1;
+        out[i / 8] |= (uint8_t)(1u << (i % 8));
+        out[n++] = x0;
+        if (width == 2)
+            out[n++] = x1;
+    }
+    return (int)n;
+}
+
+int snapshot_xor_decode(const uint8_t *base, size_t base_len,
+                        const uint8_t *delta, size_t delta_len,
+                        uint8_t *out, size_t outlen)
+{
+    size_t fields = (base_len + 1) / 2;
+    size_t mask_len = (fields + 7) / 8;
+    if (outlen < base_len || delta_len < mask_len)
+        return -1;
+    memcpy(out, base, base_len);
+
+    size_t n = mask_len;
+    for (size_t i = 0; i < fields; i++) {
+        if (!(delta[i / 8] & (1u << (i % 8))))
+            continue;
+
+        size_t off = i * 2;
+        size_t width = (off + 1 < base_len) ? 2 : 1;
+        if (n + width > delta_len)
+            return -1;
+        out[off] ^= delta[n++];
+        if (width == 2)
+            out[off + 1] ^= delta[n++];
+    }
+    return (int)base_len;
+}
+
+/* ── Server side ────────────────────────────────────────────────── */
+
+#define SNAPSHOT_BODY_MAX (MSG_HEADER_SIZE + MAX_MSG_PAYLOAD - MSG_SNAPSHOT_BODY)
+
+net_frame_t *snapshot_capture(const game_def_t *def, const void *state,
+                              const uint32_t input_seqs[2],
+                              snapshot_history_t *h, uint32_t tick,
+                              net_frame_pool_t *pool)
+{
+    net_frame_t *f = net_frame_alloc(pool);
+    if (f == NULL)
+        return NULL;
+
+    uint8_t *body = f->data + MSG_SNAPSHOT_BODY;
+    proto_pack_input_seqs(body, SNAPSHOT_BODY_MAX, input_seqs);
+    int n = def->pack_state(state, body + MSG_SNAPSHOT_INPUTS,
+                            SNAPSHOT_BODY_MAX - MSG_SNAPSHOT_INPUTS);
+    if (n > 0)
+        n += MSG_SNAPSHOT_INPUTS;
+    int len = (n > 0) ? proto_finish_snapshot(f->data, sizeof(f->data), tick, 0,
+                                              (uint16_t)n)
+                      : -1;
+    if (len < 0) {
+        net_frame_release(f);
+        return NULL;
+    }
+
+    f->len = (uint16_t)len;
+    snapshot_history_put(h, tick, body, (size_t)n);
+    return f;
+}
+
+net_frame_t *snapshot_keyframe(const snapshot_history_t *h,
+                               net_frame_pool_t *pool)
+{
+    const snapshot_frame_t *cur = snapshot_history_get(h, h->latest);
+    if (cur == NULL || cur->len > SNAPSHOT_BODY_MAX)
+        return NULL;
+
+    net_frame_t *f = net_frame_alloc(pool);
+    if (f == NULL)
+        return NULL;
+    memcpy(f->data + MSG_SNAPSHOT_BODY, cur->data, cur->len);
+    f->len = (uint16_t)proto_finish_snapshot(f->data, sizeof(f->data),
+                                             cur->tick, 0, cur->len);
+    return f;
+}
+
+void snapshot_fanout_begin(snapshot_fanout_t *fo, const game_def_t *def,
+                           const snapshot_history_t *h, net_frame_t *key)
+{
+    memset(fo, 0, sizeof(*fo));
+    fo->def = def;
+    fo->history = h;
+    fo->key = key;
+}
+
+net_frame_t *snapshot_fanout_get(snapshot_fanout_t *fo, uint32_t acked)
+{
+    const snapshot_history_t *h = fo->history;
+    const snapshot_frame_t *cur = snapshot_history_get(h, h->latest);
+    if (cur == NULL)
+        return fo->key;
+
+    /* A baseline the client never confirmed, or one we have forgotten,
+     * means the keyframe. So does a delta that wouldn't be smaller. */
+    uint32_t age = cur->tick - acked;
+    if (acked == 0 || age == 0 || age >= SNAPSHOT_HISTORY)
+        return fo->key;
+    if (fo->delta[age] != NULL)
+        return fo->delta[age];
+
+    const snapshot_frame_t *base = snapshot_history_get(h, acked);
+    net_frame_t *f = (base != NULL) ? net_frame_alloc(fo->key->pool) : NULL;
+    if (f == NULL)
+        return fo->key;
+
+    const game_def_t *def = fo->def;
+    uint8_t *body = f->data + MSG_SNAPSHOT_BODY;
+    int n = (def->delta_encode != NULL)
+          ? def->delta_encode(base->data, base->len, cur->data, cur->len,
+                              body, SNAPSHOT_BODY_MAX)
+          : snapshot_xor_encode(base->data, base->len, cur->data, cur->len,
+                                body, SNAPSHOT_BODY_MAX);
+    if (n < 0 || n >= cur->len) {
+        net_frame_release(f);
+        f = net_frame_ref(fo->key);
+    } else {
+        f->len = (uint16_t)proto_finish_snapshot(f->data, sizeof(f->data),
+                                                 cur->tick, (uint8_t)age,
+                                                 (uint16_t)n);
+    }
+    fo->delta[age] = f;
+    return f;
+}
+
+void snapshot_fanout_send(snapshot_fanout_t *fo, net_server_t *srv,
+                          int skip_idx)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        net_client_t *c = &srv->clients[i];
+        if (!c->connected || !c->greeted || i == skip_idx)
+            continue;
+
+        net_frame_t *f = snapshot_fanout_get(fo, c->acked_tick);
+        if (f != NULL)
+            net_server_send_frame(srv, i, f);
+    }
+}
+
+void snapshot_fanout_end(snapshot_fanout_t *fo)
+{
+    for (int i = 0; i < SNAPSHOT_HISTORY; i++)
+        net_frame_release(fo->delta[i]);
+    net_frame_release(fo->key);
+    memset(fo, 0, sizeof(*fo));
+}
+
+void snapshot_note_ack(net_client_t *c, uint32_t tick)
+{
+    /* Datagram acks can arrive out of order; only move forward, except
+     * that 0 always means "start over from a keyframe". */
+    if (tick == 0 || c->acked_tick == 0 || (int32_t)(tick - c->acked_tick) > 0)
+        c->acked_tick = tick;
+}
+
+/* ── Client side ────────────────────────────────────────────────── */
+
+int snapshot_unpack(const game_def_t *def, snapshot_history_t *h,
+                    const uint8_t *payload, size_t len)
+{
+    msg_snapshot_t snap;
+    int off = proto_unpack_snapshot(payload, len, &snap);
+    if (off < 0)
+        return -1;
+    if (h->latest != 0 && (int32_t)(snap.tick - h->latest) <= 0)
+        return 0;
+
+    const uint8_t *body = payload + off;
+    size_t body_len = len - (size_t)off;
+    uint8_t out[MAX_MSG_PAYLOAD];
+    int n;
+
+    if (snap.base_age == 0) {
+        if (body_len > sizeof(out))
+            return -1;
+        memcpy(out, body, body_len);
+        n = (int)body_len;
+    } else {
+        const snapshot_frame_t *base =
+            snapshot_history_get(h, snap.tick - snap.base_age);
+        if (base == NULL)
+            return -1;
+        n = (def->delta_decode != NULL)
+          ? def->delta_decode(base->data, base->len, body, body_len,
+                              out, sizeof(out))
+          : snapshot_xor_decode(base->data, base->len, body, body_len,
+                                out, sizeof(out));
+        if (n < 0)
+            return -1;
+    }
+
+    snapshot_history_put(h, snap.tick, out, (size_t)n);
+    return n;
+}
+
+int snapshot_restore(const game_def_t *def, const snapshot_history_t *h,
+                     void *state, uint32_t input_seqs[2])
+{
+    const snapshot_frame_t *f = snapshot_history_get(h, h->latest);
+    if (f == NULL || f->len < MSG_SNAPSHOT_INPUTS)
+        return -1;
+    if (input_seqs != NULL)
+        proto_unpack_input_seqs(f->data, f->len, input_seqs);
+    return def->unpack_state(state, f->data + MSG_SNAPSHOT_INPUTS,
+                             f->len - MSG_SNAPSHOT_INPUTS);
+}
@@ -6,110 +6,388 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-void stats_init(stats_t *st)
+#define STATS_MAGIC       "bytes-stats 1 "
+#define STATS_LINE_MAX    128
+#define STATS_INDEX_MIN   64
+#define STATS_COMPACT_MIN 64    /* log lines before compacting is worth it */
+
+/* FNV-1a, for the index and the line checksums */
+static uint32_t fnv1a(const char *s, size_t n)
 {
-    memset(st, 0, sizeof(*st));
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
-    char home[240];
-    platform_get_home_dir(home, sizeof(home));
-    snprintf(st->path, sizeof(st->path), "%s/.bytes_stats", home);
+/* ── Index ──────────────────────────────────────────────────────── */
+
+static int stats_find(const stats_t *st, const char *key)
+{
+    if (st->index_size == 0)
+        return -1;
+    size_t mask = (size_t)st->index_size - 1;
+    for (size_t i = fnv1a(key, strlen(key)) & mask;; i = (i + 1) & mask) {
+        int e = st->index[i];
+        if (e == 0)
+            return -1;
+        if (strcmp(st->entries[e - 1].key, key) == 0)
+            return e - 1;
+    }
 }
 
-bool stats_load(stats_t *st)
+static void index_put(int *index, int size, const char *key, int e)
 {
-    FILE *f = fopen(st->path, "r");
-    if (f == NULL)
-        return false;
+    size_t mask = (size_t)size - 1;
+    size_t i = fnv1a(key, strlen(key)) & mask;
+    while (index[i] != 0)
+        i = (i + 1) & mask;
+    index[i] = e + 1;
+}
 
-    char line[128];
-    while (fgets(line, sizeof(line), f) != NULL && st->count < STATS_MAX_ENTRIES) {
-        char *eq = strchr(line, '=');
-        if (eq == NULL)
-            continue;
+/* Room for one more entry, with the index kept at most half full */
+static bool stats_reserve(stats_t *st)
+{
+    if (st->count == st->capacity) {
+        int cap = (st->capacity > 0) ? st->capacity * 2 : 32;
+        stats_entry_t *entries = realloc(st->entries, (size_t)cap * sizeof(*entries));
+        if (entries == NULL)
+            return false;
+        st->entries = entries;
+        st->capacity = cap;
+    }
+    if ((st->count + 1) * 2 > st->index_size) {
+        int size = (st->index_size > 0) ? st->index_size * 2 : STATS_INDEX_MIN;
+        int *index = calloc((size_t)size, sizeof(*index));
+        if (index == NULL)
+            return false;
+        for (int i = 0; i < st->count; i++)
+            index_put(index, size, st->entries[i].key, i);
+        free(st->index);
+        st->index = index;
+        st->index_size = size;
+    }
+    return true;
+}
+
+/* The entry for key, added at 0 if there is none; NULL out of memory */
+static stats_entry_t *stats_entry(stats_t *st, const char *key)
+{
+    char k[STATS_KEY_LEN];
+    snprintf(k, sizeof(k), "%s", key);
+
+    int e = stats_find(st, k);
+    if (e >= 0)
+        return &st->entries[e];
+    if (!stats_reserve(st))
+        return NULL;
+
+    stats_entry_t *en = &st->entries[st->count];
+    memcpy(en->key, k, sizeof(k));
+    en->value = 0;
+    index_put(st->index, st->index_size, en->key, st->count);
+    st->count++;
+    return en;
+}
 
-        *eq = '\0';
-        const char *key = line;
-        const char *val = eq + 1;
+static void stats_reset(stats_t *st)
+{
+    st->count = 0;
+    if (st->index != NULL)
+        memset(st->index, 0, (size_t)st->index_size * sizeof(*st->index));
+    st->records = 0;
+}
+
+/* ── Log ────────────────────────────────────────────────────────── */
 
-        char *nl = strchr(val, '\n');
-        if (nl != NULL)
-            *nl = '\0';
+/* "key=value" or "key+delta", a space, and the checksum of the rest */
+static int format_record(char *out, size_t len, const char *key, char op, int value)
+{
+    char rec[STATS_LINE_MAX];
+    int n = snprintf(rec, sizeof(rec), "%s%c%d", key, op, value);
+    if (n < 0 || (size_t)n >= sizeof(rec))
+        return 0;
+    n = snprintf(out, len, "%s %08x\n", rec, (unsigned)fnv1a(rec, (size_t)n));
+    return (n > 0 && (size_t)n < len) ? n : 0;
+}
 
-        strncpy(st->entries[st->count].key, key, STATS_KEY_LEN - 1);
-        st->entries[st->count].key[STATS_KEY_LEN - 1] = '\0';
-        st->entries[st->count].value = atoi(val);
-        st->count++;
+/* One line without its newline. Lines from before the log have no
+ * checksum to check. */
+static void apply_record(stats_t *st, const char *s, size_t n, bool checked)
+{
+    char line[STATS_LINE_MAX];
+    if (n >= sizeof(line))
+        return;
+    memcpy(line, s, n);
+    line[n] = '\0';
+
+    char *end;
+    if (checked) {
+        char *sp = strrchr(line, ' ');
+        if (sp == NULL)
+            return;
+        unsigned long sum = strtoul(sp + 1, &end, 16);
+        if (end == sp + 1 || *end != '\0' || sum != fnv1a(line, (size_t)(sp - line)))
+            return;
+        *sp = '\0';
     }
 
-    fclose(f);
-    return true;
+    char *op = line + strcspn(line, "=+");
+    if (*op == '\0' || op == line)
+        return;
+    char kind = *op;
+    *op = '\0';
+    long v = strtol(op + 1, &end, 10);
+    if (end == op + 1)
+        return;
+
+    stats_entry_t *en = stats_entry(st, line);
+    if (en != NULL)
+        en->value = (kind == '=') ? (int)v : en->value + (int)v;
+}
+
+/* Under the lock: catches up with the file. That is whatever was
+ * appended since the last look, or all of it after a compaction. */
+static void stats_sync(stats_t *st)
+{
+    size_t size = 0;
+    const uint8_t *map = platform_map_file(st->path, &size);
+    if (map == NULL) {
+        if (st->offset != 0)
+            stats_reset(st);
+        st->generation = 0;
+        st->offset = 0;
+        st->torn = false;
+        st->legacy = false;
+        return;
+    }
+
+    const char *p = (const char *)map;
+    size_t magic = strlen(STATS_MAGIC);
+    const char *nl = memchr(p, '\n', size);
+    size_t start = st->offset;
+    if (nl != NULL && size > magic && memcmp(p, STATS_MAGIC, magic) == 0) {
+        uint32_t gen = (uint32_t)strtoul(p + magic, NULL, 16);
+        if (gen != st->generation || st->legacy || st->offset == 0 || size < st->offset) {
+            stats_reset(st);
+            st->generation = gen;
+            start = (size_t)(nl - p) + 1;
+        }
+        st->legacy = false;
+    } else {
+        /* Written before the log: read once, then compacted into one */
+        stats_reset(st);
+        st->generation = 0;
+        st->legacy = true;
+        start = 0;
+    }
+
+    size_t i = start;
+    while (i < size) {
+        const char *eol = memchr(p + i, '\n', size - i);
+        if (eol == NULL)
+            break;
+        size_t n = (size_t)(eol - (p + i));
+        apply_record(st, p + i, n, !st->legacy);
+        st->records++;
+        i += n + 1;
+    }
+    /* A line cut short. Its bytes are skipped for good: the next append
+     * ends it with a newline, and then it fails its checksum. */
+    if (start < size)
+        st->torn = i < size;
+    if (st->torn && st->legacy)
+        apply_record(st, p + i, size - i, false);
+    st->offset = size;
+    platform_unmap_file(map, size);
 }
 
-bool stats_save(const stats_t *st)
+static bool stats_append(stats_t *st, const char *buf, size_t len)
 {
-    FILE *f = fopen(st->path, "w");
+    FILE *f = fopen(st->path, "ab");
     if (f == NULL)
         return false;
+    bool ok = fwrite(buf, 1, len, f) == len && platform_sync_file(f) == 0;
+    fclose(f);
+    if (ok) {
+        st->offset += len;
+        st->torn = false;
+    }
+    return ok;
+}
 
-    for (int i = 0; i < st->count; i++)
-        fprintf(f, "%s=%d\n", st->entries[i].key, st->entries[i].value);
+/* Writes one line per entry to a new file and renames it over the log */
+static bool stats_compact(stats_t *st)
+{
+    char tmp[272];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", st->path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+        return false;
 
+    uint32_t gen = (uint32_t)platform_mono_us() ^ ((uint32_t)time(NULL) * 2654435761u);
+    while (gen == 0 || gen == st->generation)
+        gen++;
+
+    char line[STATS_LINE_MAX + 16];
+    int n = snprintf(line, sizeof(line), STATS_MAGIC "%08x\n", (unsigned)gen);
+    size_t size = (size_t)n;
+    bool ok = fwrite(line, 1, (size_t)n, f) == (size_t)n;
+    for (int i = 0; ok && i < st->count; i++) {
+        n = format_record(line, sizeof(line), st->entries[i].key, '=',
+                          st->entries[i].value);
+        ok = fwrite(line, 1, (size_t)n, f) == (size_t)n;
+        size += (size_t)n;
+    }
+    ok = ok && platform_sync_file(f) == 0;
     fclose(f);
+    if (!ok || platform_replace_file(tmp, st->path) < 0) {
+        remove(tmp);
+        return false;
+    }
+
+    st->generation = gen;
+    st->offset = size;
+    st->records = st->count;
+    st->torn = false;
+    st->legacy = false;
     return true;
 }
 
-int stats_get(const stats_t *st, const char *key)
+static bool stats_compact_due(const stats_t *st)
 {
-    for (int i = 0; i < st->count; i++) {
-        if (strcmp(st->entries[i].key, key) == 0)
-            return st->entries[i].value;
-    }
-    return 0;
+    return st->legacy || (st->records > STATS_COMPACT_MIN && st->records > st->count * 4);
 }
 
-void stats_set(stats_t *st, const char *key, int value)
+/* ── Stats ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    const char *key;
+    char        op;      /* '=' sets, '+' adds */
+    int         value;
+} stats_change_t;
+
+/* Applies the changes, then writes them out in one append under the
+ * lock. Without the lock they stay in memory only. */
+static bool stats_commit(stats_t *st, const stats_change_t *ch, int n)
 {
-    for (int i = 0; i < st->count; i++) {
-        if (strcmp(st->entries[i].key, key) == 0) {
-            st->entries[i].value = value;
-            return;
-        }
+    platform_lock_t lk;
+    bool locked = platform_lock(&lk, st->lock_path) == 0;
+    if (locked)
+        stats_sync(st);
+
+    char buf[4 * STATS_LINE_MAX];
+    size_t len = 0;
+    if (st->torn)
+        buf[len++] = '\n';
+    for (int i = 0; i < n; i++) {
+        stats_entry_t *en = stats_entry(st, ch[i].key);
+        if (en == NULL)
+            continue;
+        en->value = (ch[i].op == '=') ? ch[i].value : en->value + ch[i].value;
+        len += (size_t)format_record(buf + len, sizeof(buf) - len, en->key,
+                                     ch[i].op, ch[i].value);
+        st->records++;
     }
 
-    if (st->count < STATS_MAX_ENTRIES) {
-        strncpy(st->entries[st->count].key, key, STATS_KEY_LEN - 1);
-        st->entries[st->count].key[STATS_KEY_LEN - 1] = '\0';
-        st->entries[st->count].value = value;
-        st->count++;
+    bool ok = false;
+    if (locked) {
+        if (st->offset == 0 || stats_compact_due(st))
+            ok = stats_compact(st);
+        else
+            ok = stats_append(st, buf, len);
+        platform_unlock(&lk);
     }
+    return ok;
 }
 
-void stats_increment(stats_t *st, const char *key)
+void stats_init(stats_t *st)
 {
-    stats_set(st, key, stats_get(st, key) + 1);
+    memset(st, 0, sizeof(*st));
+
+    char home[240];
+    platform_get_home_dir(home, sizeof(home));
+    snprintf(st->path, sizeof(st->path), "%s/.bytes_stats", home);
+    snprintf(st->lock_path, sizeof(st->lock_path), "%s.lock", st->path);
 }
 
-void stats_record_game(stats_t *st, const char *game_name, bool won)
+void stats_close(stats_t *st)
+{
+    free(st->entries);
+    free(st->index);
+    st->entries = NULL;
+    st->index = NULL;
+    st->count = st->capacity = st->index_size = 0;
+}
+
+bool stats_load(stats_t *st)
 {
-    char key[STATS_KEY_LEN];
+    platform_lock_t lk;
+    if (platform_lock(&lk, st->lock_path) < 0)
+        return false;
+    stats_sync(st);
+    bool found = st->offset != 0;
+    if (found && stats_compact_due(st))
+        stats_compact(st);
+    platform_unlock(&lk);
+    return found;
+}
 
-    snprintf(key, sizeof(key), "%s_played", game_name);
-    stats_increment(st, key);
+bool stats_save(stats_t *st)
+{
+    platform_lock_t lk;
+    if (platform_lock(&lk, st->lock_path) < 0)
+        return false;
+    stats_sync(st);
+    bool ok = stats_compact(st);
+    platform_unlock(&lk);
+    return ok;
+}
 
-    if (won) {
-        snprintf(key, sizeof(key), "%s_won", game_name);
-        stats_increment(st, key);
-    } else {
-        snprintf(key, sizeof(key), "%s_lost", game_name);
-        stats_increment(st, key);
-    }
+int stats_get(const stats_t *st, const char *key)
+{
+    int e = stats_find(st, key);
+    return (e >= 0) ? st->entries[e].value : 0;
+}
 
-    stats_save(st);
+void stats_set(stats_t *st, const char *key, int value)
+{
+    stats_change_t ch = { key, '=', value };
+    stats_commit(st, &ch, 1);
+}
+
+void stats_increment(stats_t *st, const char *key)
+{
+    stats_change_t ch = { key, '+', 1 };
+    stats_commit(st, &ch, 1);
 }
 
-void stats_display(const stats_t *st)
+void stats_record_game(stats_t *st, const char *game_name, bool won)
+{
+    char played[STATS_KEY_LEN], result[STATS_KEY_LEN];
+    snprintf(played, sizeof(played), "%s_played", game_name);
+    snprintf(result, sizeof(result), "%s_%s", game_name, won ? "won" : "lost");
+
+    stats_change_t ch[2] = {
+        { played, '+', 1 },
+        { result, '+', 1 },
+    };
+    stats_commit(st, ch, 2);
+}
+
+void stats_display(stats_t *st)
 {
+    /* Games other instances have recorded since */
+    platform_lock_t lk;
+    if (platform_lock(&lk, st->lock_path) == 0) {
+        stats_sync(st);
+        platform_unlock(&lk);
+    }
+
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
     clear();
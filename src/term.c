@@ -0,0 +1,441 @@
+#include "term.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TERM_PROBE_US 1000000  /* for a terminal that answers nothing at all */
+
+#define SGR_BOLD 0x100
+#define SGR_DIM  0x200
+
+static struct {
+    bool   enabled;
+    bool   sync;       /* the terminal has DEC mode 2026 */
+    bool   raw;        /* the frame being built is raw */
+    bool   drawn;      /* ...and has something in it */
+    bool   shown;      /* a raw frame is on screen, unknown to curses */
+    int    row, col;   /* where the cursor will be, -1 = unknown */
+    int    sgr;        /* attributes in effect, -1 = unknown */
+    size_t len;
+    char   buf[TERM_BUF_SIZE];
+} g_term = { .row = -1, .col = -1, .sgr = -1 };
+
+static int sgr_key(attr_t attrs, short pair)
+{
+    return pair | ((attrs & A_BOLD) ? SGR_BOLD : 0) | ((attrs & A_DIM) ? SGR_DIM : 0);
+}
+
+/* One code point, as the CH_* glyphs all are */
+static int utf8_encode(wchar_t wc, char *out)
+{
+    uint32_t c = (uint32_t)wc;
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+void term_glyph(term_glyph_t *g, const wchar_t *wch, attr_t attrs, short pair)
+{
+    setcchar(&g->cc, wch, attrs, pair, NULL);
+    g->len = utf8_encode(wch[0], g->utf8);
+    g->sgr = sgr_key(attrs, pair);
+}
+
+/* ── Raw frames ─────────────────────────────────────────────────── */
+
+#ifndef BYTES_WINDOWS
+
+static void raw_write(void)
+{
+    size_t off = 0;
+    while (off < g_term.len) {
+        ssize_t n = write(STDOUT_FILENO, g_term.buf + off, g_term.len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += (size_t)n;
+    }
+    g_term.len = 0;
+}
+
+/* A frame that outgrows the buffer goes out in parts */
+static void raw_append(const char *s, size_t n)
+{
+    if (g_term.len + n > sizeof(g_term.buf))
+        raw_write();
+    memcpy(g_term.buf + g_term.len, s, n);
+    g_term.len += n;
+}
+
+static int fmt_seq(char *out, const char *fmt, int a, int b)
+{
+    int n = snprintf(out, 16, fmt, a, b);
+    return (n > 0 && n < 16) ? n : 0;
+}
+
+/* Relative moves where they come out shorter than an absolute one */
+static void raw_move(int y, int x)
+{
+    int row = g_term.row;
+    int col = g_term.col;
+    if (y == row && x == col)
+        return;
+
+    char abs[16], rel[32];
+    int na = fmt_seq(abs, "\033[%d;%dH", y + 1, x + 1);
+    int nr = sizeof(rel);
+    if (row >= 0 && col >= 0) {
+        nr = 0;
+        if (y < row)
+            nr += fmt_seq(rel + nr, (row - y == 1) ? "\033[A" : "\033[%dA", row - y, 0);
+        else if (y > row)
+            nr += fmt_seq(rel + nr, (y - row == 1) ? "\033[B" : "\033[%dB", y - row, 0);
+        if (x > col)
+            nr += fmt_seq(rel + nr, (x - col == 1) ? "\033[C" : "\033[%dC", x - col, 0);
+        else if (x < col && col - x <= 3)
+            for (int i = 0; i < col - x; i++)
+                rel[nr++] = '\b';
+        else if (x < col)
+            nr += fmt_seq(rel + nr, "\033[%dD", col - x, 0);
+    }
+    if (nr < na)
+        raw_append(rel, (size_t)nr);
+    else
+        raw_append(abs, (size_t)na);
+    g_term.row = y;
+    g_term.col = x;
+}
+
+static void pair_colors(short pair, short *fg, short *bg)
+{
+    *fg = *bg = -1;
+    if (pair > 0 && has_colors())
+        pair_content(pair, fg, bg);
+}
+
+static int color_param(char *out, size_t len, short c, int base)
+{
+    if (c < 0)
+        return snprintf(out, len, ";%d", base + 9);
+    if (c < 8)
+        return snprintf(out, len, ";%d", base + c);
+    return snprintf(out, len, ";%d;5;%d", base + 8, c);
+}
+
+/* Only what differs from the attributes in effect: a reset when one has
+ * to come off, otherwise just what is added and the colors that change */
+static void raw_sgr(int key)
+{
+    int cur = g_term.sgr;
+    if (key == cur)
+        return;
+
+    short fg, bg, cur_fg = -1, cur_bg = -1;
+    pair_colors((short)(key & 0xFF), &fg, &bg);
+    int attrs = key & (SGR_BOLD | SGR_DIM);
+    int cur_attrs = 0;
+    char tmp[48];
+    size_t n = 0;
+
+    if (cur < 0 || (cur & (SGR_BOLD | SGR_DIM) & ~attrs)) {
+        n += (size_t)snprintf(tmp, sizeof(tmp), "\033[0");
+    } else {
+        pair_colors((short)(cur & 0xFF), &cur_fg, &cur_bg);
+        cur_attrs = cur & (SGR_BOLD | SGR_DIM);
+        n += (size_t)snprintf(tmp, sizeof(tmp), "\033[");
+    }
+    if ((attrs & SGR_BOLD) && !(cur_attrs & SGR_BOLD))
+        n += (size_t)snprintf(tmp + n, sizeof(tmp) - n, ";1");
+    if ((attrs & SGR_DIM) && !(cur_attrs & SGR_DIM))
+        n += (size_t)snprintf(tmp + n, sizeof(tmp) - n, ";2");
+    if (fg != cur_fg)
+        n += (size_t)color_param(tmp + n, sizeof(tmp) - n, fg, 30);
+    if (bg != cur_bg)
+        n += (size_t)color_param(tmp + n, sizeof(tmp) - n, bg, 40);
+
+    /* "\033[;1;33m" has an empty first parameter; drop its separator */
+    if (tmp[2] == ';') {
+        memmove(tmp + 2, tmp + 3, n - 3);
+        n--;
+    }
+    if (n > 2) {
+        tmp[n++] = 'm';
+        raw_append(tmp, n);
+    }
+    g_term.sgr = key;
+}
+
+/* A space on the default background looks the same under any attributes */
+static bool raw_blank(const term_glyph_t *g)
+{
+    short fg, bg;
+    pair_colors((short)(g_term.sgr & 0xFF), &fg, &bg);
+    return g->len == 1 && g->utf8[0] == ' ' && g_term.sgr >= 0 && bg < 0;
+}
+
+/* The cursor stops on the last column until the next character wraps
+ * it, which terminals don't all agree on */
+static void raw_advance(int x, int cells)
+{
+    g_term.col = (x + cells < COLS) ? x + cells : -1;
+    g_term.drawn = true;
+}
+
+/* The length of a reply "ESC [ ? params final" at s, or 0 if there
+ * isn't a whole one there */
+static size_t probe_reply(const char *s, size_t n, char final)
+{
+    if (n < 4 || s[0] != '\033' || s[1] != '[' || s[2] != '?')
+        return 0;
+    for (size_t i = 3; i < n; i++) {
+        if (s[i] == final)
+            return i + 1;
+        if ((s[i] < '0' || s[i] > '9') && s[i] != ';' && s[i] != '$')
+            return 0;
+    }
+    return 0;
+}
+
+/* The key typed at s, and how many bytes it took. Curses doesn't
+ * decode what it is handed back, so function keys are looked up here. */
+static int probe_key(const char *s, size_t n, size_t *len)
+{
+#ifdef NCURSES_EXT_FUNCS
+    char seq[16];
+    for (size_t k = 2; s[0] == '\033' && k <= n && k < sizeof(seq); k++) {
+        memcpy(seq, s, k);
+        seq[k] = '\0';
+        int code = key_defined(seq);
+        if (code > 0) {
+            *len = k;
+            return code;
+        }
+        if (code == 0)
+            break;   /* no key starts this way */
+    }
+#endif
+    *len = 1;
+    return (unsigned char)s[0];
+}
+
+/* Asks the terminal whether it knows mode 2026. One that doesn't know
+ * the question just stays quiet, so the question is followed by a
+ * request for the device attributes (DA1), which every terminal
+ * answers, and answers in order: once that reply is in, nothing more
+ * is coming. Keys typed meanwhile go back to curses. */
+static bool probe_sync(void)
+{
+    static const char ask[] = "\033[?2026$p\033[c";
+    if (write(STDOUT_FILENO, ask, sizeof(ask) - 1) < 0)
+        return false;
+
+    char buf[256];
+    size_t n = 0;
+    bool answered = false;
+    int64_t end = platform_mono_us() + TERM_PROBE_US;
+    while (!answered && n < sizeof(buf)) {
+        int64_t left = end - platform_mono_us();
+        struct pollfd p = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+        if (left <= 0 || poll(&p, 1, (int)(left / 1000) + 1) <= 0)
+            break;
+        ssize_t r = read(STDIN_FILENO, buf + n, sizeof(buf) - n);
+        if (r <= 0)
+            break;
+        n += (size_t)r;
+        for (size_t i = 0; i < n && !answered; i++)
+            answered = probe_reply(buf + i, n - i, 'c') > 0;
+    }
+
+    /* Take both replies out, keeping everything else in order */
+    bool sync = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < n;) {
+        size_t len = probe_reply(buf + i, n - i, 'y');
+        if (len == 11 && strncmp(buf + i, "\033[?2026;", 8) == 0)
+            sync = sync || buf[i + 8] == '1' || buf[i + 8] == '2';
+        if (len == 0)
+            len = probe_reply(buf + i, n - i, 'c');
+        if (len > 0) {
+            i += len;
+            continue;
+        }
+        buf[kept++] = buf[i++];
+    }
+
+    int keys[sizeof(buf)];
+    size_t nkeys = 0;
+    for (size_t i = 0, len; i < kept; i += len)
+        keys[nkeys++] = probe_key(buf + i, kept - i, &len);
+    while (nkeys > 0)
+        ungetch(keys[--nkeys]);
+    return sync;
+}
+
+#endif
+
+bool term_use_ansi(void)
+{
+#ifdef BYTES_WINDOWS
+    return false;
+#else
+    if (!isatty(STDOUT_FILENO) || MB_CUR_MAX < 2)
+        return false;
+    g_term.sync = probe_sync();
+    g_term.enabled = true;
+    return true;
+#endif
+}
+
+/* ── Frames ─────────────────────────────────────────────────────── */
+
+bool term_begin(bool full, bool overlay)
+{
+    bool raw = g_term.enabled && !overlay;
+    if (raw != g_term.raw) {
+        full = true;
+        if (!raw)
+            term_release();
+        /* Curses has moved the cursor and set attributes since */
+        g_term.row = g_term.col = -1;
+        g_term.sgr = -1;
+    }
+    g_term.raw = raw;
+    g_term.drawn = false;
+
+    if (full)
+        erase();
+#ifndef BYTES_WINDOWS
+    if (raw) {
+        /* stdscr is erased under raw frames too, so the repaint after
+         * the hand-over shows nothing stale. Marking it as copied keeps
+         * getch() from refreshing it over the raw frame. */
+        if (full)
+            wnoutrefresh(stdscr);
+        g_term.len = 0;
+        if (g_term.sync)
+            raw_append("\033[?2026h", 8);
+        if (full) {
+            raw_append("\033[0m\033[2J", 8);
+            g_term.sgr = 0;
+            g_term.drawn = true;
+        }
+    }
+#endif
+    return full;
+}
+
+void term_present(void)
+{
+    if (!g_term.raw) {
+        refresh();
+        return;
+    }
+#ifndef BYTES_WINDOWS
+    if (!g_term.drawn) {
+        g_term.len = 0;
+        return;
+    }
+    if (g_term.sync)
+        raw_append("\033[?2026l", 8);
+    raw_write();
+    g_term.shown = true;
+#endif
+}
+
+void term_release(void)
+{
+    if (!g_term.shown)
+        return;
+#ifndef BYTES_WINDOWS
+    /* Curses takes the attributes to be off */
+    g_term.len = 0;
+    raw_sgr(0);
+    raw_write();
+#endif
+    clearok(curscr, TRUE);
+    g_term.shown = false;
+    g_term.row = g_term.col = -1;
+}
+
+/* ── Drawing ────────────────────────────────────────────────────── */
+
+void term_put(int y, int x, const term_glyph_t *g)
+{
+#ifndef BYTES_WINDOWS
+    if (g_term.raw) {
+        raw_move(y, x);
+        if (!raw_blank(g))
+            raw_sgr(g->sgr);
+        raw_append(g->utf8, (size_t)g->len);
+        raw_advance(x, 1);
+        return;
+    }
+#endif
+    mvadd_wch(y, x, &g->cc);
+}
+
+void term_hline(int y, int x, const term_glyph_t *g, int n)
+{
+#ifndef BYTES_WINDOWS
+    if (g_term.raw) {
+        raw_move(y, x);
+        raw_sgr(g->sgr);
+        for (int i = 0; i < n; i++)
+            raw_append(g->utf8, (size_t)g->len);
+        raw_advance(x, n);
+        return;
+    }
+#endif
+    mvhline_set(y, x, &g->cc, n);
+}
+
+void term_vline(int y, int x, const term_glyph_t *g, int n)
+{
+#ifndef BYTES_WINDOWS
+    if (g_term.raw) {
+        for (int i = 0; i < n; i++)
+            term_put(y + i, x, g);
+        return;
+    }
+#endif
+    mvvline_set(y, x, &g->cc, n);
+}
+
+void term_text(int y, int x, attr_t attrs, short pair, const char *s)
+{
+#ifndef BYTES_WINDOWS
+    if (g_term.raw) {
+        size_t len = strlen(s);
+        int cells = 0;
+        for (size_t i = 0; i < len; i++)
+            cells += ((s[i] & 0xC0) != 0x80);
+        raw_move(y, x);
+        raw_sgr(sgr_key(attrs, pair));
+        raw_append(s, len);
+        raw_advance(x, cells);
+        return;
+    }
+#endif
+    attron(COLOR_PAIR(pair) | attrs);
+    mvaddstr(y, x, s);
+    attroff(COLOR_PAIR(pair) | attrs);
+}
@@ -0,0 +1,46 @@
+#include "tribuf.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define TRIBUF_FRESH 4u    /* above any slot index */
+
+int tribuf_init(tribuf_t *tb, size_t size)
+{
+    /* Whole slots keep anything stored in them aligned */
+    size_t align = alignof(max_align_t);
+    tb->stride = (size + align - 1) / align * align;
+    tb->slots = calloc(3, tb->stride);
+    tb->back = 0;
+    tb->middle = 1;
+    tb->front = 2;
+    return (tb->slots != NULL) ? 0 : -1;
+}
+
+void tribuf_free(tribuf_t *tb)
+{
+    free(tb->slots);
+    tb->slots = NULL;
+}
+
+void *tribuf_back(tribuf_t *tb)
+{
+    return tb->slots + tb->back * tb->stride;
+}
+
+/* Release: the slot's contents are visible before the reader can take it */
+void tribuf_publish(tribuf_t *tb)
+{
+    uint32_t old = __atomic_exchange_n(&tb->middle, tb->back | TRIBUF_FRESH,
+                                       __ATOMIC_ACQ_REL);
+    tb->back = old & ~TRIBUF_FRESH;
+}
+
+void *tribuf_acquire(tribuf_t *tb)
+{
+    if (!(__atomic_load_n(&tb->middle, __ATOMIC_RELAXED) & TRIBUF_FRESH))
+        return NULL;
+    uint32_t old = __atomic_exchange_n(&tb->middle, tb->front, __ATOMIC_ACQ_REL);
+    tb->front = old & ~TRIBUF_FRESH;
+    return tb->slots + tb->front * tb->stride;
+}
@@ -1,4 +1,5 @@
 #include "ui.h"
+#include "network.h"
 #include "platform.h"
 
 #include <locale.h>
@@ -173,7 +174,8 @@ void ui_get_name(char *name, size_t maxlen)
     keypad(stdscr, TRUE);
 }
 
-void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_port)
+void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_port,
+                          char *room, size_t roomlen)
 {
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
@@ -191,6 +193,10 @@ void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_por
     mvhline(cy + 1, cx, '_', 20);
     attroff(COLOR_PAIR(COLOR_BORDER));
 
+    attron(COLOR_PAIR(COLOR_DIM) | A_DIM);
+    mvaddstr(cy + 3, cx, "host[:port][/room]");
+    attroff(COLOR_PAIR(COLOR_DIM) | A_DIM);
+
     move(cy + 1, cx);
     curs_set(1);
     echo();
@@ -200,23 +206,7 @@ void ui_get_host_and_port(char *host, size_t hostlen, int *port, int default_por
     getnstr(input, 63);
     input[63] = '\0';
 
-    char *colon = strrchr(input, ':');
-    if (colon != NULL) {
-        *colon = '\0';
-        int p = atoi(colon + 1);
-        if (p > 0 && p < 65536)
-            *port = p;
-        else
-            *port = default_port;
-    } else {
-        *port = default_port;
-    }
-
-    if (input[0] == '\0')
-        strncpy(host, "127.0.0.1", hostlen - 1);
-    else
-        strncpy(host, input, hostlen - 1);
-    host[hostlen - 1] = '\0';
+    net_parse_address(input, host, hostlen, port, default_port, room, roomlen);
 
     noecho();
     curs_set(0);
@@ -396,6 +386,108 @@ void ui_pause_overlay(int seconds_left)
     refresh();
 }
 
+void ui_net_hud(const linkstats_t *ls, const char *peer)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+
+    int bw = 30;
+    int bh = 7;
+    int by = 4;
+    int bx = cols - bw - 4;
+    if (bx < 1 || by + bh >= rows)
+        return;
+
+    ui_draw_box(by, bx, bh, bw);
+
+    char line[40];
+    attron(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+    snprintf(line, sizeof(line), " link to %s ", peer);
+    mvaddstr(by, bx + 2, line);
+    attroff(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+
+    attron(COLOR_PAIR(COLOR_BORDER));
+    for (int i = 1; i < bh - 1; i++)
+        mvprintw(by + i, bx + 1, "%*s", bw - 2, "");
+    if (ls->have_rtt) {
+        mvprintw(by + 1, bx + 2, "rtt     %6.1f ms", ls->srtt_ms);
+        mvprintw(by + 2, bx + 2, "jitter  %6.1f ms", ls->jitter_ms);
+    } else {
+        mvaddstr(by + 1, bx + 2, "rtt          -");
+        mvaddstr(by + 2, bx + 2, "jitter       -");
+    }
+    mvprintw(by + 3, bx + 2, "loss    %6.1f %%", ls->loss * 100.0f);
+    mvprintw(by + 4, bx + 2, "in/out  %5.1f / %5.1f KB/s",
+             ls->rx_rate / 1024.0, ls->tx_rate / 1024.0);
+    mvprintw(by + 5, bx + 2, "ticks   %6u /s", (unsigned)ls->tick_rate);
+    attroff(COLOR_PAIR(COLOR_BORDER));
+}
+
+void ui_lockstep_hud(const lockstep_t *ls, bool detail)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+
+    if (ls->desync_tick != 0) {
+        char line[48];
+        snprintf(line, sizeof(line), " out of sync since tick %u ",
+                 (unsigned)ls->desync_tick);
+        attron(COLOR_PAIR(COLOR_ALERT) | A_BOLD);
+        mvaddstr(0, (cols - (int)strlen(line)) / 2, line);
+        attroff(COLOR_PAIR(COLOR_ALERT) | A_BOLD);
+    }
+    if (!detail)
+        return;
+
+    int bw = 30;
+    int bh = 5;
+    int by = 4 + 7;
+    int bx = cols - bw - 4;
+    if (bx < 1 || by + bh >= rows)
+        return;
+
+    ui_draw_box(by, bx, bh, bw);
+    attron(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+    mvaddstr(by, bx + 2, " lockstep ");
+    attroff(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+
+    attron(COLOR_PAIR(COLOR_BORDER));
+    for (int i = 1; i < bh - 1; i++)
+        mvprintw(by + i, bx + 1, "%*s", bw - 2, "");
+    mvprintw(by + 1, bx + 2, "ahead   %6d ticks", (int)(ls->tick - ls->remote_tick));
+    mvprintw(by + 2, bx + 2, "rollbk  %6u", (unsigned)ls->rollbacks);
+    mvprintw(by + 3, bx + 2, "resim   %6u ticks", (unsigned)ls->resimulated);
+    attroff(COLOR_PAIR(COLOR_BORDER));
+}
+
+void ui_replay_bar(int row, uint32_t at, uint32_t total, int speed, bool paused)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    if (row >= rows)
+        row = rows - 1;
+
+    unsigned a = at / TICK_RATE_HZ;
+    unsigned t = total / TICK_RATE_HZ;
+    char line[80];
+    snprintf(line, sizeof(line), " %s %02u:%02u / %02u:%02u  %2dx ",
+             paused ? "||" : "> ", a / 60, a % 60, t / 60, t % 60, speed);
+
+    move(row, 0);
+    clrtoeol();
+    attron(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+    mvaddstr(row, 1, line);
+    attroff(COLOR_PAIR(COLOR_MENU) | A_BOLD);
+
+    const char *help = "space pause  \u2190/\u2192 step  \u2191/\u2193 speed  [/] 10s  q quit";
+    int x = 1 + (int)strlen(line) + 2;
+    if (x + 48 < cols) {
+        attron(COLOR_PAIR(COLOR_DIM) | A_DIM);
+        mvaddstr(row, x, help);
+        attroff(COLOR_PAIR(COLOR_DIM) | A_DIM);
+    }
+}
+
 void ui_show_message(const char *msg)
 {
     int rows, cols;
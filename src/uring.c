@@ -0,0 +1,483 @@
+#include "uring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef BYTES_HAVE_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_BUF_GROUP 0
+
+struct uring {
+    int       fd;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned  sq_entries;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void     *sq_ring;
+    size_t    sq_ring_len;
+    void     *cq_ring;
+    size_t    cq_ring_len;
+    size_t    sqes_len;
+
+    struct io_uring_buf_ring *br;
+    size_t    br_len;
+    uint16_t  br_tail;
+    uint8_t  *bufs;
+
+    unsigned long enters;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+                     unsigned flags, const void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, const void *arg,
+                        unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* ── Submission ─────────────────────────────────────────────────── */
+
+static struct io_uring_sqe *sqe_get(uring_t *u)
+{
+    unsigned tail = *u->sq_tail;
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+        /* Full: hand what we have to the kernel and carry on */
+        if (uring_enter(u, false, 0) < 0 ||
+            tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+            return NULL;
+    }
+
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void sqe_push(uring_t *u)
+{
+    __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+int uring_accept_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+    sqe_push(u);
+    return 0;
+}
+
+int uring_recv_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+    sqe_push(u);
+    return 0;
+}
+
+int uring_poll_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    /* epoll's bits match poll's and carry RDHUP without _GNU_SOURCE */
+    sqe->poll32_events = EPOLLIN | EPOLLRDHUP;
+    sqe->user_data = user_data;
+    sqe_push(u);
+    return 0;
+}
+
+int uring_sendmsg(uring_t *u, int fd, const struct msghdr *msg,
+                  uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+    sqe_push(u);
+    return 0;
+}
+
+int uring_cancel(uring_t *u, uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if (sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    sqe_push(u);
+    return 0;
+}
+
+bool uring_pending(const uring_t *u)
+{
+    return *u->sq_tail != __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_enter(uring_t *u, bool wait, int timeout_ms)
+{
+    unsigned to_submit = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && (!wait || timeout_ms == 0))
+        return 0;
+
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    const void *argp = NULL;
+    size_t argsz = 0;
+
+    if (wait && timeout_ms != 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if (timeout_ms > 0) {
+            memset(&arg, 0, sizeof(arg));
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+
+    u->enters++;
+    if (sys_enter(u->fd, to_submit, min_complete, flags, argp, argsz) < 0 &&
+        errno != ETIME && errno != EINTR && errno != EBUSY)
+        return -1;
+    return 0;
+}
+
+/* ── Completion ─────────────────────────────────────────────────── */
+
+int uring_peek(uring_t *u, uring_cqe_t *cqe)
+{
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    const struct io_uring_cqe *c = &u->cqes[head & *u->cq_mask];
+    cqe->user_data = c->user_data;
+    cqe->res = c->res;
+    cqe->more = (c->flags & IORING_CQE_F_MORE) != 0;
+    cqe->buf_id = (c->flags & IORING_CQE_F_BUFFER)
+                ? (int)(c->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    return 1;
+}
+
+void uring_pop(uring_t *u)
+{
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+const uint8_t *uring_buffer(const uring_t *u, int buf_id)
+{
+    return u->bufs + (size_t)buf_id * URING_BUF_SIZE;
+}
+
+void uring_recycle(uring_t *u, int buf_id)
+{
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)buf_id * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = (uint16_t)buf_id;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+unsigned long uring_enters(const uring_t *u)
+{
+    return u->enters;
+}
+
+/* ── Setup ──────────────────────────────────────────────────────── */
+
+static int map_rings(uring_t *u, const struct io_uring_params *p)
+{
+    u->sq_ring_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_ring_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_len > u->sq_ring_len)
+            u->sq_ring_len = u->cq_ring_len;
+        u->cq_ring_len = u->sq_ring_len;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        return -1;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            return -1;
+        }
+    }
+
+    u->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        return -1;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    uint8_t *cq = u->cq_ring;
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p->sq_off.array);
+    u->sq_entries = p->sq_entries;
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return 0;
+}
+
+static int register_buffers(uring_t *u)
+{
+    u->br_len = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    void *br = mmap(NULL, u->br_len, PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (br == MAP_FAILED)
+        return -1;
+    u->br = br;
+
+    u->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (u->bufs == NULL)
+        return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+
+    for (int i = 0; i < URING_BUF_COUNT; i++)
+        uring_recycle(u, i);
+    return 0;
+}
+
+/* Multishot recv arrived after the other pieces (6.0), and there is no
+ * feature bit for it; try it once on a socket pair. */
+static bool probe_multishot(uring_t *u)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return false;
+
+    bool ok = false;
+    uring_cqe_t cqe;
+    if (uring_recv_multishot(u, sv[0], 1) == 0 &&
+        write(sv[1], "x", 1) == 1 &&
+        uring_enter(u, true, 1000) == 0 &&
+        uring_peek(u, &cqe) == 1) {
+        ok = (cqe.user_data == 1 && cqe.res == 1 && cqe.more);
+        if (cqe.buf_id >= 0)
+            uring_recycle(u, cqe.buf_id);
+        uring_pop(u);
+    }
+
+    uring_cancel(u, 1, 0);
+    close(sv[1]);
+    close(sv[0]);
+    for (int tries = 0; tries < 4 && uring_enter(u, true, 100) == 0; tries++) {
+        while (uring_peek(u, &cqe) == 1) {
+            if (cqe.buf_id >= 0)
+                uring_recycle(u, cqe.buf_id);
+            uring_pop(u);
+        }
+        if (!uring_pending(u))
+            break;
+    }
+    return ok;
+}
+
+uring_t *uring_open(unsigned entries)
+{
+    uring_t *u = calloc(1, sizeof(uring_t));
+    if (u == NULL)
+        return NULL;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    u->fd = sys_setup(entries, &p);
+    if (u->fd < 0) {
+        free(u);
+        return NULL;
+    }
+
+    if (!(p.features & IORING_FEAT_EXT_ARG) || map_rings(u, &p) < 0 ||
+        register_buffers(u) < 0 || !probe_multishot(u)) {
+        uring_close(u);
+        return NULL;
+    }
+    return u;
+}
+
+void uring_close(uring_t *u)
+{
+    if (u == NULL)
+        return;
+    if (u->fd >= 0)
+        close(u->fd);
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->sqes_len);
+    if (u->cq_ring != NULL && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_len);
+    if (u->sq_ring != NULL)
+        munmap(u->sq_ring, u->sq_ring_len);
+    if (u->br != NULL)
+        munmap(u->br, u->br_len);
+    free(u->bufs);
+    free(u);
+}
+
+#else
+
+uring_t *uring_open(unsigned entries)
+{
+    (void)entries;
+    return NULL;
+}
+
+void uring_close(uring_t *u)
+{
+    (void)u;
+}
+
+int uring_accept_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uring_recv_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uring_poll_multishot(uring_t *u, int fd, uint64_t user_data)
+{
+    (void)u; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uring_sendmsg(uring_t *u, int fd, const struct msghdr *msg,
+                  uint64_t user_data)
+{
+    (void)u; (void)fd; (void)msg; (void)user_data;
+    return -1;
+}
+
+int uring_cancel(uring_t *u, uint64_t target, uint64_t user_data)
+{
+    (void)u; (void)target; (void)user_data;
+    return -1;
+}
+
+int uring_enter(uring_t *u, bool wait, int timeout_ms)
+{
+    (void)u; (void)wait; (void)timeout_ms;
+    return -1;
+}
+
+bool uring_pending(const uring_t *u)
+{
+    (void)u;
+    return false;
+}
+
+int uring_peek(uring_t *u, uring_cqe_t *cqe)
+{
+    (void)u; (void)cqe;
+    return 0;
+}
+
+void uring_pop(uring_t *u)
+{
+    (void)u;
+}
+
+const uint8_t *uring_buffer(const uring_t *u, int buf_id)
+{
+    (void)u; (void)buf_id;
+    return NULL;
+}
+
+void uring_recycle(uring_t *u, int buf_id)
+{
+    (void)u; (void)buf_id;
+}
+
+unsigned long uring_enters(const uring_t *u)
+{
+    (void)u;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/* bytes-bench: checks the Pong batch kernel against pong_game_def.update,
+ * then times both on one thread.
+ *
+ *   bytes-bench [games] [ticks]
+ */
+#include "pong_batch.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_ROWS         24
+#define BENCH_COLS         80
+#define BENCH_CHECK_GAMES  1023   /* not a whole number of vectors */
+#define BENCH_CHECK_TICKS  6000
+#define BENCH_HOLD_TICKS   16     /* timed runs change inputs this often */
+
+static uint32_t bench_rand(uint32_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static uint8_t random_held(uint32_t *s)
+{
+    static const uint8_t held[] = { 0, PONG_HOLD_UP, PONG_HOLD_DOWN };
+    return held[bench_rand(s) % 3];
+}
+
+/* Follows the ball, and now and then looks away so points get scored */
+static uint8_t bot_held(const pong_state_t *s, const pong_paddle_t *p, uint32_t *r)
+{
+    if (bench_rand(r) % 4 == 0)
+        return random_held(r);
+    int mid = p->y + p->len / 2;
+    int by = pong_fx_round(s->ball.y);
+    return (by < mid) ? PONG_HOLD_UP : (by > mid) ? PONG_HOLD_DOWN : 0;
+}
+
+static bool same_state(const pong_state_t *a, const pong_state_t *b)
+{
+    return a->ball.x == b->ball.x && a->ball.y == b->ball.y &&
+           a->ball.vx == b->ball.vx && a->ball.vy == b->ball.vy &&
+           a->ball.prev_x == b->ball.prev_x && a->ball.prev_y == b->ball.prev_y &&
+           a->ball.speed == b->ball.speed &&
+           a->p1.y == b->p1.y && a->p2.y == b->p2.y &&
+           a->p1.held == b->p1.held && a->p2.held == b->p2.held &&
+           a->score1 == b->score1 && a->score2 == b->score2 &&
+           a->scored == b->scored && a->rng == b->rng;
+}
+
+/* Runs bots through both batch paths and the game's own update, and
+ * compares every game after every tick. Returns -1 on a mismatch. */
+static int check(void)
+{
+    const game_def_t *def = &pong_game_def;
+    int n = BENCH_CHECK_GAMES;
+    pong_state_t *ref = calloc((size_t)n, sizeof(*ref));
+    pong_batch_t vec, scal;
+    if (ref == NULL || pong_batch_init(&vec, n, BENCH_ROWS, BENCH_COLS) < 0 ||
+        pong_batch_init(&scal, n, BENCH_ROWS, BENCH_COLS) < 0) {
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        def->init(&ref[i], BENCH_ROWS, BENCH_COLS);
+        def->seed(&ref[i], (uint32_t)i * 2654435761u + 1);
+        pong_batch_load(&vec, i, &ref[i]);
+        pong_batch_load(&scal, i, &ref[i]);
+    }
+
+    uint32_t r = 12345;
+    long hits = 0, points = 0;
+    int rc = 0;
+    for (int t = 1; t <= BENCH_CHECK_TICKS && rc == 0; t++) {
+        for (int i = 0; i < n; i++) {
+            uint8_t h1 = bot_held(&ref[i], &ref[i].p1, &r);
+            uint8_t h2 = bot_held(&ref[i], &ref[i].p2, &r);
+            def->set_held(&ref[i], 1, h1);
+            def->set_held(&ref[i], 2, h2);
+            vec.held1[i] = scal.held1[i] = h1;
+            vec.held2[i] = scal.held2[i] = h2;
+
+            pong_fx_t vx = ref[i].ball.vx;
+            def->update(&ref[i]);
+            if (ref[i].scored)
+                points++;
+            else if (ref[i].ball.vx != vx)
+                hits++;
+        }
+        pong_batch_update(&vec);
+        pong_batch_update_scalar(&scal);
+
+        for (int i = 0; i < n; i++) {
+            pong_state_t a, b;
+            pong_batch_store(&vec, i, &a);
+            pong_batch_store(&scal, i, &b);
+            if (!same_state(&a, &ref[i]) || !same_state(&b, &ref[i])) {
+                fprintf(stderr, "Game %d differs at tick %d (%s).\n", i, t,
+                        same_state(&a, &ref[i]) ? "scalar" : pong_batch_kernel());
+                rc = -1;
+                break;
+            }
+        }
+    }
+    if (rc == 0)
+        printf("Checked %d games over %d ticks: %ld paddle hits, %ld points, "
+               "all identical.\n", n, BENCH_CHECK_TICKS, hits, points);
+
+    pong_batch_free(&vec);
+    pong_batch_free(&scal);
+    free(ref);
+    return rc;
+}
+
+static void report(const char *name, long games, long ticks, int64_t us)
+{
+    double n = (double)games * (double)ticks;
+    double sec = (double)(us > 0 ? us : 1) / 1e6;
+    printf("  %-14s %9.1f M game ticks/s  %6.2f ns each\n",
+           name, n / sec / 1e6, sec * 1e9 / n);
+}
+
+/* Game ticks per second through the vtable, one pong_state_t at a time */
+static int time_vtable(int games, int ticks)
+{
+    const game_def_t *def = &pong_game_def;
+    pong_state_t *s = calloc((size_t)games, sizeof(*s));
+    if (s == NULL)
+        return -1;
+    for (int i = 0; i < games; i++) {
+        def->init(&s[i], BENCH_ROWS, BENCH_COLS);
+        def->seed(&s[i], (uint32_t)i + 1);
+    }
+
+    uint32_t r = 1;
+    int64_t start = platform_mono_us();
+    for (int t = 0; t < ticks; t++) {
+        if (t % BENCH_HOLD_TICKS == 0) {
+            for (int i = 0; i < games; i++) {
+                s[i].p1.held = random_held(&r);
+                s[i].p2.held = random_held(&r);
+            }
+        }
+        for (int i = 0; i < games; i++)
+            def->update(&s[i]);
+    }
+    report("vtable", games, ticks, platform_mono_us() - start);
+    free(s);
+    return 0;
+}
+
+static int time_batch(int games, int ticks, bool vector)
+{
+    pong_batch_t b;
+    if (pong_batch_init(&b, games, BENCH_ROWS, BENCH_COLS) < 0)
+        return -1;
+    for (int i = 0; i < games; i++)
+        b.rng[i] = (uint32_t)i + 1;
+
+    uint32_t r = 1;
+    int64_t start = platform_mono_us();
+    for (int t = 0; t < ticks; t++) {
+        if (t % BENCH_HOLD_TICKS == 0) {
+            for (int i = 0; i < games; i++) {
+                b.held1[i] = random_held(&r);
+                b.held2[i] = random_held(&r);
+            }
+        }
+        if (vector)
+            pong_batch_update(&b);
+        else
+            pong_batch_update_scalar(&b);
+    }
+    report(vector ? pong_batch_kernel() : "batch scalar", games, ticks,
+           platform_mono_us() - start);
+    pong_batch_free(&b);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int games = (argc > 1) ? atoi(argv[1]) : 10000;
+    int ticks = (argc > 2) ? atoi(argv[2]) : 3000;
+    if (games <= 0 || ticks <= 0) {
+        fprintf(stderr, "Usage: %s [games] [ticks]\n", argv[0]);
+        return 1;
+    }
+
+    if (check() < 0)
+        return 1;
+
+    printf("%d games of %dx%d, %d ticks, one thread:\n",
+           games, BENCH_COLS, BENCH_ROWS, ticks);
+    if (time_vtable(games, ticks) < 0 || time_batch(games, ticks, false) < 0 ||
+        time_batch(games, ticks, true) < 0) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,411 @@
+/* bytes-loadgen: connects bot players and spectators to a host or a
+ * dedicated server and reports how steadily snapshots reached them.
+ *
+ *   bytes-loadgen host[:port][/room] [--players N] [--spectators N]
+ *                 [--rate HZ] [--seconds S]
+ *
+ * Players are connected first, so a plain host seats the first one.
+ * Given a room, the bots spread over rooms room-0, room-1, ... of two
+ * players each, with spectators dealt round them; a plain host ignores
+ * rooms. Bots speak TCP only and ack every snapshot, as the game does. */
+#include "network.h"
+#include "protocol.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOADGEN_MAX_BOTS   10000
+#define LOADGEN_MAX_EVENTS 256
+#define LOADGEN_WAIT_MS    5
+
+#define HIST_BIN_US 10
+#define HIST_BINS   100000    /* a second; anything longer lands in the last */
+
+typedef struct {
+    uint32_t bins[HIST_BINS];
+    uint64_t count;
+    int64_t  max;
+} hist_t;
+
+typedef enum {
+    BOT_JOINING = 0,          /* hello sent, no welcome yet */
+    BOT_WAITING,              /* welcomed, no game start yet */
+    BOT_PLAYING,
+    BOT_ENDED,                /* saw the game end, then the close */
+    BOT_DROPPED               /* closed on us, or we gave up on it */
+} bot_phase_t;
+
+typedef struct {
+    net_connection_t conn;
+    bool      player;
+    bot_phase_t phase;
+    bool      game_over;
+    bool      paused;
+    int64_t   connected_us;
+    int64_t   last_snap_us;   /* 0 = no gap to measure yet */
+    int64_t   min_offset;     /* arrival less tick time, best so far */
+    bool      have_offset;
+    uint32_t  snapshots;
+    int64_t   max_gap;
+    uint32_t  seq;
+    int64_t   next_input_us;
+} bot_t;
+
+typedef struct {
+    int dropped_waiting;      /* before the game started */
+    int dropped_playing;
+    int send_failures;
+} drops_t;
+
+static volatile int g_quit = 0;
+
+static hist_t  g_gap[2];      /* [0] players, [1] spectators */
+static hist_t  g_jitter[2];
+static hist_t  g_welcome;
+static drops_t g_drops;
+
+static void handle_sigint(int sig)
+{
+    (void)sig;
+    g_quit = 1;
+}
+
+static int parse_int_opt(int argc, char **argv, const char *opt, int default_val)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], opt) == 0)
+            return atoi(argv[i + 1]);
+    }
+    return default_val;
+}
+
+/* ── Histograms ─────────────────────────────────────────────────── */
+
+static void hist_add(hist_t *h, int64_t us)
+{
+    if (us < 0)
+        us = 0;
+    int64_t bin = us / HIST_BIN_US;
+    h->bins[bin < HIST_BINS ? bin : HIST_BINS - 1]++;
+    h->count++;
+    if (us > h->max)
+        h->max = us;
+}
+
+/* Upper edge of the bin holding percentile p, at most the maximum */
+static int64_t hist_pct(const hist_t *h, double p)
+{
+    uint64_t want = (uint64_t)((double)h->count * p / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BINS - 1; i++) {
+        seen += h->bins[i];
+        if (seen > want) {
+            int64_t edge = (int64_t)(i + 1) * HIST_BIN_US;
+            return edge < h->max ? edge : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void hist_print(const char *label, const hist_t *h)
+{
+    if (h->count == 0) {
+        printf("  %-20s %9s\n", label, "none");
+        return;
+    }
+    printf("  %-20s %9llu %8.2f %8.2f %8.2f %8.2f %8.2f\n", label,
+           (unsigned long long)h->count,
+           (double)hist_pct(h, 50) / 1000.0, (double)hist_pct(h, 90) / 1000.0,
+           (double)hist_pct(h, 99) / 1000.0, (double)hist_pct(h, 99.9) / 1000.0,
+           (double)h->max / 1000.0);
+}
+
+/* ── Bots ───────────────────────────────────────────────────────── */
+
+static void bot_drop(bot_t *b, net_loop_t *loop)
+{
+    if (b->phase == BOT_JOINING || b->phase == BOT_WAITING)
+        g_drops.dropped_waiting++;
+    else if (b->phase == BOT_PLAYING && !b->game_over)
+        g_drops.dropped_playing++;
+
+    b->phase = (b->game_over && b->phase == BOT_PLAYING) ? BOT_ENDED : BOT_DROPPED;
+    net_loop_remove(loop, b->conn.fd);
+    net_client_disconnect(&b->conn);
+}
+
+static int bot_send(bot_t *b, net_loop_t *loop, const uint8_t *buf, int n)
+{
+    if (n <= 0)
+        return -1;
+    if (net_send(b->conn.fd, buf, (size_t)n, 100) < 0) {
+        g_drops.send_failures++;
+        bot_drop(b, loop);
+        return -1;
+    }
+    return 0;
+}
+
+/* Gap since the last snapshot, and how much later than its best this
+ * one arrived for its tick: the host ticks at a fixed rate, so on a
+ * steady path arrival less tick time stays constant */
+static void bot_snapshot(bot_t *b, net_loop_t *loop, const uint8_t *payload,
+                         size_t len, int64_t now)
+{
+    msg_snapshot_t snap;
+    if (proto_unpack_snapshot(payload, len, &snap) < 0)
+        return;
+
+    int kind = b->player ? 0 : 1;
+    if (b->last_snap_us != 0) {
+        int64_t gap = now - b->last_snap_us;
+        hist_add(&g_gap[kind], gap);
+        if (gap > b->max_gap)
+            b->max_gap = gap;
+    }
+    b->last_snap_us = now;
+    b->snapshots++;
+
+    int64_t offset = now - (int64_t)snap.tick * TICK_INTERVAL_US;
+    if (!b->have_offset || offset < b->min_offset) {
+        b->min_offset = offset;
+        b->have_offset = true;
+    }
+    hist_add(&g_jitter[kind], offset - b->min_offset);
+
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    bot_send(b, loop, buf, proto_pack_state_ack(buf, sizeof(buf), snap.tick));
+}
+
+static void bot_read(bot_t *b, net_loop_t *loop, int64_t now)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    const uint8_t *frame;
+
+    while (b->phase < BOT_ENDED) {
+        int rr = net_recv_frame(b->conn.fd, &b->conn.rx, &frame, 0);
+        if (rr == 0)
+            return;
+        if (rr < 0) {
+            bot_drop(b, loop);
+            return;
+        }
+
+        msg_header_t hdr;
+        proto_unpack_header(frame, (size_t)rr, &hdr);
+        const uint8_t *payload = frame + MSG_HEADER_SIZE;
+
+        switch (hdr.type) {
+        case MSG_WELCOME:
+            if (b->phase == BOT_JOINING) {
+                hist_add(&g_welcome, now - b->connected_us);
+                b->phase = BOT_WAITING;
+            }
+            break;
+        case MSG_GAME_START:
+            b->phase = BOT_PLAYING;
+            b->next_input_us = now;
+            break;
+        case MSG_SNAPSHOT:
+            if (b->phase == BOT_PLAYING)
+                bot_snapshot(b, loop, payload, hdr.payload_len, now);
+            break;
+        case MSG_PING: {
+            const msg_ping_wire_t *ping = proto_view_ping(payload, hdr.payload_len);
+            if (ping != NULL)
+                bot_send(b, loop, buf, proto_pack_pong(buf, sizeof(buf),
+                                                       proto_get_u32(&ping->seq),
+                                                       proto_get_u64(&ping->time_us)));
+            break;
+        }
+        case MSG_PAUSE:
+            b->paused = true;
+            break;
+        case MSG_RESUME:
+            /* The tick clock stopped meanwhile; start the measures afresh */
+            b->paused = false;
+            b->last_snap_us = 0;
+            b->have_offset = false;
+            break;
+        case MSG_GAME_OVER:
+        case MSG_QUIT:
+            b->game_over = true;
+            break;
+        }
+    }
+}
+
+static void bot_input(bot_t *b, net_loop_t *loop, int64_t period_us, int64_t now)
+{
+    uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+    int32_t key = (rand() % 2 == 0) ? KEY_UP : KEY_DOWN;
+    b->next_input_us += period_us;
+    if (b->next_input_us < now)
+        b->next_input_us = now + period_us;
+    bot_send(b, loop, buf, proto_pack_input(buf, sizeof(buf), ++b->seq, key));
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(bot_t *bots, int count, int connected, double seconds)
+{
+    int phases[BOT_DROPPED + 1] = { 0 };
+    int64_t *worst = calloc((size_t)count, sizeof(int64_t));
+    int nworst = 0;
+    for (int i = 0; i < count; i++) {
+        phases[bots[i].phase]++;
+        if (worst != NULL && bots[i].snapshots > 1)
+            worst[nworst++] = bots[i].max_gap;
+    }
+
+    printf("\nRan %.1f s; %d of %d bots connected.\n\n", seconds, connected, count);
+    printf("  %-20s %9s %8s %8s %8s %8s %8s\n", "ms", "samples",
+           "p50", "p90", "p99", "p99.9", "max");
+    hist_print("welcome", &g_welcome);
+    hist_print("player gap", &g_gap[0]);
+    hist_print("player jitter", &g_jitter[0]);
+    hist_print("spectator gap", &g_gap[1]);
+    hist_print("spectator jitter", &g_jitter[1]);
+
+    if (nworst > 0) {
+        qsort(worst, (size_t)nworst, sizeof(int64_t), cmp_i64);
+        printf("\n  Longest gap per connection: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               (double)worst[nworst / 2] / 1000.0,
+               (double)worst[(int)((double)nworst * 0.99)] / 1000.0,
+               (double)worst[nworst - 1] / 1000.0);
+    }
+    free(worst);
+
+    printf("\n  Still in a game: %d, waiting: %d, ended with the game: %d\n",
+           phases[BOT_PLAYING], phases[BOT_JOINING] + phases[BOT_WAITING],
+           phases[BOT_ENDED]);
+    printf("  Disconnects: %d during a game, %d before one started, "
+           "%d of them on a failed send, %d connects failed\n",
+           g_drops.dropped_playing, g_drops.dropped_waiting,
+           g_drops.send_failures, count - connected);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s host[:port][/room] [--players N] "
+                "[--spectators N] [--rate HZ] [--seconds S]\n", argv[0]);
+        return 1;
+    }
+
+    int players = parse_int_opt(argc, argv, "--players", 1);
+    int spectators = parse_int_opt(argc, argv, "--spectators", MAX_SPECTATORS);
+    int rate = parse_int_opt(argc, argv, "--rate", 10);
+    int seconds = parse_int_opt(argc, argv, "--seconds", 30);
+    int count = players + spectators;
+    if (players < 0 || spectators < 0 || count <= 0 || count > LOADGEN_MAX_BOTS ||
+        rate <= 0 || seconds <= 0) {
+        fprintf(stderr, "Need 1 to %d bots, and a positive rate and duration.\n",
+                LOADGEN_MAX_BOTS);
+        return 1;
+    }
+
+    char host[64];
+    char room[MAX_NAME_LEN];
+    int port = DEFAULT_PORT;
+    net_parse_address(argv[1], host, sizeof(host), &port, DEFAULT_PORT,
+                      room, sizeof(room));
+    int rooms = (players + 1) / 2 > 0 ? (players + 1) / 2 : 1;
+
+    signal(SIGINT, handle_sigint);
+    platform_ignore_sigpipe();
+    platform_raise_fd_limit();
+    if (platform_net_init() < 0)
+        return 1;
+
+    bot_t *bots = calloc((size_t)count, sizeof(bot_t));
+    net_loop_t loop;
+    if (bots == NULL || net_loop_init(&loop, count + 1) < 0) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+
+    printf("Connecting %d players (%d inputs/s each) and %d spectators to %s:%d",
+           players, rate, spectators, host, port);
+    printf(room[0] != '\0' ? " in %d rooms...\n" : "...\n", rooms);
+
+    int connected = 0;
+    for (int i = 0; i < count && !g_quit; i++) {
+        bot_t *b = &bots[i];
+        b->player = i < players;
+        if (net_client_connect(&b->conn, host, port) < 0) {
+            b->phase = BOT_DROPPED;
+            continue;
+        }
+        connected++;
+
+        char name[MAX_NAME_LEN];
+        char bot_room[MAX_NAME_LEN] = "";
+        snprintf(name, sizeof(name), "bot-%c%d", b->player ? 'p' : 's', i);
+        if (room[0] != '\0') {
+            int r = b->player ? i / 2 : (i - players) % rooms;
+            snprintf(bot_room, sizeof(bot_room), "%.16s-%d", room, r);
+        }
+
+        if (net_loop_add_stream(&loop, b->conn.fd, i, &b->conn.rx) < 0) {
+            net_client_disconnect(&b->conn);
+            b->phase = BOT_DROPPED;
+            g_drops.dropped_waiting++;
+            continue;
+        }
+        b->connected_us = platform_mono_us();
+        uint8_t buf[MSG_HEADER_SIZE + MAX_MSG_PAYLOAD];
+        bot_send(b, &loop, buf, proto_pack_hello(buf, sizeof(buf), name,
+                 b->player ? ROLE_PLAYER : ROLE_SPECTATOR, bot_room));
+    }
+
+    int64_t period_us = 1000000 / rate;
+    int64_t start = platform_mono_us();
+    int64_t deadline = start + (int64_t)seconds * 1000000;
+    net_event_t events[LOADGEN_MAX_EVENTS];
+
+    for (;;) {
+        int64_t now = platform_mono_us();
+        if (g_quit || now >= deadline)
+            break;
+
+        int alive = 0;
+        for (int i = 0; i < count; i++) {
+            bot_t *b = &bots[i];
+            if (b->phase >= BOT_ENDED)
+                continue;
+            alive++;
+            if (b->player && b->phase == BOT_PLAYING && !b->paused &&
+                !b->game_over && now >= b->next_input_us)
+                bot_input(b, &loop, period_us, now);
+        }
+        if (alive == 0)
+            break;
+
+        int n = net_loop_wait(&loop, events, LOADGEN_MAX_EVENTS, LOADGEN_WAIT_MS);
+        now = platform_mono_us();
+        for (int e = 0; e < n; e++) {
+            int idx = events[e].tag;
+            if (idx >= 0 && idx < count && bots[idx].phase < BOT_ENDED)
+                bot_read(&bots[idx], &loop, now);
+        }
+    }
+
+    double ran = (double)(platform_mono_us() - start) / 1e6;
+    report(bots, count, connected, ran);
+
+    for (int i = 0; i < count; i++) {
+        if (bots[i].phase < BOT_ENDED)
+            net_client_disconnect(&bots[i].conn);
+    }
+    net_loop_close(&loop);
+    free(bots);
+    platform_net_cleanup();
+    return 0;
+}